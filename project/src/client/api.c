@@ -14,20 +14,37 @@
 #include "../common/constants.h"
 #include "../common/protocol.h"
 #include "../common/io.h"
+#include "../common/ring.h"
+#include <stdint.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <errno.h>
+#include <limits.h>
 #include <bits/types/sigset_t.h>
 #include <signal.h>
 #include <bits/sigaction.h>
 #include <pthread.h>
+#include <poll.h>
 
 #define NOT_EXISTENT -1
 
+// Requests of the asynchronous api that may wait for their completion
+#define MAX_IN_FLIGHT 256
+
+#define CACHE_BUCKETS 1024
+
+// Bytes of notifications read at once
+#define NOTIF_BUFFER_SIZE 65536
+
 // The file descriptores of the client's pipes
 int REQ_FD = NOT_EXISTENT, RESP_FD = NOT_EXISTENT, NOTIF_FD = NOT_EXISTENT;
 
@@ -36,7 +53,156 @@ char REQ_PATH[MAX_PIPE_PATH_LENGTH] = {'\0'},
      RESP_PATH[MAX_PIPE_PATH_LENGTH] = {'\0'},
      NOTIF_PATH[MAX_PIPE_PATH_LENGTH] = {'\0'};
 
+// When connected through a socket, the three descriptors are the socket.
+// It is only closed by the next connection, since the notifications thread
+// may still be reading it.
+int SOCKET_FD = NOT_EXISTENT;
+
+// The bytes of a channel received through the socket by the thread that
+// does not read that channel, kept until the one that does asks for them
+typedef struct {
+  char* data;
+  size_t len, cap;
+  int wake_fd;    // Signalled when bytes are kept for the channel
+} Inbox;
+
+// Inboxes of the responses and of the notifications. Their events are kept
+// across the connections, since the notifications thread may wait on them.
+static Inbox INBOXES[2] = {{NULL, 0, 0, NOT_EXISTENT}, {NULL, 0, 0, NOT_EXISTENT}};
+static int SOCKET_CLOSED = 0;
+static pthread_mutex_t INBOX_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+// Readable when responses arrive through the socket or are kept in their inbox
+static int COMPLETION_FD = NOT_EXISTENT;
+
+// The shared memory ring of the notifications, when the notifications
+// path has the ring scheme. It is only unmapped by the next connection,
+// since the notifications thread may still be reading it.
+NotifRing* NOTIF_RING = NULL;
+
+// A request of the asynchronous api, from its submission until its
+// completion is collected
+typedef struct {
+  uint32_t id;      // 0 while the slot is free
+  int opcode, done, result;
+  size_t num_keys;
+  char (*values)[MAX_STRING_SIZE];
+  int* flags;
+} AsyncRequest;
+
+static AsyncRequest REQUESTS[MAX_IN_FLIGHT];
+static uint32_t NEXT_REQUEST_ID = 1;
+
+// Requests submitted but not yet written to the request pipe
+static char* SUBMITTED = NULL;
+static size_t SUBMITTED_LEN = 0, SUBMITTED_CAP = 0;
+
+// Slots of the completed requests, in the order they completed
+static size_t COMPLETED[MAX_IN_FLIGHT];
+static size_t COMPLETED_HEAD = 0, COMPLETED_COUNT = 0, IN_FLIGHT = 0;
+
+// Bytes of responses read but not yet parsed
+static char RESPONSES[sizeof(uint32_t) + MAX_RESPONSE_SIZE + PIPE_BUF];
+static size_t RESPONSES_LEN = 0;
+
+static void async_reset(){
+  memset(REQUESTS, 0, sizeof(REQUESTS));
+  SUBMITTED_LEN = COMPLETED_HEAD = COMPLETED_COUNT = IN_FLIGHT = RESPONSES_LEN = 0;
+}
+
+// A value of the read cache. The key is subscribed while it is cached,
+// so the notifications keep the value up to date.
+typedef struct CacheEntry {
+  char key[MAX_STRING_SIZE];
+  char value[MAX_STRING_SIZE];
+  int pending;    // Subscribed, but its value is still being read
+  int notified;   // Notified while pending, so the value read is older
+  struct CacheEntry* next;
+} CacheEntry;
+
+// The cache is shared with the thread that reads the notifications
+static CacheEntry* CACHE[CACHE_BUCKETS];
+static size_t CACHE_COUNT = 0, CACHE_CAPACITY = 0;
+static pthread_mutex_t CACHE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+// Sequence every change up to which was notified, kept across the
+// connections with the epoch of the server that sent it, 0 until a server
+// is connected
+static uint64_t LAST_SEQUENCE = 0, LAST_EPOCH = 0;
+static uint64_t SERVER_EPOCH = 0;   // Epoch of the server connected
+static pthread_mutex_t SEQUENCE_LOCK = PTHREAD_MUTEX_INITIALIZER;
+
+// Notification frames read but not yet parsed, only used by the thread
+// that reads the notifications
+static char NOTIF_BUFFER[NOTIF_BUFFER_SIZE];
+static size_t NOTIF_START = 0, NOTIF_LEN = 0;
+
+// Finds the link to the entry of a key, or to the end of its bucket
+static CacheEntry** cache_find(const char* key){
+  size_t hash = 2166136261u;
+  for(const char* c = key; *c != '\0'; c++)
+    hash = (hash ^ (unsigned char) *c) * 16777619u;
+
+  CacheEntry** link = &CACHE[hash % CACHE_BUCKETS];
+  while(*link != NULL && strcmp((*link)->key, key) != 0)
+    link = &(*link)->next;
+  return link;
+}
+
+static void cache_remove(const char* key){
+  CacheEntry** link = cache_find(key);
+  CacheEntry* entry = *link;
+  if(entry != NULL){
+    *link = entry->next;
+    free(entry);
+    CACHE_COUNT--;
+  }
+}
+
+static void cache_clear(){
+  pthread_mutex_lock(&CACHE_LOCK);
+  for(size_t i = 0; i < CACHE_BUCKETS; i++)
+    while(CACHE[i] != NULL){
+      CacheEntry* entry = CACHE[i];
+      CACHE[i] = entry->next;
+      free(entry);
+    }
+  CACHE_COUNT = 0;
+  pthread_mutex_unlock(&CACHE_LOCK);
+}
+
+// Writes a request built after the room for its header, which tells the
+// server its size
+static int write_request(char* frame, size_t size){
+  uint32_t request_size = (uint32_t) size;
+  memcpy(frame, &request_size, REQUEST_HEADER_SIZE);
+  return write_all(REQ_FD, frame, REQUEST_HEADER_SIZE + size);
+}
+
+static int uses_ring(){
+  return strncmp(NOTIF_PATH, RING_SCHEME, strlen(RING_SCHEME)) == 0;
+}
+
+static int uses_socket(){
+  return SOCKET_FD != NOT_EXISTENT && RESP_FD == SOCKET_FD;
+}
+
 int close_and_unlink(){
+  // The cached keys are no longer subscribed
+  cache_clear();
+
+  if(uses_ring() && shm_unlink(NOTIF_PATH + strlen(RING_SCHEME)) != 0 && errno != ENOENT){
+    fprintf(stderr, "Unlink(%s) failed.\n", NOTIF_PATH);
+    return 1;
+  }
+
+  if(uses_socket()){
+    // Wakes the threads reading the socket, which see the end of the connection
+    shutdown(SOCKET_FD, SHUT_RDWR);
+    REQ_FD = RESP_FD = NOTIF_FD = NOT_EXISTENT;
+    return 0;
+  }
+
   // Closes pipes and unlinks pipes files
   if(REQ_FD != NOT_EXISTENT)close(REQ_FD);
   if(RESP_FD != NOT_EXISTENT)close(RESP_FD);
@@ -50,7 +216,7 @@ int close_and_unlink(){
     fprintf(stderr, "Unlink(%s) failed.\n", RESP_PATH);
     return 1;
   }
-  if(unlink(NOTIF_PATH) != 0 && errno != ENOENT){
+  if(!uses_ring() && unlink(NOTIF_PATH) != 0 && errno != ENOENT){
     fprintf(stderr, "Unlink(%s) failed.\n", NOTIF_PATH);
     return 1;
   }
@@ -58,43 +224,190 @@ int close_and_unlink(){
   return 0;
 }
 
-int kvs_connect(char const* req_pipe_path, char const* resp_pipe_path,
-                char const* server_pipe_path, char const* notif_pipe_path,
-                int* notif_pipe){
-  // Blocks SIGPIPE
-  sigset_t sigset;
-  sigemptyset(&sigset);
-  sigaddset(&sigset, SIGPIPE);
-  if(pthread_sigmask(SIG_BLOCK, &sigset, NULL) != 0){
-    fprintf(stderr,"[API] Failed to mask SIGPIPE.\n");
-    pthread_exit(NULL);
+static int inbox_append(Inbox* inbox, const char* data, size_t size){
+  if(inbox->len + size > inbox->cap){
+    size_t cap = inbox->cap ? inbox->cap : MAX_SOCKET_MESSAGE_SIZE;
+    while(cap < inbox->len + size)
+      cap *= 2;
+    char* grown = realloc(inbox->data, cap);
+    if(grown == NULL)
+      return 1;
+    inbox->data = grown;
+    inbox->cap = cap;
   }
-  
-  // Copies every pipe path in order to be accessible for other functions of the api
-  strcpy(REQ_PATH, req_pipe_path);
-  strcpy(RESP_PATH, resp_pipe_path);
-  strcpy(NOTIF_PATH, notif_pipe_path);
+  memcpy(inbox->data + inbox->len, data, size);
+  inbox->len += size;
+  return 0;
+}
 
-  if(close_and_unlink()){
-    fprintf(stderr, "[API] Falied to unlink and close the client's pipes.\n");
+// Reads up to size bytes of a channel from the socket, as read does. The
+// messages of the other channel received meanwhile are kept in its inbox,
+// and the thread reading it is woken. If wait is 0 and there are no bytes
+// of the channel, fails with EAGAIN.
+static ssize_t socket_read(char channel, void* buffer, size_t size, int wait){
+  Inbox* own = &INBOXES[channel == CHANNEL_NOTIFICATION];
+  Inbox* other = &INBOXES[channel != CHANNEL_NOTIFICATION];
+  char message[MAX_SOCKET_MESSAGE_SIZE];
+  uint64_t value = 1;
+
+  while(1){
+    pthread_mutex_lock(&INBOX_LOCK);
+    if(own->len > 0){
+      size_t count = own->len < size ? own->len : size;
+      memcpy(buffer, own->data, count);
+      memmove(own->data, own->data + count, own->len - count);
+      own->len -= count;
+      pthread_mutex_unlock(&INBOX_LOCK);
+      return (ssize_t) count;
+    }
+    int closed = SOCKET_CLOSED;
+    pthread_mutex_unlock(&INBOX_LOCK);
+    if(closed)
+      return 0;
+
+    struct pollfd fds[2] = {
+      {.fd = SOCKET_FD, .events = POLLIN, .revents = 0},
+      {.fd = own->wake_fd, .events = POLLIN, .revents = 0}
+    };
+    int ready = poll(fds, 2, wait ? -1 : 0);
+    if(ready < 0 && errno != EINTR)
+      return -1;
+    if(ready == 0){
+      errno = EAGAIN;
+      return -1;
+    }
+    if(ready < 0)
+      continue;
+    if((fds[1].revents & POLLIN) && read(own->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+      return -1;
+    if(!(fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+      continue;
+
+    // The other thread may have received the message first
+    ssize_t received = recv(SOCKET_FD, message, MAX_SOCKET_MESSAGE_SIZE, MSG_DONTWAIT);
+    if(received < 0){
+      if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    Inbox* inbox = received > 0 && message[0] == CHANNEL_NOTIFICATION ? &INBOXES[1] : &INBOXES[0];
+    int failed = 0;
+    pthread_mutex_lock(&INBOX_LOCK);
+    if(received == 0)
+      SOCKET_CLOSED = 1;
+    else
+      failed = inbox_append(inbox, message + 1, (size_t) received - 1);
+    pthread_mutex_unlock(&INBOX_LOCK);
+    if(failed){
+      fprintf(stderr, "[API] Failed to keep a message received through the socket.\n");
+      return -1;
+    }
+
+    // The other thread also learns about the end of the connection
+    value = 1;
+    if((received == 0 || inbox == other) && write(other->wake_fd, &value, sizeof(value)) < 0)
+      return -1;
+  }
+}
+
+// Reads a whole response, from the response pipe or from the socket.
+// Returns 1 on success, 0 if the server closed the connection, -1 on error.
+static int read_response(void* buffer, size_t size){
+  if(!uses_socket())
+    return read_all(RESP_FD, buffer, size, NULL);
+
+  for(size_t done = 0; done < size;){
+    ssize_t result = socket_read(CHANNEL_RESPONSE, (char*) buffer + done, size - done, 1);
+    if(result <= 0)
+      return (int) result;
+    done += (size_t) result;
+  }
+  return 1;
+}
+
+// Connects through the server socket and sends the connection request,
+// which names the client after its request pipe, since no pipe is created
+static int socket_open(char const* socket_path){
+  struct sockaddr_un address;
+  if(strlen(socket_path) >= sizeof(address.sun_path)){
+    fprintf(stderr, "[API] The server socket path is too long.\n");
+    return 1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+
+  for(int i = 0; i < 2; i++)
+    if(INBOXES[i].wake_fd == NOT_EXISTENT
+       && (INBOXES[i].wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0){
+      fprintf(stderr, "[API] Failed to create the events of the socket.\n");
+      INBOXES[i].wake_fd = NOT_EXISTENT;
+      return 1;
+    }
+
+  if((SOCKET_FD = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0){
+    fprintf(stderr, "[API] Failed to create the socket.\n");
+    SOCKET_FD = NOT_EXISTENT;
     return 1;
   }
 
+  // The completions are waited for on the socket and on the inbox of the responses
+  struct epoll_event socket_event = {.events = EPOLLIN, .data.fd = SOCKET_FD},
+                     inbox_event = {.events = EPOLLIN, .data.fd = INBOXES[0].wake_fd};
+  if(connect(SOCKET_FD, (struct sockaddr*) &address, sizeof(address)) < 0
+     || (COMPLETION_FD = epoll_create1(EPOLL_CLOEXEC)) < 0
+     || epoll_ctl(COMPLETION_FD, EPOLL_CTL_ADD, SOCKET_FD, &socket_event) < 0
+     || epoll_ctl(COMPLETION_FD, EPOLL_CTL_ADD, INBOXES[0].wake_fd, &inbox_event) < 0){
+    fprintf(stderr, "[API] Failed to connect to the server socket.\n");
+    if(COMPLETION_FD >= 0)
+      close(COMPLETION_FD);
+    close(SOCKET_FD);
+    SOCKET_FD = COMPLETION_FD = NOT_EXISTENT;
+    return 1;
+  }
+
+  pthread_mutex_lock(&INBOX_LOCK);
+  INBOXES[0].len = INBOXES[1].len = 0;
+  SOCKET_CLOSED = 0;
+  pthread_mutex_unlock(&INBOX_LOCK);
+
+  REQ_FD = RESP_FD = NOTIF_FD = SOCKET_FD;
+
+  char request[SOCKET_CONNECT_SIZE] = {'\0'};
+  const char* name = strrchr(REQ_PATH, '/');
+  request[0] = '0' + OP_CODE_CONNECT;
+  strncpy(request + 1, name != NULL ? name + 1 : REQ_PATH, MAX_PIPE_PATH_LENGTH - 1);
+  strncpy(request + 1 + MAX_PIPE_PATH_LENGTH, NOTIF_PATH, MAX_PIPE_PATH_LENGTH - 1);
+
+  // Writes the connection request to the server socket
+  if(write_all(SOCKET_FD, request, SOCKET_CONNECT_SIZE) == -1){
+    fprintf(stderr, "[API] Failed to write the connection request to the server socket.\n");
+    close_and_unlink();
+    return 1;
+  }
+
+  return 0;
+}
+
+// Creates the client pipes and sends the connection request
+// through the server pipe
+static int pipes_open(char const* server_pipe_path, char const* request, size_t size){
   // Creates the request pipe
-  if(mkfifo(req_pipe_path, 0640) != 0){
+  if(mkfifo(REQ_PATH, 0640) != 0){
     fprintf(stderr, "[API] Failed to create request pipe.\n");
     return 1;
   }
 
   // Creates the response pipe
-  if(mkfifo(resp_pipe_path, 0640) != 0){
+  if(mkfifo(RESP_PATH, 0640) != 0){
     fprintf(stderr, "[API] Failed to create response pipe.\n");
     close_and_unlink();
     return 1;
   }
 
   // Creates the notifications pipe
-  if(mkfifo(notif_pipe_path, 0640) != 0){
+  if(!uses_ring() && mkfifo(NOTIF_PATH, 0640) != 0){
     close_and_unlink();
     fprintf(stderr, "[API] Failed to create notifications pipe.\n");
     return 1;
@@ -108,6 +421,65 @@ int kvs_connect(char const* req_pipe_path, char const* resp_pipe_path,
     return 1;
   }
 
+  // Writes the connection request to the server pipe
+  if(write_all(server_fd, request, size) == -1){
+    fprintf(stderr, "[API] Failed to write the connection request to the server pipe.\n");
+    close(server_fd);
+    close_and_unlink();
+    return 1;
+  }
+
+  close(server_fd);
+
+  // Opens the client pipes
+  RESP_FD = open(RESP_PATH, O_RDONLY);
+  REQ_FD = open(REQ_PATH, O_WRONLY);
+  if(!uses_ring())
+    NOTIF_FD = open(NOTIF_PATH, O_RDONLY);
+  return 0;
+}
+
+int kvs_connect(char const* req_pipe_path, char const* resp_pipe_path,
+                char const* server_pipe_path, char const* notif_pipe_path,
+                int* notif_pipe){
+  // Blocks SIGPIPE
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGPIPE);
+  if(pthread_sigmask(SIG_BLOCK, &sigset, NULL) != 0){
+    fprintf(stderr,"[API] Failed to mask SIGPIPE.\n");
+    pthread_exit(NULL);
+  }
+  
+  // Copies every pipe path in order to be accessible for other functions of the api
+  strcpy(REQ_PATH, req_pipe_path);
+  strcpy(RESP_PATH, resp_pipe_path);
+  strcpy(NOTIF_PATH, notif_pipe_path);
+
+  if(close_and_unlink()){
+    fprintf(stderr, "[API] Falied to unlink and close the client's pipes.\n");
+    return 1;
+  }
+  if(SOCKET_FD != NOT_EXISTENT){
+    close(SOCKET_FD);
+    close(COMPLETION_FD);
+    SOCKET_FD = COMPLETION_FD = NOT_EXISTENT;
+  }
+
+  async_reset();
+  cache_clear();
+  NOTIF_START = NOTIF_LEN = 0;
+
+  // Creates the ring before the server is asked to map it
+  if(NOTIF_RING != NULL){
+    ring_unmap(NOTIF_RING);
+    NOTIF_RING = NULL;
+  }
+  if(uses_ring() && (NOTIF_RING = ring_create(NOTIF_PATH + strlen(RING_SCHEME))) == NULL){
+    fprintf(stderr, "[API] Failed to create the notifications ring.\n");
+    return 1;
+  }
+
   // Creates the connection request to be sent to the server
   // content of the message:
   // OP_CODE = 1
@@ -119,29 +491,23 @@ int kvs_connect(char const* req_pipe_path, char const* resp_pipe_path,
      || snprintf(message + 1, MAX_PIPE_PATH_LENGTH, "%s", REQ_PATH) < 0
      || snprintf(message + 1 + MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH, "%s", RESP_PATH) < 0
      || snprintf(message + 1 + 2*MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH, "%s", NOTIF_PATH) < 0){
-      close_and_unlink();
       fprintf(stderr, "[API] Failed to create connection request.\n");
       return 1;
      }
 
-  // Writes the connection request to the server pipe
-  if(write_all(server_fd, message, 3*MAX_PIPE_PATH_LENGTH + 1) == -1){
-    fprintf(stderr, "[API] Failed to write the connection request to the server pipe.\n");
-    close_and_unlink();
+  // The transport is chosen by the scheme of the server path
+  size_t scheme_length = strlen(SOCKET_SCHEME);
+  if(strncmp(server_pipe_path, SOCKET_SCHEME, scheme_length) == 0){
+    if(socket_open(server_pipe_path + scheme_length))
+      return 1;
+  }else if(pipes_open(server_pipe_path, message, 3*MAX_PIPE_PATH_LENGTH + 1)){
     return 1;
   }
-
-  close(server_fd);
-
-  // Opens the client pipes
-  RESP_FD = open(resp_pipe_path, O_RDONLY);
-  REQ_FD = open(req_pipe_path, O_WRONLY);
-  NOTIF_FD = open(notif_pipe_path, O_RDONLY);
   *notif_pipe = NOTIF_FD;
 
   // Reads the result of the connection from the response pipe
   char result[2] = {'\0'};
-  if(read_all(RESP_FD, result, 2, NULL) <= 0){
+  if(read_response(result, 2) <= 0){
     fprintf(stderr, "[API] Failed to read the connection result from the response pipe.\n");
     close_and_unlink();
     return 1;
@@ -156,8 +522,27 @@ int kvs_connect(char const* req_pipe_path, char const* resp_pipe_path,
   }
   write_all(1, response, 45);
 
-  if(result[1] - '0' == 1)
+  // A connected server follows the result with its epoch
+  uint64_t epoch;
+  if(result[1] == '0' && read_response((char*) &epoch, sizeof(epoch)) <= 0){
+    fprintf(stderr, "[API] Failed to read the server epoch from the response pipe.\n");
+    close_and_unlink();
+    return 1;
+  }
+
+  if(result[1] - '0' == 1){
     close_and_unlink();
+  }else{
+    // The sequences are of the first server until a notification is read
+    pthread_mutex_lock(&SEQUENCE_LOCK);
+    SERVER_EPOCH = epoch;
+    if(LAST_EPOCH == 0)
+      LAST_EPOCH = epoch;
+    pthread_mutex_unlock(&SEQUENCE_LOCK);
+  }
+  if(result[1] == '0' && uses_ring())
+    // Both sides have mapped the ring, its name is no longer needed
+    shm_unlink(NOTIF_PATH + strlen(RING_SCHEME));
   
   return result[1] - '0';
 }
@@ -170,13 +555,11 @@ int kvs_disconnect(int force_closing){
   // disconnection request to the server
   if(!force_closing){
     // Creates the disconnection request to be sent to the server
-    if(snprintf(message, 2, "%d", OP_CODE_DISCONNECT) < 0){
-      fprintf(stderr, "[API] Failed to create disconnection request.\n");
-      return 1;
-    }
+    char request[REQUEST_HEADER_SIZE + 1];
+    request[REQUEST_HEADER_SIZE] = '0' + OP_CODE_DISCONNECT;
 
     // Writes the disconnection request to the server pipe
-    if(write_all(REQ_FD, message, 1) == -1){
+    if(write_request(request, 1) == -1){
       fprintf(stderr, "[API] Failed to write the disconnection request to the request pipe.\n");
       if(errno == EPIPE){
         fprintf(stderr, "[API] Server connection lost.\n");
@@ -187,7 +570,7 @@ int kvs_disconnect(int force_closing){
 
     // Reads the result of the disconnection from the response pipe
     int io_result;
-    if((io_result = read_all(RESP_FD, message, 2, NULL)) <= 0){
+    if((io_result = read_response(message, 2)) <= 0){
       fprintf(stderr, "[API] Failed to read the disconnection result from the response pipe.\n");
       if(io_result == 0)
         fprintf(stderr, "[API] Server connection lost.\n");
@@ -214,14 +597,12 @@ int kvs_disconnect(int force_closing){
 
 int kvs_subscribe(const char* key){
   // Creates the subscription request to be sent to the server
-  char request[MAX_STRING_SIZE + 2] = {'\0'};
-  if(snprintf(request, MAX_STRING_SIZE + 2, "%d%s", OP_CODE_SUBSCRIBE, key) < 0){
-    fprintf(stderr, "[API] Failed to create subscription request.\n");
-    return 1;
-  }
+  char request[REQUEST_HEADER_SIZE + 1 + MAX_STRING_SIZE] = {'\0'};
+  request[REQUEST_HEADER_SIZE] = '0' + OP_CODE_SUBSCRIBE;
+  strncpy(request + REQUEST_HEADER_SIZE + 1, key, MAX_STRING_SIZE - 1);
 
   // Writes subscription request to the request pipe
-  if(write_all(REQ_FD, request, MAX_STRING_SIZE + 2) == -1){
+  if(write_request(request, 1 + MAX_STRING_SIZE) == -1){
     fprintf(stderr, "[API] Failed to write the subscription request to the request pipe.\n");
     if(errno == EPIPE){
       fprintf(stderr, "[API] Server connection lost.\n");
@@ -233,7 +614,7 @@ int kvs_subscribe(const char* key){
   // Reads the result of the subscription from the response pipe
   int io_result;
   char result[2] = {'\0'};
-  if((io_result = read_all(RESP_FD, result, 2, NULL)) <= 0){
+  if((io_result = read_response(result, 2)) <= 0){
     fprintf(stderr, "[API] Failed to read the subscription result from the response pipe.\n");
     if(io_result == 0)
       fprintf(stderr, "[API] Server connection lost.\n");
@@ -253,16 +634,18 @@ int kvs_subscribe(const char* key){
 }
 
 int kvs_unsubscribe(const char* key){
+  // A key that is no longer subscribed can not stay cached
+  pthread_mutex_lock(&CACHE_LOCK);
+  cache_remove(key);
+  pthread_mutex_unlock(&CACHE_LOCK);
+
   // Creates the unsubscription request to be sent to the server
-  char request[MAX_STRING_SIZE + 2] = {'\0'};
-  if(snprintf(request, MAX_STRING_SIZE + 2, "%d%s",
-              OP_CODE_UNSUBSCRIBE, key) < 0){
-    fprintf(stderr, "[API] Failed to create unsubscription request.\n");
-    return 1;
-  }
+  char request[REQUEST_HEADER_SIZE + 1 + MAX_STRING_SIZE] = {'\0'};
+  request[REQUEST_HEADER_SIZE] = '0' + OP_CODE_UNSUBSCRIBE;
+  strncpy(request + REQUEST_HEADER_SIZE + 1, key, MAX_STRING_SIZE - 1);
 
   // Writes unsubscription request to the request pipe
-  if(write_all(REQ_FD, request, MAX_STRING_SIZE + 2) == -1){
+  if(write_request(request, 1 + MAX_STRING_SIZE) == -1){
     fprintf(stderr, "[API] Failed to write the unsubscription request to the request pipe.\n");
     if(errno == EPIPE){
       fprintf(stderr, "[API] Server connection lost.\n");
@@ -274,7 +657,7 @@ int kvs_unsubscribe(const char* key){
   // Reads the result of the unsubscription from the response pipe
   int io_result;
   char result[2] = {'\0'};
-  if((io_result = read_all(RESP_FD, result, 2, NULL)) <= 0){
+  if((io_result = read_response(result, 2)) <= 0){
     fprintf(stderr, "[API] Failed to read the unsubscription result from the validation pipe.\n");
     if(io_result == 0)
       fprintf(stderr, "[API] Server connection lost.\n");
@@ -293,4 +676,694 @@ int kvs_unsubscribe(const char* key){
   return result[1] - '0';
 }
 
+// Sends a batched request, the values following the keys for the writes
+// and the sequence and its epoch for the resume, and reads the op code and
+// the result of the response
+static int batch_request(int opcode, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                         char values[][MAX_STRING_SIZE], const uint64_t sequence[2], char result[2]){
+  if(num_keys == 0 || num_keys > MAX_BATCH_SIZE){
+    fprintf(stderr, "[API] A request must have between 1 and %d keys.\n", MAX_BATCH_SIZE);
+    return 1;
+  }
+
+  // Creates the request to be sent to the server
+  char request[REQUEST_HEADER_SIZE + 1 + sizeof(uint16_t) + 2*MAX_BATCH_SIZE*MAX_STRING_SIZE
+               + 2*sizeof(uint64_t)];
+  uint16_t batch_size = (uint16_t) num_keys;
+  size_t size = REQUEST_HEADER_SIZE;
+  request[size++] = (char) ('0' + opcode);
+  memcpy(request + size, &batch_size, sizeof(batch_size));
+  size += sizeof(batch_size);
+  for(size_t i = 0; i < num_keys; i++, size += MAX_STRING_SIZE)
+    strncpy(request + size, keys[i], MAX_STRING_SIZE);
+  for(size_t i = 0; values != NULL && i < num_keys; i++, size += MAX_STRING_SIZE)
+    strncpy(request + size, values[i], MAX_STRING_SIZE);
+  if(sequence != NULL){
+    memcpy(request + size, sequence, 2*sizeof(uint64_t));
+    size += 2*sizeof(uint64_t);
+  }
+
+  // Writes the request to the request pipe
+  if(write_request(request, size - REQUEST_HEADER_SIZE) == -1){
+    fprintf(stderr, "[API] Failed to write the request to the request pipe.\n");
+    if(errno == EPIPE){
+      fprintf(stderr, "[API] Server connection lost.\n");
+      return 2;
+    }
+    return 1;
+  }
+
+  // Reads the result of the request from the response pipe
+  int io_result;
+  if((io_result = read_response(result, 2)) <= 0){
+    fprintf(stderr, "[API] Failed to read the result of the request from the response pipe.\n");
+    if(io_result == 0)
+      fprintf(stderr, "[API] Server connection lost.\n");
+    return 2;
+  }
+
+  return 0;
+}
+
+// Sends a multi-key (un)subscription and, unless it is made by the cache,
+// prints the result of each key, as the single key requests do
+static int subscription_batch(int opcode, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                              int results[], const char* operation, int print){
+  int result;
+  char header[2];
+  if((result = batch_request(opcode, num_keys, keys, NULL, NULL, header)))
+    return result;
+  if(header[1] != '0')
+    return 1;
 
+  // Reads the bitmap with the keys that exist
+  char bitmap[(MAX_BATCH_SIZE + 7) / 8];
+  if(read_response(bitmap, (num_keys + 7) / 8) <= 0){
+    fprintf(stderr, "[API] Failed to read the %s results from the response pipe.\n", operation);
+    return 2;
+  }
+
+  for(size_t i = 0; i < num_keys; i++){
+    results[i] = (bitmap[i/8] >> (i%8)) & 1;
+    if(!print)
+      continue;
+
+    // Prints the result of the operation
+    char response[49] = {'\0'};
+    int length = snprintf(response, 49, "Server returned %d for operation: %s.\n",
+                          opcode == OP_CODE_SUBSCRIBE_KEYS ? results[i] : !results[i], operation);
+    if(length > 0)
+      write_all(1, response, (size_t) length);
+  }
+  return 0;
+}
+
+// Sends a pattern (un)subscription request, returning the result of the
+// server, or 1 if it failed and 2 if the api is corrupted
+static int pattern_request(int opcode, const char* pattern, const char* operation){
+  char request[REQUEST_HEADER_SIZE + 1 + MAX_STRING_SIZE] = {'\0'};
+  request[REQUEST_HEADER_SIZE] = (char) ('0' + opcode);
+  strncpy(request + REQUEST_HEADER_SIZE + 1, pattern, MAX_STRING_SIZE - 1);
+
+  if(write_request(request, 1 + MAX_STRING_SIZE) == -1){
+    fprintf(stderr, "[API] Failed to write the %s request to the request pipe.\n", operation);
+    if(errno == EPIPE){
+      fprintf(stderr, "[API] Server connection lost.\n");
+      return 2;
+    }
+    return 1;
+  }
+
+  int io_result;
+  char result[2] = {'\0'};
+  if((io_result = read_response(result, 2)) <= 0){
+    fprintf(stderr, "[API] Failed to read the %s result from the response pipe.\n", operation);
+    if(io_result == 0)
+      fprintf(stderr, "[API] Server connection lost.\n");
+    return 2;
+  }
+
+  char response[49] = {'\0'};
+  int length = snprintf(response, 49, "Server returned %c for operation: %s.\n",
+                        result[1], operation);
+  if(length > 0)
+    write_all(1, response, (size_t) length);
+  return result[1] - '0';
+}
+
+int kvs_subscribe_pattern(const char* pattern){
+  return !pattern_request(OP_CODE_SUBSCRIBE_PATTERN, pattern, "subscribe");
+}
+
+int kvs_unsubscribe_pattern(const char* pattern){
+  return pattern_request(OP_CODE_UNSUBSCRIBE_PATTERN, pattern, "unsubscribe");
+}
+
+int kvs_subscribe_keys(size_t num_keys, char keys[][MAX_STRING_SIZE], int subscribed[]){
+  return subscription_batch(OP_CODE_SUBSCRIBE_KEYS, num_keys, keys, subscribed, "subscribe", 1);
+}
+
+int kvs_unsubscribe_keys(size_t num_keys, char keys[][MAX_STRING_SIZE], int unsubscribed[]){
+  pthread_mutex_lock(&CACHE_LOCK);
+  for(size_t i = 0; i < num_keys; i++)
+    cache_remove(keys[i]);
+  pthread_mutex_unlock(&CACHE_LOCK);
+
+  return subscription_batch(OP_CODE_UNSUBSCRIBE_KEYS, num_keys, keys, unsubscribed, "unsubscribe", 1);
+}
+
+void kvs_cache_enable(size_t capacity){
+  pthread_mutex_lock(&CACHE_LOCK);
+  CACHE_CAPACITY = capacity;
+  pthread_mutex_unlock(&CACHE_LOCK);
+  if(capacity == 0)
+    cache_clear();
+}
+
+// Reads the values of the keys from the server
+static int read_batch(size_t num_keys, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], int found[]){
+  int result;
+  char header[2];
+  if((result = batch_request(OP_CODE_READ, num_keys, keys, NULL, NULL, header)))
+    return result;
+  if(header[1] != '0')
+    return 1;
+
+  // Reads whether each key exists, followed by its value
+  char entries[MAX_BATCH_SIZE*(MAX_STRING_SIZE + 1)];
+  if(read_response(entries, num_keys*(MAX_STRING_SIZE + 1)) <= 0){
+    fprintf(stderr, "[API] Failed to read the values from the response pipe.\n");
+    return 2;
+  }
+
+  for(size_t i = 0; i < num_keys; i++){
+    char* entry = entries + i*(MAX_STRING_SIZE + 1);
+    found[i] = entry[0];
+    strncpy(values[i], entry + 1, MAX_STRING_SIZE);
+    values[i][MAX_STRING_SIZE - 1] = '\0';
+  }
+  return 0;
+}
+
+// Subscribes the keys missing from the cache, while there is room for them,
+// so they are cached once read. Returns the number of keys subscribed.
+static size_t cache_subscribe(size_t num_keys, char keys[][MAX_STRING_SIZE]){
+  char subscribe[MAX_BATCH_SIZE][MAX_STRING_SIZE];
+  size_t count = 0;
+
+  pthread_mutex_lock(&CACHE_LOCK);
+  for(size_t i = 0; i < num_keys && CACHE_COUNT < CACHE_CAPACITY; i++){
+    CacheEntry** link = cache_find(keys[i]);
+    if(*link != NULL || (*link = calloc(1, sizeof(CacheEntry))) == NULL)
+      continue;
+
+    strncpy((*link)->key, keys[i], MAX_STRING_SIZE - 1);
+    (*link)->pending = 1;
+    CACHE_COUNT++;
+    memcpy(subscribe[count++], keys[i], MAX_STRING_SIZE);
+  }
+  pthread_mutex_unlock(&CACHE_LOCK);
+  if(count == 0)
+    return 0;
+
+  // Only the keys that exist can be subscribed
+  int subscribed[MAX_BATCH_SIZE] = {0};
+  int result = subscription_batch(OP_CODE_SUBSCRIBE_KEYS, count, subscribe,
+                                  subscribed, "subscribe", 0);
+
+  pthread_mutex_lock(&CACHE_LOCK);
+  for(size_t i = 0; i < count; i++)
+    if(result || !subscribed[i])
+      cache_remove(subscribe[i]);
+  pthread_mutex_unlock(&CACHE_LOCK);
+  return result ? 0 : count;
+}
+
+int kvs_read(size_t num_keys, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], int found[]){
+  if(CACHE_CAPACITY == 0 || num_keys == 0 || num_keys > MAX_BATCH_SIZE)
+    return read_batch(num_keys, keys, values, found);
+
+  // The cached keys are answered without asking the server
+  char missed_keys[MAX_BATCH_SIZE][MAX_STRING_SIZE];
+  size_t missed[MAX_BATCH_SIZE], num_missed = 0;
+  pthread_mutex_lock(&CACHE_LOCK);
+  for(size_t i = 0; i < num_keys; i++){
+    CacheEntry* entry = *cache_find(keys[i]);
+    if(entry != NULL && !entry->pending){
+      memcpy(values[i], entry->value, MAX_STRING_SIZE);
+      found[i] = 1;
+    }else{
+      memcpy(missed_keys[num_missed], keys[i], MAX_STRING_SIZE);
+      missed[num_missed++] = i;
+    }
+  }
+  pthread_mutex_unlock(&CACHE_LOCK);
+  if(num_missed == 0)
+    return 0;
+
+  // The keys are subscribed before being read, so no update is missed
+  cache_subscribe(num_missed, missed_keys);
+
+  char missed_values[MAX_BATCH_SIZE][MAX_STRING_SIZE];
+  int missed_found[MAX_BATCH_SIZE], result;
+  if((result = read_batch(num_missed, missed_keys, missed_values, missed_found))){
+    pthread_mutex_lock(&CACHE_LOCK);
+    for(size_t i = 0; i < num_missed; i++){
+      CacheEntry* entry = *cache_find(missed_keys[i]);
+      if(entry != NULL && entry->pending)
+        cache_remove(missed_keys[i]);
+    }
+    pthread_mutex_unlock(&CACHE_LOCK);
+    return result;
+  }
+
+  // A value notified meanwhile is newer than the one read
+  pthread_mutex_lock(&CACHE_LOCK);
+  for(size_t i = 0; i < num_missed; i++){
+    memcpy(values[missed[i]], missed_values[i], MAX_STRING_SIZE);
+    found[missed[i]] = missed_found[i];
+
+    CacheEntry* entry = *cache_find(missed_keys[i]);
+    if(entry == NULL || !entry->pending)
+      continue;
+    if(!missed_found[i])
+      cache_remove(missed_keys[i]);
+    else{
+      if(!entry->notified)
+        memcpy(entry->value, missed_values[i], MAX_STRING_SIZE);
+      entry->pending = entry->notified = 0;
+    }
+  }
+  pthread_mutex_unlock(&CACHE_LOCK);
+  return 0;
+}
+
+int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]){
+  int result;
+  char header[2];
+  if((result = batch_request(OP_CODE_WRITE, num_pairs, keys, values, NULL, header)))
+    return result;
+  if(header[1] != '0')
+    return 1;
+
+  // The client reads its own writes, even before they are notified
+  pthread_mutex_lock(&CACHE_LOCK);
+  for(size_t i = 0; i < num_pairs; i++){
+    CacheEntry* entry = *cache_find(keys[i]);
+    if(entry != NULL)
+      strncpy(entry->value, values[i], MAX_STRING_SIZE - 1);
+  }
+  pthread_mutex_unlock(&CACHE_LOCK);
+  return 0;
+}
+
+int kvs_delete(size_t num_keys, char keys[][MAX_STRING_SIZE], int missing[]){
+  int result;
+  char header[2];
+  if((result = batch_request(OP_CODE_DELETE, num_keys, keys, NULL, NULL, header)))
+    return result;
+  if(header[1] != '0')
+    return 1;
+
+  // Reads whether each key was missing
+  char flags[MAX_BATCH_SIZE];
+  if(read_response(flags, num_keys) <= 0){
+    fprintf(stderr, "[API] Failed to read the deleted keys from the response pipe.\n");
+    return 2;
+  }
+
+  pthread_mutex_lock(&CACHE_LOCK);
+  for(size_t i = 0; i < num_keys; i++){
+    missing[i] = flags[i];
+    cache_remove(keys[i]);
+  }
+  pthread_mutex_unlock(&CACHE_LOCK);
+  return 0;
+}
+
+uint64_t kvs_last_sequence(uint64_t* epoch){
+  pthread_mutex_lock(&SEQUENCE_LOCK);
+  uint64_t sequence = LAST_SEQUENCE;
+  *epoch = LAST_EPOCH;
+  pthread_mutex_unlock(&SEQUENCE_LOCK);
+  return sequence;
+}
+
+int kvs_resume(uint64_t epoch, uint64_t since, size_t num_keys, char keys[][MAX_STRING_SIZE],
+               int subscribed[], int* resync){
+  int result;
+  char header[2];
+  uint64_t sequence[2] = {since, epoch};
+  if((result = batch_request(OP_CODE_RESUME, num_keys, keys, NULL, sequence, header)))
+    return result;
+  if(header[1] != '0')
+    return 1;
+
+  // Reads whether the changes were lost, followed by the subscribed keys
+  char flags[1 + (MAX_BATCH_SIZE + 7) / 8];
+  if(read_response(flags, 1 + (num_keys + 7) / 8) <= 0){
+    fprintf(stderr, "[API] Failed to read the resume results from the response pipe.\n");
+    return 2;
+  }
+
+  *resync = flags[0];
+  for(size_t i = 0; i < num_keys; i++)
+    subscribed[i] = (flags[1 + i/8] >> (i%8)) & 1;
+  return 0;
+}
+
+// Size of the frame at the start of the buffer, 0 if its header is
+// incomplete and MAX_NOTIFICATION_SIZE + 1 if it is not valid
+static size_t notification_frame_size(const char* frame, size_t available){
+  if(available < NOTIFICATION_HEADER_SIZE)
+    return 0;
+
+  size_t key_length = (unsigned char) frame[1], value_length = (unsigned char) frame[2];
+  if((frame[0] != NOTIFICATION_UPDATE && frame[0] != NOTIFICATION_DELETE)
+     || key_length >= MAX_STRING_SIZE || value_length >= MAX_STRING_SIZE)
+    return MAX_NOTIFICATION_SIZE + 1;
+  return NOTIFICATION_HEADER_SIZE + key_length + value_length;
+}
+
+int kvs_read_notification(int notif_fd, KvsNotification* notification){
+  // Reads as many frames as are available at once, so the following
+  // calls are answered from the buffer
+  size_t size;
+  while((size = notification_frame_size(NOTIF_BUFFER + NOTIF_START, NOTIF_LEN)) == 0
+        || size > NOTIF_LEN){
+    if(size > MAX_NOTIFICATION_SIZE){
+      fprintf(stderr, "[API] Invalid notification frame.\n");
+      NOTIF_START = NOTIF_LEN = 0;
+      return -1;
+    }
+
+    memmove(NOTIF_BUFFER, NOTIF_BUFFER + NOTIF_START, NOTIF_LEN);
+    NOTIF_START = 0;
+
+    // The hang up of the response pipe, or of the socket, tells that the server is gone
+    ssize_t result;
+    if(NOTIF_RING != NULL)
+      result = (ssize_t) ring_read(NOTIF_RING, NOTIF_BUFFER + NOTIF_LEN, NOTIF_BUFFER_SIZE - NOTIF_LEN,
+                                   SOCKET_FD != NOT_EXISTENT ? SOCKET_FD : RESP_FD);
+    else if(notif_fd == SOCKET_FD)
+      result = socket_read(CHANNEL_NOTIFICATION, NOTIF_BUFFER + NOTIF_LEN, NOTIF_BUFFER_SIZE - NOTIF_LEN, 1);
+    else
+      result = read(notif_fd, NOTIF_BUFFER + NOTIF_LEN, NOTIF_BUFFER_SIZE - NOTIF_LEN);
+    if(result < 0){
+      if(errno == EINTR)
+        continue;
+      return -1;
+    }
+    if(result == 0)
+      return 0;
+    NOTIF_LEN += (size_t) result;
+  }
+
+  const char* frame = NOTIF_BUFFER + NOTIF_START;
+  size_t key_length = (unsigned char) frame[1], value_length = (unsigned char) frame[2];
+  notification->deleted = frame[0] == NOTIFICATION_DELETE;
+  memcpy(&notification->sequence, frame + 3, sizeof(notification->sequence));
+  memcpy(notification->key, frame + NOTIFICATION_HEADER_SIZE, key_length);
+  notification->key[key_length] = '\0';
+  memcpy(notification->value, frame + NOTIFICATION_HEADER_SIZE + key_length, value_length);
+  notification->value[value_length] = '\0';
+  uint64_t delivered;
+  memcpy(&delivered, frame + 3 + sizeof(notification->sequence), sizeof(delivered));
+  NOTIF_START += size;
+  NOTIF_LEN -= size;
+
+  // The changes arrive out of order across the keys, and those notified
+  // again on resume are older, so the sequence kept only grows, except that
+  // the sequences of another server start over
+  pthread_mutex_lock(&SEQUENCE_LOCK);
+  if(LAST_EPOCH != SERVER_EPOCH){
+    LAST_EPOCH = SERVER_EPOCH;
+    LAST_SEQUENCE = delivered;
+  }else if(delivered > LAST_SEQUENCE){
+    LAST_SEQUENCE = delivered;
+  }
+  pthread_mutex_unlock(&SEQUENCE_LOCK);
+
+  // Keeps the cached value of the key up to date
+  pthread_mutex_lock(&CACHE_LOCK);
+  CacheEntry* entry = CACHE_COUNT > 0 ? *cache_find(notification->key) : NULL;
+  if(entry != NULL && notification->deleted)
+    cache_remove(notification->key);
+  else if(entry != NULL){
+    memcpy(entry->value, notification->value, MAX_STRING_SIZE);
+    entry->notified = entry->pending;
+  }
+  pthread_mutex_unlock(&CACHE_LOCK);
+  return 1;
+}
+
+// ASYNCHRONOUS API //
+
+static void async_complete(size_t slot, int result){
+  REQUESTS[slot].done = 1;
+  REQUESTS[slot].result = result;
+  COMPLETED[(COMPLETED_HEAD + COMPLETED_COUNT) % MAX_IN_FLIGHT] = slot;
+  COMPLETED_COUNT++;
+  IN_FLIGHT--;
+}
+
+// Completes every request still in flight when the server is gone
+static void async_fail_all(){
+  for(size_t slot = 0; slot < MAX_IN_FLIGHT; slot++)
+    if(REQUESTS[slot].id != 0 && !REQUESTS[slot].done)
+      async_complete(slot, 2);
+  SUBMITTED_LEN = RESPONSES_LEN = 0;
+}
+
+// Size of the response to a request, after its id, op code and result
+static size_t async_response_size(AsyncRequest* request, char result){
+  if(result != '0')
+    return 0;
+  switch(request->opcode){
+    case OP_CODE_READ:
+      return request->num_keys*(MAX_STRING_SIZE + 1);
+    case OP_CODE_DELETE:
+      return request->num_keys;
+    default:
+      return 0;
+  }
+}
+
+// Completes the requests whose responses were read whole.
+// Returns 1 if a response does not match any request, 0 otherwise.
+static int async_parse_responses(){
+  size_t parsed = 0, header = sizeof(uint32_t) + 2;
+  while(RESPONSES_LEN - parsed >= header){
+    char* response = RESPONSES + parsed;
+    uint32_t id;
+    memcpy(&id, response, sizeof(id));
+
+    AsyncRequest* request = &REQUESTS[id % MAX_IN_FLIGHT];
+    if(request->id != id || request->done){
+      fprintf(stderr, "[API] Received a response to an unknown request.\n");
+      return 1;
+    }
+
+    char result = response[sizeof(uint32_t) + 1];
+    size_t size = header + async_response_size(request, result);
+    if(RESPONSES_LEN - parsed < size)
+      break;
+
+    // Copies the results to the buffers given on submission
+    char* body = response + header;
+    for(size_t i = 0; result == '0' && request->opcode == OP_CODE_READ && i < request->num_keys; i++){
+      char* entry = body + i*(MAX_STRING_SIZE + 1);
+      request->flags[i] = entry[0];
+      strncpy(request->values[i], entry + 1, MAX_STRING_SIZE);
+      request->values[i][MAX_STRING_SIZE - 1] = '\0';
+    }
+    for(size_t i = 0; result == '0' && request->opcode == OP_CODE_DELETE && i < request->num_keys; i++)
+      request->flags[i] = body[i];
+
+    // Same results of the synchronous api
+    if(request->opcode == OP_CODE_SUBSCRIBE)
+      async_complete(id % MAX_IN_FLIGHT, result == '0');
+    else
+      async_complete(id % MAX_IN_FLIGHT, result != '0');
+    parsed += size;
+  }
+
+  memmove(RESPONSES, RESPONSES + parsed, RESPONSES_LEN - parsed);
+  RESPONSES_LEN -= parsed;
+  return 0;
+}
+
+// Writes the submitted requests and reads the responses that arrive in the
+// meantime, so the server never waits for the client to read a response.
+// Then waits up to timeout_ms (-1 for no limit) for a completion, if none
+// is waiting to be collected.
+// Returns 0 on success, 1 if the connection with the server was lost.
+static int async_pump(int timeout_ms){
+  size_t written = 0;
+
+  while(written < SUBMITTED_LEN || (COMPLETED_COUNT == 0 && IN_FLIGHT > 0)){
+    // Through a socket, the responses may also be kept in their inbox by the
+    // notifications thread
+    struct pollfd fds[3] = {
+      {.fd = RESP_FD, .events = POLLIN, .revents = 0},
+      {.fd = uses_socket() ? INBOXES[0].wake_fd : NOT_EXISTENT, .events = POLLIN, .revents = 0},
+      {.fd = REQ_FD, .events = POLLOUT, .revents = 0}
+    };
+    int writing = written < SUBMITTED_LEN;
+    int ready = poll(fds, writing ? 3 : 2, writing ? -1 : timeout_ms);
+    if(ready < 0){
+      if(errno == EINTR)
+        continue;
+      fprintf(stderr, "[API] Failed to wait for the server.\n");
+      return 1;
+    }
+    if(ready == 0)
+      break;
+
+    if((fds[0].revents & (POLLIN | POLLHUP)) || (fds[1].revents & POLLIN)){
+      // The message received through the socket may not be a response
+      ssize_t result = uses_socket()
+        ? socket_read(CHANNEL_RESPONSE, RESPONSES + RESPONSES_LEN, sizeof(RESPONSES) - RESPONSES_LEN, 0)
+        : read(RESP_FD, RESPONSES + RESPONSES_LEN, sizeof(RESPONSES) - RESPONSES_LEN);
+      if(result <= 0 && !(result < 0 && (errno == EINTR || errno == EAGAIN))){
+        fprintf(stderr, "[API] Server connection lost.\n");
+        return 1;
+      }
+      if(result > 0){
+        RESPONSES_LEN += (size_t) result;
+        if(async_parse_responses())
+          return 1;
+      }
+    }
+
+    // Up to PIPE_BUF bytes are written without blocking once the pipe is writable
+    if(writing && (fds[2].revents & POLLOUT)){
+      size_t size = SUBMITTED_LEN - written < PIPE_BUF ? SUBMITTED_LEN - written : PIPE_BUF;
+      ssize_t result = write(REQ_FD, SUBMITTED + written, size);
+      if(result < 0 && errno != EINTR){
+        fprintf(stderr, "[API] Failed to write the requests to the request pipe.\n");
+        return 1;
+      }
+      if(result > 0)
+        written += (size_t) result;
+    }else if(writing && (fds[2].revents & (POLLERR | POLLHUP))){
+      fprintf(stderr, "[API] Server connection lost.\n");
+      return 1;
+    }
+  }
+
+  SUBMITTED_LEN = 0;
+  return 0;
+}
+
+// Queues a request to be written by the next kvs_poll_completions
+static uint32_t async_submit(int opcode, size_t num_keys, char keys[][MAX_STRING_SIZE],
+                             char values[][MAX_STRING_SIZE], char (*results)[MAX_STRING_SIZE],
+                             int* flags){
+  if(REQ_FD == NOT_EXISTENT){
+    fprintf(stderr, "[API] Not connected to the server.\n");
+    return 0;
+  }
+  if(num_keys == 0 || num_keys > MAX_BATCH_SIZE){
+    fprintf(stderr, "[API] A request must have between 1 and %d keys.\n", MAX_BATCH_SIZE);
+    return 0;
+  }
+
+  uint32_t id = NEXT_REQUEST_ID;
+  AsyncRequest* request = &REQUESTS[id % MAX_IN_FLIGHT];
+  if(request->id != 0){
+    fprintf(stderr, "[API] Too many requests in flight, their completions must be collected.\n");
+    return 0;
+  }
+
+  // Size, id, op code and number of keys, followed by the keys and the values
+  size_t batched = opcode == OP_CODE_READ || opcode == OP_CODE_WRITE || opcode == OP_CODE_DELETE;
+  size_t size = REQUEST_HEADER_SIZE + 1 + sizeof(uint32_t) + 1 + (batched ? sizeof(uint16_t) : 0)
+                + num_keys*MAX_STRING_SIZE*(values != NULL ? 2 : 1);
+  uint32_t request_size = (uint32_t) (size - REQUEST_HEADER_SIZE);
+  if(SUBMITTED_LEN + size > SUBMITTED_CAP){
+    size_t cap = SUBMITTED_CAP ? SUBMITTED_CAP : 2*PIPE_BUF;
+    while(cap < SUBMITTED_LEN + size)
+      cap *= 2;
+    char* submitted = realloc(SUBMITTED, cap);
+    if(submitted == NULL){
+      fprintf(stderr, "[API] Failed to allocate the request.\n");
+      return 0;
+    }
+    SUBMITTED = submitted;
+    SUBMITTED_CAP = cap;
+  }
+
+  char* request_data = SUBMITTED + SUBMITTED_LEN;
+  memcpy(request_data, &request_size, REQUEST_HEADER_SIZE);
+  request_data += REQUEST_HEADER_SIZE;
+  request_data[0] = '0' + OP_CODE_REQUEST_ID;
+  memcpy(request_data + 1, &id, sizeof(id));
+  request_data[1 + sizeof(id)] = (char) ('0' + opcode);
+  size_t offset = 2 + sizeof(id);
+  if(batched){
+    uint16_t batch_size = (uint16_t) num_keys;
+    memcpy(request_data + offset, &batch_size, sizeof(batch_size));
+    offset += sizeof(batch_size);
+  }
+  for(size_t i = 0; i < num_keys; i++, offset += MAX_STRING_SIZE)
+    strncpy(request_data + offset, keys[i], MAX_STRING_SIZE);
+  for(size_t i = 0; values != NULL && i < num_keys; i++, offset += MAX_STRING_SIZE)
+    strncpy(request_data + offset, values[i], MAX_STRING_SIZE);
+  SUBMITTED_LEN += size;
+
+  // Keeps the cache as the synchronous api does, on submission since the keys
+  // are not kept. Nothing is read from it until the request completes, since
+  // the synchronous api is not used while requests are in flight.
+  pthread_mutex_lock(&CACHE_LOCK);
+  for(size_t i = 0; CACHE_COUNT > 0 && i < num_keys; i++){
+    CacheEntry* entry = *cache_find(keys[i]);
+    if(entry != NULL && opcode == OP_CODE_WRITE)
+      strncpy(entry->value, values[i], MAX_STRING_SIZE - 1);
+    else if(entry != NULL && (opcode == OP_CODE_DELETE || opcode == OP_CODE_UNSUBSCRIBE))
+      cache_remove(keys[i]);
+  }
+  pthread_mutex_unlock(&CACHE_LOCK);
+
+  request->id = id;
+  request->opcode = opcode;
+  request->done = request->result = 0;
+  request->num_keys = num_keys;
+  request->values = results;
+  request->flags = flags;
+  IN_FLIGHT++;
+
+  // The id 0 marks the free slots
+  if(++NEXT_REQUEST_ID == 0)
+    NEXT_REQUEST_ID = 1;
+  return id;
+}
+
+uint32_t kvs_subscribe_async(const char* key){
+  char keys[1][MAX_STRING_SIZE] = {'\0'};
+  strncpy(keys[0], key, MAX_STRING_SIZE - 1);
+  return async_submit(OP_CODE_SUBSCRIBE, 1, keys, NULL, NULL, NULL);
+}
+
+uint32_t kvs_unsubscribe_async(const char* key){
+  char keys[1][MAX_STRING_SIZE] = {'\0'};
+  strncpy(keys[0], key, MAX_STRING_SIZE - 1);
+  return async_submit(OP_CODE_UNSUBSCRIBE, 1, keys, NULL, NULL, NULL);
+}
+
+uint32_t kvs_read_async(size_t num_keys, char keys[][MAX_STRING_SIZE],
+                        char values[][MAX_STRING_SIZE], int found[]){
+  return async_submit(OP_CODE_READ, num_keys, keys, NULL, values, found);
+}
+
+uint32_t kvs_write_async(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]){
+  return async_submit(OP_CODE_WRITE, num_pairs, keys, values, NULL, NULL);
+}
+
+uint32_t kvs_delete_async(size_t num_keys, char keys[][MAX_STRING_SIZE], int missing[]){
+  return async_submit(OP_CODE_DELETE, num_keys, keys, NULL, NULL, missing);
+}
+
+int kvs_poll_completions(KvsCompletion* completions, size_t max_completions, int timeout_ms){
+  if(async_pump(timeout_ms))
+    async_fail_all();
+
+  size_t count = 0;
+  while(count < max_completions && COMPLETED_COUNT > 0){
+    AsyncRequest* request = &REQUESTS[COMPLETED[COMPLETED_HEAD]];
+    completions[count].id = request->id;
+    completions[count].opcode = request->opcode;
+    completions[count].result = request->result;
+    count++;
+
+    request->id = 0;
+    COMPLETED_HEAD = (COMPLETED_HEAD + 1) % MAX_IN_FLIGHT;
+    COMPLETED_COUNT--;
+  }
+
+  return (int) count;
+}
+
+int kvs_completion_fd(){
+  return uses_socket() ? COMPLETION_FD : RESP_FD;
+}
@@ -15,12 +15,17 @@
 #define CLIENT_API_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "src/common/constants.h"
 
 /// Connects to a kvs server.
 /// @param req_pipe_path Path to the name pipe to be created for requests.
 /// @param resp_pipe_path Path to the name pipe to be created for responses.
-/// @param server_pipe_path Path to the name pipe where the server is listening.
+/// @param server_pipe_path Path to the name pipe where the server is listening,
+/// or "unix:" followed by the path of the server socket to connect through it,
+/// in which case no pipe is created and the client is named after its request pipe.
+/// @param notif_pipe_path Path to the name pipe to be created for notifications,
+/// or "shm:" followed by the name of a shared memory ring to be used instead.
 /// @return 0 if the connection was established successfully, 1 otherwise.
 int kvs_connect(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path,
                 char const* notif_pipe_path, int* notif_pipe);
@@ -43,5 +48,146 @@ int kvs_subscribe(const char* key);
 /// (subscription existed), 1 if it failed but api can still be used, 
 /// 2 if it failed and api is corrupted.
 int kvs_unsubscribe(const char* key);
+
+/// Requests the subscription of a pattern, where '*' matches any sequence
+/// of characters and '?' any character. The client is notified about every
+/// key that matches it, including the keys written after the subscription.
+/// @param pattern Pattern to be subscribed.
+/// @return 0 if the pattern was subscribed successfully, 1 if it failed
+/// but api can still be used, 2 if it failed and api is corrupted.
+int kvs_subscribe_pattern(const char* pattern);
+
+/// Removes the subscription of a pattern.
+/// @param pattern Pattern to be unsubscribed.
+/// @return 0 if the pattern was unsubscribed successfully (subscription
+/// existed), 1 if it failed but api can still be used, 2 if it failed and
+/// api is corrupted.
+int kvs_unsubscribe_pattern(const char* pattern);
+
+/// Requests the subscription of a batch of keys.
+/// @param num_keys Number of keys, at most MAX_BATCH_SIZE.
+/// @param keys Keys to be subscribed.
+/// @param subscribed Set to 1 for each key subscribed (key existed), 0 otherwise.
+/// @return 0 if the request was answered, 1 if it failed but api can
+/// still be used, 2 if it failed and api is corrupted.
+int kvs_subscribe_keys(size_t num_keys, char keys[][MAX_STRING_SIZE], int subscribed[]);
+
+/// Removes the subscription of a batch of keys.
+/// @param num_keys Number of keys, at most MAX_BATCH_SIZE.
+/// @param keys Keys to be unsubscribed.
+/// @param unsubscribed Set to 1 for each key unsubscribed (key existed), 0 otherwise.
+/// @return 0 if the request was answered, 1 if it failed but api can
+/// still be used, 2 if it failed and api is corrupted.
+int kvs_unsubscribe_keys(size_t num_keys, char keys[][MAX_STRING_SIZE], int unsubscribed[]);
+
+/// Reads the values of a batch of keys.
+/// @param num_keys Number of keys, at most MAX_BATCH_SIZE.
+/// @param keys Keys to be read.
+/// @param values Set to the value of each key, empty if it does not exist.
+/// @param found Set to 1 for each key that exists, 0 otherwise.
+/// @return 0 if the keys were read successfully, 1 if it failed but api
+/// can still be used, 2 if it failed and api is corrupted.
+int kvs_read(size_t num_keys, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], int found[]);
+
+/// Enables the read cache, which answers kvs_read for the keys read before
+/// without asking the server. The cached keys are subscribed, so their
+/// notifications are also delivered to the client, and the cache is only
+/// kept up to date while the notifications are read with
+/// kvs_read_notification. A key is no longer cached once it is deleted or
+/// unsubscribed.
+/// @param capacity Maximum number of keys cached, 0 to disable the cache.
+void kvs_cache_enable(size_t capacity);
+
+/// Writes a batch of key value pairs. If a key already exists it is updated.
+/// @param num_pairs Number of pairs, at most MAX_BATCH_SIZE.
+/// @param keys Keys to be written.
+/// @param values Values of the respective keys.
+/// @return 0 if the pairs were written successfully, 1 if it failed but
+/// api can still be used, 2 if it failed and api is corrupted.
+int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]);
+
+/// Deletes a batch of keys.
+/// @param num_keys Number of keys, at most MAX_BATCH_SIZE.
+/// @param keys Keys to be deleted.
+/// @param missing Set to 1 for each key that did not exist, 0 otherwise.
+/// @return 0 if the keys were deleted successfully, 1 if it failed but
+/// api can still be used, 2 if it failed and api is corrupted.
+int kvs_delete(size_t num_keys, char keys[][MAX_STRING_SIZE], int missing[]);
+
+/// The completion of a request of the asynchronous api.
+typedef struct {
+  uint32_t id;  // Id returned by the submission of the request
+  int opcode;   // OP_CODE of the request
+  int result;   // Result the synchronous api would return for the request
+} KvsCompletion;
+
+/// The asynchronous api submits requests without waiting for their
+/// responses. The submitted requests are only written to the server by
+/// kvs_poll_completions, which collects the completed ones. The buffers
+/// given for the results must be kept until the request completes, and the
+/// synchronous api must not be used while requests are in flight.
+/// @return The id of the request, 0 if it could not be submitted.
+uint32_t kvs_subscribe_async(const char* key);
+uint32_t kvs_unsubscribe_async(const char* key);
+uint32_t kvs_read_async(size_t num_keys, char keys[][MAX_STRING_SIZE],
+                        char values[][MAX_STRING_SIZE], int found[]);
+uint32_t kvs_write_async(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]);
+uint32_t kvs_delete_async(size_t num_keys, char keys[][MAX_STRING_SIZE], int missing[]);
+
+/// Writes the submitted requests and collects the completed ones. When the
+/// connection is lost, the requests in flight complete with the result 2.
+/// @param completions Array where the completions are stored.
+/// @param max_completions Size of the array.
+/// @param timeout_ms Time to wait for a completion, -1 to wait until one
+/// arrives and 0 not to wait.
+/// @return Number of completions stored.
+int kvs_poll_completions(KvsCompletion* completions, size_t max_completions, int timeout_ms);
+
+/// File descriptor that becomes readable when responses arrive, so the
+/// completions can be waited for together with other events. Through a
+/// socket it also becomes readable when notifications arrive.
+/// @return The file descriptor.
+int kvs_completion_fd();
+
+/// Sequence up to which the client was notified of every change of its keys,
+/// which is kept when the connection is lost, with the epoch of the server
+/// that numbered it, since the sequences of each server start from 0. The
+/// changes of different keys may be notified out of order, so it may be
+/// older than the sequence of the last notification.
+/// @param epoch Set to the epoch, 0 if no server was connected.
+/// @return The sequence, 0 if no notification was read.
+uint64_t kvs_last_sequence(uint64_t* epoch);
+
+/// Subscribes again the keys of a client that reconnected, and is notified
+/// again of the changes made to them since the given sequence, so that they
+/// do not have to be read again.
+/// @param epoch Epoch returned by kvs_last_sequence before reconnecting.
+/// @param since Sequence returned by kvs_last_sequence before reconnecting.
+/// @param num_keys Number of keys, at most MAX_BATCH_SIZE.
+/// @param keys Keys to be subscribed.
+/// @param subscribed Set to 1 for each key subscribed (key exists), 0 otherwise.
+/// @param resync Set to 1 if the server no longer has the changes since the
+/// sequence, or is not the server that numbered it, in which case the keys
+/// must be read again.
+/// @return 0 if the request was answered, 1 if it failed but api can
+/// still be used, 2 if it failed and api is corrupted.
+int kvs_resume(uint64_t epoch, uint64_t since, size_t num_keys, char keys[][MAX_STRING_SIZE],
+               int subscribed[], int* resync);
+
+/// A change of a subscribed key.
+typedef struct {
+  char key[MAX_STRING_SIZE];
+  char value[MAX_STRING_SIZE];  // Empty if the key was deleted
+  int deleted;
+  uint64_t sequence;            // Sequence of the change
+} KvsNotification;
+
+/// Reads the next notification, from the notifications pipe or from the
+/// notifications ring when the connection uses one. The notifications are
+/// read many at a time, and the next ones are returned from memory.
+/// @param notif_fd Notifications pipe returned by kvs_connect.
+/// @param notification Set to the notification read.
+/// @return 1 on success, 0 if the server closed the connection, -1 on error.
+int kvs_read_notification(int notif_fd, KvsNotification* notification);
  
 #endif  // CLIENT_API_H
@@ -5,7 +5,8 @@
  * 
  * @brief The main file of the client. It receives two arguments, 
  * its id and the server's pipe path (in order to connect to the
- * server), in this specified order.
+ * server), in this specified order. An optional third argument, "shm",
+ * asks for the notifications to be delivered through shared memory.
  * 
  * The client connects to the server sending the request, response 
  * and notifications pipes paths. After connected can subscribe and
@@ -29,14 +30,16 @@
 #include "src/client/api.h"
 #include "../common/constants.h"
 #include "../common/io.h"
+#include "../common/protocol.h"
 #include <bits/types/sigset_t.h>
 #include <bits/sigaction.h>
 #include "../common/subs_lists.h"
 
-#define MAX_HELP_CLIENT_STRING 79
+#define MAX_HELP_CLIENT_STRING 87
 
-KeyChar* SUBS_LIST = NULL;
-int AVAILABLE_SUBS = MAX_NUMBER_SUB;
+// The subscribed keys, also changed by the notifications thread
+KeySet SUBS_SET;
+pthread_mutex_t SUBS_LOCK = PTHREAD_MUTEX_INITIALIZER;
 int END = 0, SIGUSR1_RECEIVED = 0, THREAD_FORCED_CLOSE = 0;
 
 void handle_signal(int sig){
@@ -47,7 +50,7 @@ void handle_signal(int sig){
 
 void* receive_notifications(void* args){
   int notif_fd = *((int*) args), io_result;
-  char notification[2*(MAX_STRING_SIZE + 1)];
+  KvsNotification notification;
 
   // Blocks SIGUSR1 in this thread
   sigset_t sigset1;
@@ -61,7 +64,7 @@ void* receive_notifications(void* args){
   // Reads a notification from notifications pipe
   while(!END){
     // Reads the key that has been modified and its new value from the notifications pipe
-    if((io_result = read_all(notif_fd, notification, 2*(MAX_STRING_SIZE + 1), NULL)) == 0
+    if((io_result = kvs_read_notification(notif_fd, &notification)) == 0
         && !END){
       fprintf(stderr, "[NOTIFICATIONS THREAD] Server connection lost.\n");
 
@@ -78,22 +81,22 @@ void* receive_notifications(void* args){
       continue;
     }
     else if(io_result == 1){
-      char value[MAX_STRING_SIZE + 1] = {'\0'}, key[MAX_STRING_SIZE + 1] = {'\0'};
-      strncpy(key, notification, MAX_STRING_SIZE + 1);
-      strncpy(value, notification + MAX_STRING_SIZE + 1, MAX_STRING_SIZE + 1);
-
       // Writes the notification read
       char message[2*(MAX_STRING_SIZE + 1) + 5] = {'\0'};
-      if(snprintf(message, 2*(MAX_STRING_SIZE+1) + 5, "(%s,%s)\n", key, value) < 0){
+      if(snprintf(message, 2*(MAX_STRING_SIZE+1) + 5, "(%s,%s)\n", notification.key,
+                  notification.deleted ? "DELETED" : notification.value) < 0){
         fprintf(stderr, "[NOTIFICATIONS THREAD] Failed to create a notification.\n");
         continue;
       }
       write_all(1, message, strlen(message));
 
-      if(strcmp(value, "DELETED") == 0){
-        write_all(1, "[NOTIFICATIONS THREAD] Key has been removed from the subscripitons.\n", 69);
-        SUBS_LIST = delete_KeyChar_List(SUBS_LIST, key);
-        AVAILABLE_SUBS++;
+      if(notification.deleted){
+        // The key may have been notified through a pattern instead
+        pthread_mutex_lock(&SUBS_LOCK);
+        int removed = delete_KeySet(&SUBS_SET, notification.key);
+        pthread_mutex_unlock(&SUBS_LOCK);
+        if(removed)
+          write_all(1, "[NOTIFICATIONS THREAD] Key has been removed from the subscripitons.\n", 69);
       }
     }
   }
@@ -101,16 +104,46 @@ void* receive_notifications(void* args){
   pthread_exit(NULL);
 }
 
+// (Un)subscribes the patterns among the given keys, which contain '*' or
+// '?', and keeps the remaining keys. Returns the number of keys left.
+static size_t subscribe_patterns(char keys[][MAX_STRING_SIZE], size_t num, int subscribe){
+  size_t count = 0;
+  for(size_t i = 0; i < num; i++){
+    if(strpbrk(keys[i], "*?") == NULL){
+      memmove(keys[count++], keys[i], MAX_STRING_SIZE);
+      continue;
+    }
+
+    int result = subscribe ? kvs_subscribe_pattern(keys[i]) : kvs_unsubscribe_pattern(keys[i]);
+    if(result){
+      fprintf(stderr, "Command %s failed.\n", subscribe ? "subscribe" : "unsubscribe");
+      if(result == 2)
+        END = 1;
+      continue;
+    }
+
+    pthread_mutex_lock(&SUBS_LOCK);
+    if(subscribe)
+      insert_KeySet(&SUBS_SET, keys[i]);
+    else
+      delete_KeySet(&SUBS_SET, keys[i]);
+    pthread_mutex_unlock(&SUBS_LOCK);
+  }
+  return count;
+}
+
 int main(int argc, char* argv[]){
   // The program must have exaclty 3 arguments
   if(argc < 3){
-    fprintf(stderr, "Usage: %s <client_unique_id> <register_pipe_path>\n", argv[0]);
+    fprintf(stderr, "Usage: %s <client_unique_id> <register_pipe_path> [shm]\n", argv[0]);
     return 1;
   }
 
   char req_pipe_path[MAX_PIPE_PATH_LENGTH] = "/tmp/req";
   char resp_pipe_path[MAX_PIPE_PATH_LENGTH] = "/tmp/resp";
   char notif_pipe_path[MAX_PIPE_PATH_LENGTH] = "/tmp/notif";
+  if(argc > 3 && strcmp(argv[3], "shm") == 0)
+    strcpy(notif_pipe_path, RING_SCHEME "/notif");
   unsigned int delay_ms;
   size_t num;
 
@@ -145,10 +178,10 @@ int main(int argc, char* argv[]){
   }
   
   // Executes the commands requested by the client
-  int result = 0, exists;
-  char key[1][MAX_STRING_SIZE] = {'\0'};
+  int result = 0, results[MAX_BATCH_SIZE];
+  char keys[MAX_BATCH_SIZE][MAX_STRING_SIZE] = {'\0'};
+  size_t count;
   while(!END){
-    exists = 0;
     SIGUSR1_RECEIVED = 0;
     switch(get_next(STDIN_FILENO)){
       case CMD_DISCONNECT:
@@ -172,69 +205,93 @@ int main(int argc, char* argv[]){
         break;
 
       case CMD_SUBSCRIBE:
-        num = parse_list(STDIN_FILENO, key, 1, MAX_STRING_SIZE);
+        num = parse_list(STDIN_FILENO, keys, MAX_BATCH_SIZE, MAX_STRING_SIZE);
         if(num == 0){
           fprintf(stderr, "Invalid command. See HELP for usage.\n");
           continue;
         }
 
-        // Verifies if the client had already subscribed to the key
-        for(KeyChar* aux = SUBS_LIST; aux != NULL; aux = aux->next)
-          if(strcmp(aux->key, key[0]) == 0){
+        // Keeps the keys not subscribed yet, while there is space for them
+        count = 0;
+        pthread_mutex_lock(&SUBS_LOCK);
+        for(size_t i = 0; i < num; i++){
+          if(contains_KeySet(&SUBS_SET, keys[i]))
             fprintf(stderr, "The subscription was already made.\n");
-            exists = 1;
-          }
-        if(exists)
-          continue;
+          else if(SUBS_SET.count + count >= MAX_NUMBER_SUB)
+            fprintf(stderr, "Maximum number of subscriptions has been reached.\n");
+          else
+            memmove(keys[count++], keys[i], MAX_STRING_SIZE);
+        }
+        pthread_mutex_unlock(&SUBS_LOCK);
 
-        // Verifies if there is enough space for the subscription
-        else if(AVAILABLE_SUBS == 0){
-          fprintf(stderr, "Maximum number of subscriptions has been reached.\n");
+        // The patterns are subscribed one by one, apart from the keys
+        count = subscribe_patterns(keys, count, 1);
+        if(count == 0)
           continue;
-        }
 
-        if((result = kvs_subscribe(key[0]))){
+        // Several keys are subscribed with a single request
+        memset(results, 0, sizeof(results));
+        if(count == 1)
+          results[0] = !(result = kvs_subscribe(keys[0]));
+        else
+          result = kvs_subscribe_keys(count, keys, results);
+
+        if(result){
           fprintf(stderr, "Command subscribe failed.\n");
           if(result == 2)
             END = 1;
         }
-        else{
-          SUBS_LIST = insert_KeyChar_List(SUBS_LIST, key[0]);
-          AVAILABLE_SUBS--;
-        }
+
+        pthread_mutex_lock(&SUBS_LOCK);
+        for(size_t i = 0; i < count; i++)
+          if(results[i])
+            insert_KeySet(&SUBS_SET, keys[i]);
+        pthread_mutex_unlock(&SUBS_LOCK);
 
         break;
 
       case CMD_UNSUBSCRIBE:
-        num = parse_list(STDIN_FILENO, key, 1, MAX_STRING_SIZE);
+        num = parse_list(STDIN_FILENO, keys, MAX_BATCH_SIZE, MAX_STRING_SIZE);
         if(num == 0){
           fprintf(stderr, "Invalid command. See HELP for usage.\n");
           continue;
         }
 
-        // Verifies if there are subscriptions
-        if(AVAILABLE_SUBS == MAX_NUMBER_SUB){
+        // Keeps the keys that were subscribed
+        count = 0;
+        pthread_mutex_lock(&SUBS_LOCK);
+        if(SUBS_SET.count == 0)
           fprintf(stderr, "No subscriptions done.\n");
-          continue;
-        }
+        else
+          for(size_t i = 0; i < num; i++){
+            if(!contains_KeySet(&SUBS_SET, keys[i]))
+              fprintf(stderr, "The key is not subscribed.\n");
+            else
+              memmove(keys[count++], keys[i], MAX_STRING_SIZE);
+          }
+        pthread_mutex_unlock(&SUBS_LOCK);
 
-        // Verifies if the client had subscribed that key
-        for(KeyChar* aux = SUBS_LIST; aux != NULL; aux = aux->next)
-          if(strcmp(aux->key, key[0]) == 0) exists = 1;
-        if(!exists){
-          fprintf(stderr, "The key is not subscribed.\n");
+        count = subscribe_patterns(keys, count, 0);
+        if(count == 0)
           continue;
-        }
 
-        if((result = kvs_unsubscribe(key[0]))){
+        memset(results, 0, sizeof(results));
+        if(count == 1)
+          results[0] = !(result = kvs_unsubscribe(keys[0]));
+        else
+          result = kvs_unsubscribe_keys(count, keys, results);
+
+        if(result){
           fprintf(stderr, "Command unsubscribe failed.\n");
           if(result == 2)
             END = 1;
         }
-        else{
-          SUBS_LIST = delete_KeyChar_List(SUBS_LIST, key[0]);
-          AVAILABLE_SUBS++;
-        }
+
+        pthread_mutex_lock(&SUBS_LOCK);
+        for(size_t i = 0; i < count; i++)
+          if(results[i])
+            delete_KeySet(&SUBS_SET, keys[i]);
+        pthread_mutex_unlock(&SUBS_LOCK);
 
         break;
 
@@ -279,8 +336,8 @@ int main(int argc, char* argv[]){
         write_all(1, 
                 "Available commands:\n"
                 "  DISCONNECT\n"
-                "  SUBSCRIBE [key]\n"
-                "  UNSUBSCRIBE [key]\n"
+                "  SUBSCRIBE [key,...]\n"
+                "  UNSUBSCRIBE [key,...]\n"
                 "  HELP\n",
                 MAX_HELP_CLIENT_STRING
           );
@@ -289,7 +346,7 @@ int main(int argc, char* argv[]){
     }
   }
 
-  delete_All_Char(SUBS_LIST);
+  delete_All_KeySet(&SUBS_SET);
 
   // Waits for the end of the notifications thread
   pthread_join(notif_thread, NULL);
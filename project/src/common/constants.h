@@ -1,7 +1,6 @@
 // constantes partilhadas entre cliente e servidor
-#define MAX_SESSION_COUNT 8 // num max de sessoes no server, 1 default, necessario alterar mais tarde
 #define STATE_ACCESS_DELAY_US  // delay a aplicar no server
 #define MAX_PIPE_PATH_LENGTH 40 // tamanho max do caminho do pipe
 #define MAX_STRING_SIZE 40
-#define MAX_NUMBER_SUB 10
+#define MAX_NUMBER_SUB 4096
 #define MAX_SENTECE_SIZE 46
@@ -8,7 +8,93 @@ enum {
   OP_CODE_CONNECT = 1,
   OP_CODE_DISCONNECT = 2,
   OP_CODE_SUBSCRIBE = 3,
-  OP_CODE_UNSUBSCRIBE = 4
+  OP_CODE_UNSUBSCRIBE = 4,
+  OP_CODE_READ = 5,
+  OP_CODE_WRITE = 6,
+  OP_CODE_DELETE = 7,
+  OP_CODE_REQUEST_ID = 8,
+  OP_CODE_SUBSCRIBE_KEYS = 9,
+  OP_CODE_UNSUBSCRIBE_KEYS = 10,
+  OP_CODE_SUBSCRIBE_PATTERN = 11,
+  OP_CODE_UNSUBSCRIBE_PATTERN = 12,
+  OP_CODE_RESUME = 13
 };
 
+// The read, write, delete and multi-key (un)subscription requests carry a batch of keys:
+//   op code, number of keys (uint16_t), keys (MAX_STRING_SIZE bytes each)
+//   and, for the writes, the values (MAX_STRING_SIZE bytes each)
+// and their responses, after the op code and the result:
+//   read:   for each key, 1 if it exists, and its value (MAX_STRING_SIZE bytes)
+//   delete: for each key, 1 if it was missing
+//   (un)subscription: a bitmap with a bit set for each key that exists,
+//   the bit of the key i being (1 << i%8) of the byte i/8
+#define MAX_BATCH_SIZE 256
+
+// The pattern (un)subscription requests carry a pattern (MAX_STRING_SIZE
+// bytes) where '*' matches any sequence of characters and '?' any character,
+// and the client is notified about every key that matches it, even the keys
+// written after the subscription
+#define MAX_RESPONSE_SIZE (2 + MAX_BATCH_SIZE*(MAX_STRING_SIZE + 1))
+
+// A notification is a frame with its kind, the lengths of the key and of the
+// value (one byte each), the sequence of the change, which grows with every
+// change of the store, the sequence up to which every change was notified
+// before it (uint64_t each), and the key and the value, without their
+// terminators. The deletions have no value. The changes of different keys
+// may arrive out of order, the client resumes from the second sequence.
+enum {
+  NOTIFICATION_UPDATE = 1,
+  NOTIFICATION_DELETE = 2
+};
+
+#define NOTIFICATION_HEADER_SIZE (3 + 2*sizeof(uint64_t))
+#define MAX_NOTIFICATION_SIZE (NOTIFICATION_HEADER_SIZE + 2*(MAX_STRING_SIZE - 1))
+
+// The response to a connection that succeeds has, after the op code and the
+// result, the epoch of the server (uint64_t), which differs from that of any
+// previous server, since the sequences of every server start from 0.
+
+// The resume request is a batch of keys followed by the last sequence the
+// client was notified of and the epoch of the server that sent it (uint64_t
+// each). The keys are subscribed and the changes made to them since that
+// sequence are notified again. Its response has, after the op code and the
+// result, 1 if the server no longer has those changes or the epoch is not
+// its own (the client must read the keys again), and the bitmap of the
+// subscription request.
+
+// Every request after the connection is a frame made of the size of the
+// request (uint32_t) followed by the request itself, starting with its op
+// code, so the server reads many requests at once and tells them apart
+// without knowing their op codes
+#define REQUEST_HEADER_SIZE sizeof(uint32_t)
+#define MAX_REQUEST_SIZE (1 + sizeof(uint32_t) + 1 + sizeof(uint16_t) \
+                          + 2*MAX_BATCH_SIZE*MAX_STRING_SIZE + 2*sizeof(uint64_t))
+
+// A request may start with OP_CODE_REQUEST_ID and a uint32_t id, followed
+// by its op code, in which case its response is preceded by the same id.
+// The responses keep the order of the requests, so many requests may be in
+// flight at once.
+
+// Clients connect through a Unix domain socket when the server path
+// starts with this scheme, and through the server pipe otherwise
+#define SOCKET_SCHEME "unix:"
+
+// The connection request sent through a socket is its op code, the id of
+// the client and the notifications path (MAX_PIPE_PATH_LENGTH bytes each).
+// The notifications go through the socket unless the path names a ring.
+#define SOCKET_CONNECT_SIZE (1 + 2*MAX_PIPE_PATH_LENGTH)
+
+// Every message the server sends through a socket starts with its channel,
+// followed by the same bytes that would be written to the respective pipe
+enum {
+  CHANNEL_RESPONSE = 1,
+  CHANNEL_NOTIFICATION = 2
+};
+
+#define MAX_SOCKET_MESSAGE_SIZE 65536
+
+// A notifications path starting with this scheme names a shared memory
+// ring (see ring.h) created by the client instead of a pipe
+#define RING_SCHEME "shm:"
+
 #endif  // COMMON_PROTOCOL_H
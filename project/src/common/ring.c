@@ -0,0 +1,143 @@
+// syscall() is needed for the futex, which has no libc wrapper
+#define _GNU_SOURCE
+
+#include "ring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// Seconds a parked reader waits before checking if the server is gone
+#define RING_PARK_TIMEOUT_S 1
+
+static void futex_wake(_Atomic uint32_t* word){
+  syscall(SYS_futex, (uint32_t*) word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static void futex_wait(_Atomic uint32_t* word, uint32_t value){
+  struct timespec timeout = {.tv_sec = RING_PARK_TIMEOUT_S, .tv_nsec = 0};
+  syscall(SYS_futex, (uint32_t*) word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static NotifRing* ring_map(int fd){
+  void* ring = mmap(NULL, sizeof(NotifRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return ring == MAP_FAILED ? NULL : (NotifRing*) ring;
+}
+
+NotifRing* ring_create(const char* name){
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fd < 0)
+    return NULL;
+
+  NotifRing* ring = NULL;
+  if(ftruncate(fd, sizeof(NotifRing)) == 0)
+    ring = ring_map(fd);
+  close(fd);
+
+  if(ring == NULL){
+    shm_unlink(name);
+    return NULL;
+  }
+
+  // The rest of the ring is zeroed by ftruncate
+  ring->magic = NOTIF_RING_MAGIC;
+  return ring;
+}
+
+NotifRing* ring_open(const char* name, int* fd){
+  if((*fd = shm_open(name, O_RDWR, 0)) < 0)
+    return NULL;
+
+  // A smaller object would fault on the first notification
+  struct stat status;
+  NotifRing* ring = NULL;
+  if(fstat(*fd, &status) == 0 && (size_t) status.st_size >= sizeof(NotifRing))
+    ring = ring_map(*fd);
+
+  if(ring != NULL && ring->magic != NOTIF_RING_MAGIC){
+    ring_unmap(ring);
+    ring = NULL;
+  }
+  if(ring == NULL)
+    close(*fd);
+  return ring;
+}
+
+int ring_write(NotifRing* ring, const void* data, size_t size){
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+  // The tail is written by the client, an invalid one is taken as a full ring
+  uint32_t used = head - tail;
+  if(used > NOTIF_RING_SIZE || size > NOTIF_RING_SIZE - used)
+    return 1;
+
+  size_t offset = head & (NOTIF_RING_SIZE - 1);
+  size_t first = size < NOTIF_RING_SIZE - offset ? size : NOTIF_RING_SIZE - offset;
+  memcpy(ring->data + offset, data, first);
+  memcpy(ring->data, (const char*) data + first, size - first);
+
+  // Publishing the head before checking the reader means that either the
+  // reader sees the new head or the writer sees the reader parked
+  atomic_store(&ring->head, head + (uint32_t) size);
+  if(atomic_load(&ring->parked))
+    futex_wake(&ring->head);
+  return 0;
+}
+
+size_t ring_read(NotifRing* ring, void* buffer, size_t size, int hangup_fd){
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+  while(size > 0){
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if(head != tail){
+      size_t count = head - tail < size ? head - tail : size;
+      size_t offset = tail & (NOTIF_RING_SIZE - 1);
+      size_t first = count < NOTIF_RING_SIZE - offset ? count : NOTIF_RING_SIZE - offset;
+      memcpy(buffer, ring->data + offset, first);
+      memcpy((char*) buffer + first, ring->data, count - first);
+
+      atomic_store_explicit(&ring->tail, tail + (uint32_t) count, memory_order_release);
+      return count;
+    }
+
+    // Nothing more is written once the ring is closed
+    if(atomic_load(&ring->closed)){
+      if(atomic_load(&ring->head) == tail)
+        return 0;
+      continue;
+    }
+
+    // Parks until the server writes, unless it did so in the meantime
+    atomic_store(&ring->parked, 1);
+    if(atomic_load(&ring->head) == tail && !atomic_load(&ring->closed)){
+      futex_wait(&ring->head, tail);
+
+      struct pollfd hangup = {.fd = hangup_fd, .events = 0, .revents = 0};
+      if(atomic_load(&ring->head) == tail && poll(&hangup, 1, 0) > 0
+         && (hangup.revents & (POLLHUP | POLLERR | POLLNVAL))){
+        atomic_store(&ring->parked, 0);
+        return 0;
+      }
+    }
+    atomic_store(&ring->parked, 0);
+  }
+
+  return 0;
+}
+
+void ring_close(NotifRing* ring){
+  atomic_store(&ring->closed, 1);
+  futex_wake(&ring->head);
+}
+
+void ring_unmap(NotifRing* ring){
+  munmap(ring, sizeof(NotifRing));
+}
@@ -0,0 +1,97 @@
+/**
+ * @file ring.h
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A single producer, single consumer ring buffer in shared memory,
+ * used to deliver the notifications to the local clients without any
+ * system call while the client keeps up with them. The server only wakes
+ * the client (futex) when it is parked waiting for notifications.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef COMMON_RING_H
+#define COMMON_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Must be a power of two
+#define NOTIF_RING_SIZE 262144
+#define NOTIF_RING_MAGIC 0x4b56534eu
+
+typedef struct NotifRing {
+  uint32_t magic;
+
+  // Bytes written by the server, the futex the client parks on
+  _Atomic uint32_t head;
+  _Atomic uint32_t closed;
+  char producer_padding[52];
+
+  // Bytes read by the client
+  _Atomic uint32_t tail;
+  _Atomic uint32_t parked;
+  char consumer_padding[56];
+
+  char data[NOTIF_RING_SIZE];
+} NotifRing;
+
+/**
+ * @brief Creates and maps the shared memory of a ring (client).
+ *
+ * @param name Name of the shared memory object, starting with '/'.
+ * @return The ring, NULL on failure.
+ */
+NotifRing* ring_create(const char* name);
+
+/**
+ * @brief Maps the ring created by a client (server).
+ *
+ * @param name Name of the shared memory object.
+ * @param fd Set to the file descriptor of the shared memory object,
+ * which is kept open while the ring is in use.
+ * @return The ring, NULL on failure.
+ */
+NotifRing* ring_open(const char* name, int* fd);
+
+/**
+ * @brief Writes a message to the ring, waking the reader if it is parked.
+ *
+ * @param ring The ring.
+ * @param data The message.
+ * @param size Size of the message.
+ * @return 0 if the message was written, 1 if there is no room for it.
+ */
+int ring_write(NotifRing* ring, const void* data, size_t size);
+
+/**
+ * @brief Reads the bytes available in the ring, up to the given size,
+ * parking until the server writes some.
+ *
+ * @param ring The ring.
+ * @param buffer Buffer to read into.
+ * @param size Maximum number of bytes to read.
+ * @param hangup_fd While parked, the hang up of this descriptor means
+ * that the server is gone.
+ * @return Number of bytes read, 0 if the ring was closed by the server.
+ */
+size_t ring_read(NotifRing* ring, void* buffer, size_t size, int hangup_fd);
+
+/**
+ * @brief Tells the reader that no more messages will be written.
+ *
+ * @param ring The ring.
+ */
+void ring_close(NotifRing* ring);
+
+/**
+ * @brief Unmaps the ring.
+ *
+ * @param ring The ring.
+ */
+void ring_unmap(NotifRing* ring);
+
+#endif  // COMMON_RING_H
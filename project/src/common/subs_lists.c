@@ -52,6 +52,49 @@ void delete_All_Char(KeyChar* head){
     } 
 }
 
+// FNV-1a hash of the key
+static size_t key_set_bucket(const char* key){
+    size_t hash = 2166136261u;
+    for(; *key != '\0'; key++)
+        hash = (hash ^ (unsigned char) *key) * 16777619u;
+    return hash % KEY_SET_BUCKETS;
+}
+
+int contains_KeySet(KeySet* set, const char* key){
+    for(KeyChar* aux = set->buckets[key_set_bucket(key)]; aux != NULL; aux = aux->next)
+        if(strcmp(aux->key, key) == 0)
+            return 1;
+    return 0;
+}
+
+int insert_KeySet(KeySet* set, char* key){
+    if(contains_KeySet(set, key))
+        return 0;
+
+    size_t bucket = key_set_bucket(key);
+    set->buckets[bucket] = insert_KeyChar_List(set->buckets[bucket], key);
+    set->count++;
+    return 1;
+}
+
+int delete_KeySet(KeySet* set, char* key){
+    if(!contains_KeySet(set, key))
+        return 0;
+
+    size_t bucket = key_set_bucket(key);
+    set->buckets[bucket] = delete_KeyChar_List(set->buckets[bucket], key);
+    set->count--;
+    return 1;
+}
+
+void delete_All_KeySet(KeySet* set){
+    for(size_t i = 0; i < KEY_SET_BUCKETS; i++){
+        delete_All_Char(set->buckets[i]);
+        set->buckets[i] = NULL;
+    }
+    set->count = 0;
+}
+
 struct KeyInt* insert_KeyInt_List(KeyInt* head, int node){
     KeyInt* new = (KeyInt*)malloc(sizeof(KeyInt));
     new->fd = node;
@@ -17,6 +17,13 @@ typedef struct KeyChar{
     struct KeyChar *next;
 } KeyChar;
 
+// Hash set of keys, each bucket being a KeyChar linked list
+#define KEY_SET_BUCKETS 1024
+typedef struct KeySet{
+    KeyChar* buckets[KEY_SET_BUCKETS];
+    size_t count;
+} KeySet;
+
 typedef struct KeyInt{
     int fd;
     struct KeyInt* next;
@@ -49,6 +56,40 @@ struct KeyChar* delete_KeyChar_List(KeyChar* head, char* node);
  */
 void delete_All_Char(KeyChar* head);
 
+/**
+ * @brief Inserts a key into the given set.
+ * 
+ * @param set The set.
+ * @param key Key to be inserted.
+ * @return 1 if the key was inserted, 0 if it was already in the set.
+ */
+int insert_KeySet(KeySet* set, char* key);
+
+/**
+ * @brief Deletes a key from the given set.
+ * 
+ * @param set The set.
+ * @param key Key to be deleted.
+ * @return 1 if the key was deleted, 0 if it was not in the set.
+ */
+int delete_KeySet(KeySet* set, char* key);
+
+/**
+ * @brief Tells whether a key is in the given set.
+ * 
+ * @param set The set.
+ * @param key The key.
+ * @return 1 if the key is in the set, 0 otherwise.
+ */
+int contains_KeySet(KeySet* set, const char* key);
+
+/**
+ * @brief Deletes all the keys of the given set.
+ * 
+ * @param set The set.
+ */
+void delete_All_KeySet(KeySet* set);
+
 /**
  * @brief Inserts the specified node into the given KeyInt linked list
  * and returns the new head of the linked list.
@@ -0,0 +1,111 @@
+/**
+ * @file changelog.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A bounded log of the last changes of the keys, each one numbered
+ * with the sequence of its notification, so that a client which lost its
+ * session is only sent the changes it missed.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include "changelog.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+ChangeLog* create_change_log(){
+    ChangeLog* log = calloc(1, sizeof(ChangeLog));
+    if(log == NULL)
+        return NULL;
+    pthread_mutex_init(&log->lock, NULL);
+
+    // The sequences of every server start from 0, the time it started
+    // tells them apart
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    log->epoch = (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+    return log;
+}
+
+uint64_t log_change(ChangeLog* log, const char* key, const char* value,
+                    Delivery* delivery, uint64_t* delivered){
+    pthread_mutex_lock(&log->lock);
+    uint64_t sequence = ++log->last_sequence;
+    Change* change = &log->changes[sequence % CHANGE_LOG_SIZE];
+    change->sequence = sequence;
+    change->deleted = value == NULL;
+    strncpy(change->key, key, MAX_STRING_SIZE - 1);
+    change->key[MAX_STRING_SIZE - 1] = '\0';
+    strncpy(change->value, value != NULL ? value : "", MAX_STRING_SIZE - 1);
+    change->value[MAX_STRING_SIZE - 1] = '\0';
+
+    // The sequences increase, so the oldest change being delivered is first
+    if(delivery != NULL){
+        delivery->sequence = sequence;
+        delivery->next = NULL;
+        delivery->prev = log->last;
+        if(log->last != NULL)
+            log->last->next = delivery;
+        else
+            log->first = delivery;
+        log->last = delivery;
+        *delivered = log->first->sequence - 1;
+    }
+    pthread_mutex_unlock(&log->lock);
+    return sequence;
+}
+
+void finish_delivery(ChangeLog* log, Delivery* delivery){
+    pthread_mutex_lock(&log->lock);
+    if(delivery->prev != NULL)
+        delivery->prev->next = delivery->next;
+    else
+        log->first = delivery->next;
+    if(delivery->next != NULL)
+        delivery->next->prev = delivery->prev;
+    else
+        log->last = delivery->prev;
+    pthread_mutex_unlock(&log->lock);
+}
+
+int replay_changes(ChangeLog* log, KeySet* keys, uint64_t epoch, uint64_t since,
+                   void (*replay)(const Change* change, void* arg), void* arg){
+    pthread_mutex_lock(&log->lock);
+
+    // The changes after the sequence must not have been overwritten
+    uint64_t last = log->last_sequence;
+    if(epoch != log->epoch || since > last || last - since > CHANGE_LOG_SIZE){
+        pthread_mutex_unlock(&log->lock);
+        return 1;
+    }
+
+    // Copy the changes, which may wrap around the end of the log
+    size_t count = (size_t) (last - since);
+    Change* changes = count > 0 ? malloc(count * sizeof(Change)) : NULL;
+    if(count > 0 && changes == NULL){
+        pthread_mutex_unlock(&log->lock);
+        return 1;
+    }
+    size_t first = (size_t) ((since + 1) % CHANGE_LOG_SIZE);
+    size_t head = count < CHANGE_LOG_SIZE - first ? count : CHANGE_LOG_SIZE - first;
+    if(count > 0){
+        memcpy(changes, &log->changes[first], head * sizeof(Change));
+        memcpy(changes + head, log->changes, (count - head) * sizeof(Change));
+    }
+    pthread_mutex_unlock(&log->lock);
+
+    for(size_t i = 0; i < count; i++)
+        if(contains_KeySet(keys, changes[i].key))
+            replay(&changes[i], arg);
+
+    free(changes);
+    return 0;
+}
+
+void free_change_log(ChangeLog* log){
+    pthread_mutex_destroy(&log->lock);
+    free(log);
+}
@@ -0,0 +1,106 @@
+/**
+ * @file changelog.h
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A bounded log of the last changes of the keys, each one numbered
+ * with the sequence of its notification, so that a client which lost its
+ * session is only sent the changes it missed.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef KVS_CHANGELOG_H
+#define KVS_CHANGELOG_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/constants.h"
+#include "../common/subs_lists.h"
+
+// Number of changes kept, the older ones are overwritten
+#define CHANGE_LOG_SIZE 4096
+
+typedef struct {
+    uint64_t sequence;
+    int deleted;
+    char key[MAX_STRING_SIZE];
+    char value[MAX_STRING_SIZE];
+} Change;
+
+// A change being delivered to its subscribers, linked in the log until
+// they all have it
+typedef struct Delivery {
+    uint64_t sequence;
+    struct Delivery *prev, *next;
+} Delivery;
+
+typedef struct ChangeLog {
+    Change changes[CHANGE_LOG_SIZE];
+    uint64_t last_sequence;         // Sequence of the last change, 0 if none
+    uint64_t epoch;                 // Tells the sequences of this server from
+                                    // those of the previous ones
+    Delivery *first, *last;         // Changes being delivered, oldest first
+    pthread_mutex_t lock;
+} ChangeLog;
+
+/**
+ * @brief Creates an empty change log, of a new epoch.
+ *
+ * @return The change log, NULL on failure.
+ */
+ChangeLog* create_change_log();
+
+/**
+ * @brief Appends a change to the log. A change that is delivered is
+ * tracked until finish_delivery, so the log knows up to which sequence
+ * every change was delivered.
+ *
+ * @param log The change log.
+ * @param key Key that was changed.
+ * @param value Its new value, NULL if it was deleted.
+ * @param delivery Tracks the change while it is delivered, NULL if it has
+ * no subscribers.
+ * @param delivered Set, if the change is delivered, to the sequence every
+ * change up to which was delivered before this one was logged.
+ * @return The sequence of the change.
+ */
+uint64_t log_change(ChangeLog* log, const char* key, const char* value,
+                    Delivery* delivery, uint64_t* delivered);
+
+/**
+ * @brief Stops tracking a change once all its subscribers have it.
+ *
+ * @param log The change log.
+ * @param delivery The change, as given to log_change.
+ */
+void finish_delivery(ChangeLog* log, Delivery* delivery);
+
+/**
+ * @brief Calls the given function for each change of the keys after a
+ * sequence, in the order they were made. The changes are copied from the
+ * log at once, so the writers only wait for the copy.
+ *
+ * @param log The change log.
+ * @param keys The keys.
+ * @param epoch Epoch of the sequence known by the client.
+ * @param since Last sequence known by the client.
+ * @param replay Function called for each change.
+ * @param arg Argument of the function.
+ * @return 0 if the log has all the changes since the sequence, 1 if some
+ * were overwritten, the sequence is of another epoch or the changes could
+ * not be copied.
+ */
+int replay_changes(ChangeLog* log, KeySet* keys, uint64_t epoch, uint64_t since,
+                   void (*replay)(const Change* change, void* arg), void* arg);
+
+/**
+ * @brief Frees the change log.
+ *
+ * @param log The change log.
+ */
+void free_change_log(ChangeLog* log);
+
+#endif  // KVS_CHANGELOG_H
@@ -3,3 +3,19 @@
 #define MAX_JOB_FILE_NAME_SIZE 256
 #define MAX_HELP_STRING 146
 #define MAX_WAIT_STRING 11
+#define PARSE_AHEAD_SIZE 32
+#define NOTIFY_CHUNK_SIZE 64
+#define MAX_PARKED_JOBS 512
+#define SESSION_LOOP_COUNT 4
+#define MAX_EPOLL_EVENTS 64
+#define SESSION_BUFFER_SIZE 4096
+#define SESSION_MAX_BACKLOG 1048576
+#define MAX_SESSIONS_TABLE_SIZE 65536
+#define SESSION_CONNECT_TIMEOUT_MS 5000
+#define SESSION_CONNECT_RETRY_MS 1
+#define SOCKET_PATH_SUFFIX ".sock"
+#define OUTPUT_BUFFER_SIZE 65536
+#define OUTPUT_QUEUE_DEPTH 64
+#define OUTPUT_POLL_MS 1
+#define BACKUP_DELTA_HEADER "#DELTA "
+#define MAX_DELTA_CHAIN 1024
@@ -0,0 +1,179 @@
+/**
+ * @file jobc.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief Compiles a .job file into the binary form described in parser.h,
+ * which the server executes straight from memory, without parsing the
+ * text again every time the job is run. Receives the path of the .job
+ * file and the path of the compiled file, which must also end in .job
+ * for the server to run it.
+ *
+ * The text is parsed by the same parser as the server's, so a compiled
+ * job behaves exactly as the text it came from.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "constants.h"
+#include "parser.h"
+#include "../common/io.h"
+
+// The compiled file, built in memory and written at once
+typedef struct {
+  char* data;
+  size_t len, cap;
+} Output;
+
+static int emit(Output* out, const void* data, size_t size){
+  if(out->len + size > out->cap){
+    size_t cap = out->cap ? 2*out->cap : 65536;
+    while(cap < out->len + size)
+      cap *= 2;
+    char* aux = realloc(out->data, cap);
+    if(aux == NULL)
+      return 1;
+    out->data = aux;
+    out->cap = cap;
+  }
+  memcpy(out->data + out->len, data, size);
+  out->len += size;
+  return 0;
+}
+
+static int emit_command(Output* out, enum Command command){
+  char byte = (char) command;
+  return emit(out, &byte, 1);
+}
+
+static int emit_uint(Output* out, uint32_t value){
+  return emit(out, &value, sizeof(value));
+}
+
+static int emit_string(Output* out, const char* str){
+  char len = (char) strlen(str);
+  return emit(out, &len, 1) || emit(out, str, strlen(str));
+}
+
+// Emits a WRITE, READ or DELETE, parsed MAX_WRITE_SIZE keys at a time, or
+// CMD_INVALID if it could not be parsed
+static int emit_keys(JobFile* job, Output* out, enum Command command){
+  static char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE];
+  static char values[MAX_WRITE_SIZE][MAX_STRING_SIZE];
+  size_t start = out->len, num_keys = 0, parsed;
+
+  // The number of keys is only known at the end of the command
+  if(emit_command(out, command) || emit_uint(out, 0))
+    return 1;
+
+  do{
+    if(command == CMD_WRITE)
+      parsed = parse_write(job, keys, values, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+    else
+      parsed = parse_read_delete(job, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+
+    for(size_t i = 0; i < parsed; i++)
+      if(emit_string(out, keys[i]) || (command == CMD_WRITE && emit_string(out, values[i])))
+        return 1;
+    num_keys += parsed;
+  }while(parsed != 0 && job->pending);
+
+  if(parsed == 0 || num_keys > UINT32_MAX){
+    out->len = start;
+    return emit_command(out, CMD_INVALID);
+  }
+
+  uint32_t count = (uint32_t) num_keys;
+  memcpy(out->data + start + 1, &count, sizeof(count));
+  return 0;
+}
+
+static int compile(JobFile* job, Output* out){
+  unsigned int delay;
+  int result = emit(out, JOB_MAGIC, JOB_MAGIC_SIZE);
+
+  while(!result){
+    enum Command command = get_next(job);
+    switch(command){
+      case CMD_WRITE:
+      case CMD_READ:
+      case CMD_DELETE:
+        result = emit_keys(job, out, command);
+        break;
+
+      case CMD_WAIT:
+        if(parse_wait(job, &delay, NULL) == -1)
+          result = emit_command(out, CMD_INVALID);
+        else
+          result = emit_command(out, command) || emit_uint(out, delay);
+        break;
+
+      case CMD_SHOW:
+      case CMD_BACKUP:
+      case CMD_HELP:
+      case CMD_INVALID:
+        result = emit_command(out, command);
+        break;
+
+      case CMD_EMPTY:
+        break;
+
+      case EOC:
+        return 0;
+    }
+  }
+
+  return result;
+}
+
+int main(int argc, char** argv){
+  if(argc != 3){
+    fprintf(stderr, "Usage: %s <input.job> <output.job>\n", argv[0]);
+    return 1;
+  }
+
+  JobFile* job = job_open(argv[1]);
+  if(job == NULL){
+    fprintf(stderr, "[JOBC] Error opening input file %s\n", argv[1]);
+    return 1;
+  }
+  if(job->compiled){
+    fprintf(stderr, "[JOBC] The file %s is already compiled.\n", argv[1]);
+    job_close(job);
+    return 1;
+  }
+
+  Output out = {NULL, 0, 0};
+  if(compile(job, &out)){
+    fprintf(stderr, "[JOBC] Failed to compile the file %s.\n", argv[1]);
+    job_close(job);
+    free(out.data);
+    return 1;
+  }
+  job_close(job);
+
+  int output_file = open(argv[2], O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR);
+  if(output_file < 0){
+    fprintf(stderr, "[JOBC] Error opening output file %s\n", argv[2]);
+    free(out.data);
+    return 1;
+  }
+
+  int result = 0;
+  if(write_all(output_file, out.data, out.len) == -1){
+    fprintf(stderr, "[JOBC] Failed to write the output file %s.\n", argv[2]);
+    result = 1;
+  }
+
+  close(output_file);
+  free(out.data);
+  return result;
+}
@@ -17,9 +17,11 @@
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include "constants.h"
-#include "../common/io.h"
+#include "sessions.h"
+#include "../common/protocol.h"
 
 
 // Hash function based on key initial.
@@ -88,11 +90,361 @@ struct HashTable* create_hash_table() {
       ht->table[i] = NULL;
       pthread_rwlock_init(&ht->locks[i], NULL);
   }
+  if ((ht->patterns = create_pattern_trie()) == NULL) {
+      free(ht);
+      return NULL;
+  }
+  if ((ht->changes = create_change_log()) == NULL) {
+      free_pattern_trie(ht->patterns);
+      free(ht);
+      return NULL;
+  }
+  pthread_rwlock_init(&ht->patterns_lock, NULL);
+  ht->snapshots = NULL;
+  pthread_mutex_init(&ht->snapshots_lock, NULL);
+  ht->epoch = 0;
+  ht->track_deletes = 0;
+  ht->bases = NULL;
+  for (int i = 0; i < TABLE_SIZE; i++)
+      ht->deleted[i] = NULL;
+  ht->pool = NULL;
+  ht->notifying = 0;
   return ht;
 }
 
+// SNAPSHOTS //
+
+// Tells if a pair goes into the snapshot, all of them unless it is a delta
+static int in_snapshot(const Snapshot* snapshot, uint64_t changed){
+    return !snapshot->delta || (changed > snapshot->since && changed <= snapshot->epoch);
+}
+
+// Formats the pairs of a bucket into the snapshot, with its lock held
+static void copy_bucket(HashTable* ht, Snapshot* snapshot, int index){
+    size_t len = 0;
+    for (KeyNode *keyNode = ht->table[index]; keyNode != NULL; keyNode = keyNode->next)
+        if (in_snapshot(snapshot, keyNode->changed))
+            len += strlen(keyNode->key) + strlen(keyNode->value) + 5;
+    for (Tombstone *tombstone = ht->deleted[index]; snapshot->delta && tombstone != NULL;
+         tombstone = tombstone->next)
+        if (in_snapshot(snapshot, tombstone->deleted))
+            len += strlen(tombstone->key) + 4;
+
+    char* bucket = len > 0 ? malloc(len + 1) : NULL;
+    if (len > 0 && bucket == NULL) {
+        atomic_store(&snapshot->failed, 1);
+    } else {
+        // A key written again after it was deleted is in both, so the
+        // deletes go first
+        size_t pos = 0;
+        for (Tombstone *tombstone = ht->deleted[index]; snapshot->delta && tombstone != NULL;
+             tombstone = tombstone->next)
+            if (in_snapshot(snapshot, tombstone->deleted))
+                pos += (size_t) sprintf(bucket + pos, "-(%s)\n", tombstone->key);
+        for (KeyNode *keyNode = ht->table[index]; keyNode != NULL; keyNode = keyNode->next)
+            if (in_snapshot(snapshot, keyNode->changed))
+                pos += (size_t) sprintf(bucket + pos, "(%s, %s)\n", keyNode->key, keyNode->value);
+        snapshot->buckets[index] = bucket;
+        snapshot->sizes[index] = pos;
+    }
+    snapshot->copied[index] = 1;
+}
+
+// Called before a bucket is changed, with its write lock held, so the
+// snapshots that did not copy it yet keep it as it was
+static void preserve_bucket(HashTable* ht, int index){
+    for (Snapshot *snapshot = ht->snapshots; snapshot != NULL; snapshot = snapshot->next)
+        if (!snapshot->copied[index])
+            copy_bucket(ht, snapshot, index);
+}
+
+// Records that a key was deleted in this epoch, for the deltas
+static void remember_delete(HashTable* ht, int index, const char* key){
+    Tombstone* tombstone = malloc(sizeof(Tombstone));
+    if (tombstone == NULL || (tombstone->key = strdup(key)) == NULL) {
+        fprintf(stderr, "[ERR]: Failed to record the delete of %s\n", key);
+        free(tombstone);
+        return;
+    }
+    tombstone->deleted = ht->epoch;
+    tombstone->next = ht->deleted[index];
+    ht->deleted[index] = tombstone;
+}
+
+// Drops the deletes no delta can have, those up to the given epoch, with
+// the snapshots lock held
+static void prune_deletes(HashTable* ht, uint64_t oldest){
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        pthread_rwlock_wrlock(&ht->locks[i]);
+        Tombstone **tombstone = &ht->deleted[i];
+        while (*tombstone != NULL) {
+            if ((*tombstone)->deleted <= oldest) {
+                Tombstone* temp = *tombstone;
+                *tombstone = temp->next;
+                free(temp->key);
+                free(temp);
+            } else {
+                tombstone = &(*tombstone)->next;
+            }
+        }
+        pthread_rwlock_unlock(&ht->locks[i]);
+    }
+}
+
+Snapshot* take_snapshot(HashTable* ht, int delta, uint64_t since){
+    Snapshot* snapshot = calloc(1, sizeof(Snapshot));
+    if (snapshot == NULL)
+        return NULL;
+    snapshot->delta = delta;
+    snapshot->since = since;
+    atomic_init(&snapshot->failed, 0);
+    atomic_init(&snapshot->released, 0);
+
+    // The only moment all the buckets are locked, no writer is halfway
+    // through a batch. The snapshots already serialized are freed.
+    pthread_mutex_lock(&ht->snapshots_lock);
+    read_lock_all_keys(ht);
+    Snapshot** prev = &ht->snapshots;
+    while (*prev != NULL) {
+        Snapshot* old = *prev;
+        if (atomic_load(&old->released)) {
+            *prev = old->next;
+            free(old);
+        } else {
+            prev = &old->next;
+        }
+    }
+    snapshot->next = ht->snapshots;
+    ht->snapshots = snapshot;
+
+    // The changes made from now on are of the next epoch
+    snapshot->epoch = ht->epoch++;
+    unlock_all_keys(ht);
+
+    // The next delta is taken since this snapshot, and the deltas not yet
+    // copied are taken since their base, so the deletes before all of
+    // them are no longer needed
+    if (ht->track_deletes) {
+        DeltaBase* base = malloc(sizeof(DeltaBase));
+        if (base == NULL) {
+            pthread_mutex_unlock(&ht->snapshots_lock);
+            atomic_store(&snapshot->released, 1);
+            return NULL;
+        }
+        base->epoch = snapshot->epoch;
+        base->next = ht->bases;
+        ht->bases = base;
+
+        uint64_t oldest = snapshot->epoch;
+        for (base = ht->bases; base != NULL; base = base->next)
+            if (base->epoch < oldest)
+                oldest = base->epoch;
+        for (Snapshot* s = ht->snapshots; s != NULL; s = s->next)
+            if (s->delta && !atomic_load(&s->released) && s->since < oldest)
+                oldest = s->since;
+        prune_deletes(ht, oldest);
+    }
+    pthread_mutex_unlock(&ht->snapshots_lock);
+    return snapshot;
+}
+
+void release_base(HashTable* ht, uint64_t epoch){
+    pthread_mutex_lock(&ht->snapshots_lock);
+    for (DeltaBase** base = &ht->bases; *base != NULL; base = &(*base)->next) {
+        if ((*base)->epoch == epoch) {
+            DeltaBase* temp = *base;
+            *base = temp->next;
+            free(temp);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ht->snapshots_lock);
+}
+
+char* serialize_snapshot(HashTable* ht, Snapshot* snapshot, size_t* size){
+    // The buckets no writer changed are copied now, one at a time
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        pthread_rwlock_rdlock(&ht->locks[i]);
+        if (!snapshot->copied[i])
+            copy_bucket(ht, snapshot, i);
+        pthread_rwlock_unlock(&ht->locks[i]);
+    }
+
+    // Every bucket is copied, so the writers no longer touch the rest
+    size_t len = 0;
+    for (int i = 0; i < TABLE_SIZE; i++)
+        len += snapshot->sizes[i];
+    char* backup = atomic_load(&snapshot->failed) ? NULL : malloc(len + 1);
+    if (backup != NULL) {
+        len = 0;
+        for (int i = 0; i < TABLE_SIZE; i++) {
+            if (snapshot->sizes[i] > 0)
+                memcpy(backup + len, snapshot->buckets[i], snapshot->sizes[i]);
+            len += snapshot->sizes[i];
+        }
+        *size = len;
+    }
+
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        free(snapshot->buckets[i]);
+        snapshot->buckets[i] = NULL;
+    }
+    atomic_store(&snapshot->released, 1);
+    return backup;
+}
+
+// Builds the notification frame of a change, the value being NULL for the
+// deletions, and returns its size
+static size_t build_notification(char message[MAX_NOTIFICATION_SIZE], const char* key,
+                                 const char* value, uint64_t sequence, uint64_t delivered){
+    size_t key_length = strnlen(key, MAX_STRING_SIZE - 1);
+    size_t value_length = value != NULL ? strnlen(value, MAX_STRING_SIZE - 1) : 0;
+
+    message[0] = value != NULL ? NOTIFICATION_UPDATE : NOTIFICATION_DELETE;
+    message[1] = (char) key_length;
+    message[2] = (char) value_length;
+    memcpy(message + 3, &sequence, sizeof(sequence));
+    memcpy(message + 3 + sizeof(sequence), &delivered, sizeof(delivered));
+    memcpy(message + NOTIFICATION_HEADER_SIZE, key, key_length);
+    if(value != NULL)
+        memcpy(message + NOTIFICATION_HEADER_SIZE + key_length, value, value_length);
+    return NOTIFICATION_HEADER_SIZE + key_length + value_length;
+}
+
+// A notification sent to its subscribers NOTIFY_CHUNK_SIZE at a time, by
+// the thread that changed the key and by the helpers it submitted
+typedef struct {
+    const int* fds;
+    size_t num_fds, num_chunks;
+    const char* message;
+    size_t size;
+    atomic_size_t next;         // Next chunk to be sent
+    size_t sent;                // Chunks sent, guarded by the lock
+    atomic_int refs;            // Helpers not yet run, plus the thread that changed the key
+    pthread_mutex_t lock;
+    pthread_cond_t all_sent;
+} FanOut;
+
+static void release_fan_out(FanOut* fan_out){
+    if(atomic_fetch_sub(&fan_out->refs, 1) == 1){
+        pthread_mutex_destroy(&fan_out->lock);
+        pthread_cond_destroy(&fan_out->all_sent);
+        free(fan_out);
+    }
+}
+
+static void send_chunks(FanOut* fan_out){
+    size_t chunk;
+    while((chunk = atomic_fetch_add(&fan_out->next, 1)) < fan_out->num_chunks){
+        size_t end = (chunk + 1) * NOTIFY_CHUNK_SIZE;
+        if(end > fan_out->num_fds)
+            end = fan_out->num_fds;
+        for(size_t i = chunk * NOTIFY_CHUNK_SIZE; i < end; i++)
+            if(session_notify(fan_out->fds[i], fan_out->message, fan_out->size))
+                fprintf(stderr, "[KVS] Failed to write to the notifications pipe.\n");
+
+        pthread_mutex_lock(&fan_out->lock);
+        if(++fan_out->sent == fan_out->num_chunks)
+            pthread_cond_signal(&fan_out->all_sent);
+        pthread_mutex_unlock(&fan_out->lock);
+    }
+}
+
+static void help_fan_out(void* arg){
+    FanOut* fan_out = (FanOut*) arg;
+    send_chunks(fan_out);
+    release_fan_out(fan_out);
+}
+
+// Sends the notification to the given clients, returning once all of them
+// have it, so each client keeps getting the changes of a key in order.
+// The thread that changed the key sends the chunks no helper took, so it
+// only waits for the ones being sent.
+static int fan_out_notification(Pool* pool, const int* fds, size_t num_fds,
+                                const char* message, size_t size){
+    FanOut* fan_out = malloc(sizeof(FanOut));
+    if(fan_out == NULL)
+        return 1;
+
+    size_t num_chunks = (num_fds + NOTIFY_CHUNK_SIZE - 1) / NOTIFY_CHUNK_SIZE;
+    *fan_out = (FanOut) {.fds = fds, .num_fds = num_fds, .num_chunks = num_chunks,
+                         .message = message, .size = size, .sent = 0};
+    atomic_init(&fan_out->next, 0);
+    atomic_init(&fan_out->refs, 1);
+    pthread_mutex_init(&fan_out->lock, NULL);
+    pthread_cond_init(&fan_out->all_sent, NULL);
+
+    for(size_t i = 1; i < num_chunks && i < pool->num_workers; i++){
+        atomic_fetch_add(&fan_out->refs, 1);
+        if(pool_submit(pool, POOL_INTERACTIVE, help_fan_out, fan_out)){
+            atomic_fetch_sub(&fan_out->refs, 1);
+            break;
+        }
+    }
+    send_chunks(fan_out);
+
+    pthread_mutex_lock(&fan_out->lock);
+    while(fan_out->sent < num_chunks)
+        pthread_cond_wait(&fan_out->all_sent, &fan_out->lock);
+    pthread_mutex_unlock(&fan_out->lock);
+    release_fan_out(fan_out);
+    return 0;
+}
+
+// Sends a change to the clients matched
+static void deliver_notification(HashTable* ht, MatchedFds* matched, const char* key,
+                                 const char* value, uint64_t sequence, uint64_t delivered){
+    char message[MAX_NOTIFICATION_SIZE];
+    size_t size = build_notification(message, key, value, sequence, delivered);
+
+    // Many subscribers are notified by the pool, a few are not worth it
+    Pool* pool = ht->pool;
+    if(pool == NULL || matched->len <= NOTIFY_CHUNK_SIZE
+       || fan_out_notification(pool, matched->fds, matched->len, message, size)){
+        for(size_t i = 0; i < matched->len; i++)
+            if(session_notify(matched->fds[i], message, size))
+                fprintf(stderr, "[KVS] Failed to write to the notifications pipe.\n");
+    }
+}
+
+// Logs the change of the key, the value being NULL if it was deleted, and
+// notifies the clients subscribed to it, or to a pattern that matches it,
+// each one only once
+static void notify_subscribers(HashTable* ht, KeyNode* keyNode, const char* value){
+    if(!ht->notifying)
+        return;
+
+    MatchedFds matched = {NULL, 0, 0};
+    for(KeyInt* aux = keyNode->fd; aux != NULL; aux = aux->next)
+        add_matched_fd(&matched, aux->fd);
+
+    pthread_rwlock_rdlock(&ht->patterns_lock);
+    match_patterns(ht->patterns, keyNode->key, &matched);
+    pthread_rwlock_unlock(&ht->patterns_lock);
+
+    unique_matched_fds(&matched);
+    if(matched.len == 0){
+        log_change(ht->changes, keyNode->key, value, NULL, NULL);
+        free(matched.fds);
+        return;
+    }
+
+    // The change is delivered outside the lock of the log, the lock of the
+    // key keeping its changes in order. The changes of other keys may reach
+    // a client out of order, so it resumes from the sequence up to which
+    // every change was delivered before this one, and gets the later ones
+    // again.
+    Delivery delivery;
+    uint64_t delivered;
+    uint64_t sequence = log_change(ht->changes, keyNode->key, value, &delivery, &delivered);
+    deliver_notification(ht, &matched, keyNode->key, value, sequence, delivered);
+    finish_delivery(ht->changes, &delivery);
+    free(matched.fds);
+}
+
 int write_pair(HashTable *ht, const char *key, const char *value) {
     int index = hash(key);
+    preserve_bucket(ht, index);
     KeyNode *keyNode = ht->table[index];
 
     // Search for the key node
@@ -100,6 +452,7 @@ int write_pair(HashTable *ht, const char *key, const char *value) {
         if (strcmp(keyNode->key, key) == 0) {
             free(keyNode->value);
             keyNode->value = strdup(value);
+            keyNode->changed = ht->epoch;
                        
             return 0;
         }
@@ -111,6 +464,7 @@ int write_pair(HashTable *ht, const char *key, const char *value) {
     keyNode->key = strdup(key); // Allocate memory for the key
     keyNode->value = strdup(value); // Allocate memory for the value
     keyNode->fd = NULL;
+    keyNode->changed = ht->epoch;
     keyNode->next = ht->table[index]; // Link to existing nodes
     ht->table[index] = keyNode; // Place new key node at the start of the list
     return 0;
@@ -140,6 +494,8 @@ int delete_pair(HashTable *ht, const char *key) {
     // Search for the key node
     while (keyNode != NULL) {
         if (strcmp(keyNode->key, key) == 0) {
+            preserve_bucket(ht, index);
+
             // Key found; delete this node
             if (prevNode == NULL) {
                 // Node to delete is the first node in the list
@@ -149,14 +505,9 @@ int delete_pair(HashTable *ht, const char *key) {
                 prevNode->next = keyNode->next; // Link the previous node to the next node
             }
 
-            char message[2*(MAX_STRING_SIZE + 1)] = {'\0'};
-            strncpy(message, key, MAX_STRING_SIZE);
-            strncpy(message + MAX_STRING_SIZE + 1, "DELETED", 8);
-
-            for(KeyInt* aux = keyNode->fd; aux != NULL; aux = aux->next){
-                if(write_all(aux->fd, message, 2*(MAX_STRING_SIZE + 1)) < 0)
-                    fprintf(stderr, "[KVS] Failed to write to the notifications pipe.\n");
-            }
+            notify_subscribers(ht, keyNode, NULL);
+            if (ht->track_deletes)
+                remember_delete(ht, index, key);
             
             // Free the memory allocated for the key and value
             free(keyNode->key);
@@ -175,17 +526,10 @@ int kvs_notify(HashTable* ht, const char *key, const char *value){
     int index = hash(key);
     KeyNode *keyNode = ht->table[index];
 
-    char message[2*(MAX_STRING_SIZE + 1)] = {'\0'};
-    strncpy(message, key, MAX_STRING_SIZE);
-    strncpy(message + MAX_STRING_SIZE + 1, value, MAX_STRING_SIZE);
-
     // Search for the key node
     while (keyNode != NULL) {
         if (strcmp(keyNode->key, key) == 0) {
-            for(KeyInt* aux = keyNode->fd; aux != NULL; aux = aux->next)
-                if(write_all(aux->fd, message, 2*(MAX_STRING_SIZE + 1)) < 0)
-                    fprintf(stderr, "[KVS] Failed to write to the notififcations pipe.\n");
-
+            notify_subscribers(ht, keyNode, value);
             return 0;
         }
         keyNode = keyNode->next; // Move to the next node
@@ -228,6 +572,127 @@ int unsubscribe_pair(HashTable* ht, const char*key, int notif_fd){
     return 1;
 }
 
+int subscribe_keys(HashTable* ht, char keys[][MAX_STRING_SIZE], size_t num_keys,
+                   int notif_fd, int subscribe, char results[]){
+    size_t* order = malloc(num_keys * sizeof(size_t));
+    if(order == NULL)
+        return 1;
+
+    // Sorts the keys by lock (counting sort), the invalid ones are left out
+    size_t first[TABLE_SIZE + 1] = {0}, next[TABLE_SIZE];
+    for(size_t i = 0; i < num_keys; i++){
+        results[i] = 0;
+        if(hash(keys[i]) >= 0)
+            first[hash(keys[i]) + 1]++;
+    }
+    for(int i = 0; i < TABLE_SIZE; i++){
+        first[i + 1] += first[i];
+        next[i] = first[i];
+    }
+    for(size_t i = 0; i < num_keys; i++)
+        if(hash(keys[i]) >= 0)
+            order[next[hash(keys[i])]++] = i;
+
+    for(int index = 0; index < TABLE_SIZE; index++){
+        if(first[index] == first[index + 1])
+            continue;
+
+        pthread_rwlock_wrlock(&ht->locks[index]);
+        for(size_t j = first[index]; j < first[index + 1]; j++){
+            size_t i = order[j];
+            KeyNode *keyNode = ht->table[index];
+            while(keyNode != NULL && strcmp(keyNode->key, keys[i]) != 0)
+                keyNode = keyNode->next;
+            if(keyNode == NULL)
+                continue;
+
+            results[i] = 1;
+            if(!subscribe){
+                keyNode->fd = delete_KeyInt_List(keyNode->fd, notif_fd);
+                continue;
+            }
+
+            // A key repeated in the batch is only subscribed once
+            KeyInt* aux = keyNode->fd;
+            while(aux != NULL && aux->fd != notif_fd)
+                aux = aux->next;
+            if(aux == NULL)
+                keyNode->fd = insert_KeyInt_List(keyNode->fd, notif_fd);
+        }
+        pthread_rwlock_unlock(&ht->locks[index]);
+    }
+
+    free(order);
+    return 0;
+}
+
+// A client being notified again of the changes it missed
+typedef struct {
+    int notif_fd;
+    uint64_t since;
+} Replay;
+
+// Notifies a client again of a change it missed, which it still resumes
+// from the sequence it gave, since only its keys are notified again
+static void replay_notification(const Change* change, void* arg){
+    Replay* replay = (Replay*) arg;
+    char message[MAX_NOTIFICATION_SIZE];
+    size_t size = build_notification(message, change->key, change->deleted ? NULL : change->value,
+                                     change->sequence, replay->since);
+    if(session_notify(replay->notif_fd, message, size))
+        fprintf(stderr, "[KVS] Failed to write to the notifications pipe.\n");
+}
+
+int resume_keys(HashTable* ht, char keys[][MAX_STRING_SIZE], size_t num_keys,
+                int notif_fd, uint64_t epoch, uint64_t since, char results[], int* truncated){
+    *truncated = 0;
+    KeySet* resumed = calloc(1, sizeof(KeySet));
+    if(resumed == NULL)
+        return 1;
+
+    // The missed changes are notified before the keys can change again,
+    // the buckets being locked in order
+    int locked[TABLE_SIZE] = {0};
+    for(size_t i = 0; i < num_keys; i++)
+        if(hash(keys[i]) >= 0)
+            locked[hash(keys[i])] = 1;
+    for(int i = 0; i < TABLE_SIZE; i++)
+        if(locked[i])
+            pthread_rwlock_wrlock(&ht->locks[i]);
+
+    for(size_t i = 0; i < num_keys; i++){
+        results[i] = 0;
+        int index = hash(keys[i]);
+        if(index < 0)
+            continue;
+
+        // The set has a key repeated in the batch once, so it is replayed once
+        insert_KeySet(resumed, keys[i]);
+
+        KeyNode *keyNode = ht->table[index];
+        while(keyNode != NULL && strcmp(keyNode->key, keys[i]) != 0)
+            keyNode = keyNode->next;
+        if(keyNode != NULL){
+            results[i] = 1;
+            KeyInt* aux = keyNode->fd;
+            while(aux != NULL && aux->fd != notif_fd)
+                aux = aux->next;
+            if(aux == NULL)
+                keyNode->fd = insert_KeyInt_List(keyNode->fd, notif_fd);
+        }
+    }
+
+    Replay replay = {notif_fd, since};
+    *truncated = replay_changes(ht->changes, resumed, epoch, since, replay_notification, &replay);
+
+    for(int i = 0; i < TABLE_SIZE; i++)
+        if(locked[i])
+            pthread_rwlock_unlock(&ht->locks[i]);
+    delete_All_KeySet(resumed);
+    free(resumed);
+    return 0;
+}
+
 void clear_subscriptions(HashTable* ht){
     write_lock_all_keys(ht);
 
@@ -242,6 +707,24 @@ void clear_subscriptions(HashTable* ht){
     }
 
     unlock_all_keys(ht);
+
+    pthread_rwlock_wrlock(&ht->patterns_lock);
+    clear_pattern_subscriptions(ht->patterns, -1);
+    pthread_rwlock_unlock(&ht->patterns_lock);
+}
+
+int subscribe_pattern_pair(HashTable* ht, const char* pattern, int notif_fd){
+    pthread_rwlock_wrlock(&ht->patterns_lock);
+    int result = subscribe_pattern(ht->patterns, pattern, notif_fd);
+    pthread_rwlock_unlock(&ht->patterns_lock);
+    return result;
+}
+
+int unsubscribe_pattern_pair(HashTable* ht, const char* pattern, int notif_fd){
+    pthread_rwlock_wrlock(&ht->patterns_lock);
+    int result = unsubscribe_pattern(ht->patterns, pattern, notif_fd);
+    pthread_rwlock_unlock(&ht->patterns_lock);
+    return result;
 }
 
 void clear_fifo_subscriptions(HashTable* ht, int notif_fd){
@@ -255,6 +738,10 @@ void clear_fifo_subscriptions(HashTable* ht, int notif_fd){
         }
     }
     unlock_all_keys(ht);
+
+    pthread_rwlock_wrlock(&ht->patterns_lock);
+    clear_pattern_subscriptions(ht->patterns, notif_fd);
+    pthread_rwlock_unlock(&ht->patterns_lock);
 }
 
 void free_table(HashTable *ht) {
@@ -269,6 +756,26 @@ void free_table(HashTable *ht) {
             free(temp->value);
             free(temp);
         }
+        while (ht->deleted[i] != NULL) {
+            Tombstone *temp = ht->deleted[i];
+            ht->deleted[i] = temp->next;
+            free(temp->key);
+            free(temp);
+        }
+    }
+    while (ht->snapshots != NULL) {
+        Snapshot *snapshot = ht->snapshots;
+        ht->snapshots = snapshot->next;
+        free(snapshot);
+    }
+    while (ht->bases != NULL) {
+        DeltaBase *base = ht->bases;
+        ht->bases = base->next;
+        free(base);
     }
+    pthread_mutex_destroy(&ht->snapshots_lock);
+    pthread_rwlock_destroy(&ht->patterns_lock);
+    free_pattern_trie(ht->patterns);
+    free_change_log(ht->changes);
     free(ht);
 }
\ No newline at end of file
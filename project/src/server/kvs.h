@@ -18,21 +18,93 @@
 #define TABLE_SIZE 26
 #include "constants.h"
 #include <stddef.h>
+#include <stdint.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include "../common/subs_lists.h"
+#include "patterns.h"
+#include "changelog.h"
+#include "pool.h"
 
 typedef struct KeyNode {
     char *key;
     char *value;
     struct KeyNode *next;
     struct KeyInt *fd;
+    uint64_t changed;           // Epoch of the last change
 } KeyNode;
 
+// A key deleted, kept while a delta snapshot may be taken since before it
+typedef struct Tombstone {
+    char *key;
+    uint64_t deleted;           // Epoch of the deletion
+    struct Tombstone *next;
+} Tombstone;
+
+// An epoch a job takes its next delta snapshot since
+typedef struct DeltaBase {
+    uint64_t epoch;
+    struct DeltaBase *next;
+} DeltaBase;
+
+// The pairs of the table as they were when the snapshot was taken, each
+// bucket formatted as a backup. A bucket is copied by the first writer to
+// change it afterwards or else when the snapshot is serialized. A delta
+// snapshot only has the pairs changed and the keys deleted since the
+// snapshot of the given epoch, the deleted ones as "-(key)" before the
+// pairs, so a key deleted and written again ends up written.
+typedef struct Snapshot {
+    uint64_t epoch;             // Changes made later are not in the snapshot
+    int delta;
+    uint64_t since;             // Epoch of the snapshot the delta is based on
+    char *buckets[TABLE_SIZE];
+    size_t sizes[TABLE_SIZE];
+    int copied[TABLE_SIZE];     // Guarded by the lock of the bucket
+    atomic_int failed;          // A bucket could not be copied
+    atomic_int released;        // Serialized, to be freed by the next snapshot
+    struct Snapshot *next;
+} Snapshot;
+
 typedef struct HashTable {
     KeyNode *table[TABLE_SIZE];
     pthread_rwlock_t locks[TABLE_SIZE];
+
+    // Snapshots taken, changed with all the buckets locked and read by
+    // the writers, which hold the lock of a bucket, and the epoch of the
+    // changes, which begins with each snapshot. The buckets are only read
+    // locked, so the snapshots are taken one at a time, under their lock.
+    Snapshot *snapshots;
+    uint64_t epoch;
+    pthread_mutex_t snapshots_lock;
+
+    // Keys deleted in each bucket, guarded by the lock of the bucket, only
+    // recorded for the delta snapshots. Those older than every base are
+    // dropped, the bases being guarded by the snapshots lock.
+    int track_deletes;
+    Tombstone *deleted[TABLE_SIZE];
+    DeltaBase *bases;
+
+    // Pattern subscriptions, locked after the keys
+    PatternNode *patterns;
+    pthread_rwlock_t patterns_lock;
+
+    // Last changes, to notify the clients that resume their subscriptions
+    ChangeLog *changes;
+
+    // Unset while the table is rebuilt from the log of the server, whose
+    // changes are neither notified nor logged, no client having missed them
+    int notifying;
+
+    // Sends the notifications of the keys with many subscribers, NULL to
+    // send them all in the thread that changed the key
+    Pool *pool;
 } HashTable;
 
+/// Hash function based on key initial.
+/// @param key Lowercase alphabetical string.
+/// @return Index of the key in the table, -1 if it has no index.
+int hash(const char *key);
+
 /// Creates a new event hash table.
 /// @return Newly created hash table, NULL on failure
 struct HashTable *create_hash_table();
@@ -92,6 +164,38 @@ char* read_pair(HashTable *ht, const char *key);
 /// @return 0 if the node was deleted successfully, 1 otherwise.
 int delete_pair(HashTable *ht, const char *key);
 
+/**
+ * @brief Takes a snapshot of the hash table. The buckets are only locked
+ * while the snapshot is registered, the pairs are copied later. When the
+ * deletes are tracked, the epoch of the snapshot becomes a base until it
+ * is released, and the deletes older than every base are dropped.
+ *
+ * @param ht Hash table.
+ * @param delta 1 for a delta of the snapshot of the given epoch.
+ * @param since Epoch of the snapshot the delta is based on.
+ * @return The snapshot, NULL on failure.
+ */
+Snapshot* take_snapshot(HashTable* ht, int delta, uint64_t since);
+
+/**
+ * @brief Releases a base, once no more deltas are taken since it.
+ *
+ * @param ht Hash table.
+ * @param epoch Epoch of the snapshot taken.
+ */
+void release_base(HashTable* ht, uint64_t epoch);
+
+/**
+ * @brief Formats a snapshot as a backup, locking one bucket at a time to
+ * copy the ones that were not changed, and releases the snapshot.
+ *
+ * @param ht Hash table of the snapshot.
+ * @param snapshot The snapshot.
+ * @param size Set to the size of the backup.
+ * @return The backup, to be freed, NULL on failure.
+ */
+char* serialize_snapshot(HashTable* ht, Snapshot* snapshot, size_t* size);
+
 /// Frees the hashtable.
 /// @param ht Hash table to be deleted.
 void free_table(HashTable *ht);
@@ -118,6 +222,63 @@ int subscribe_pair(HashTable * ht, const char*key, int notif_fd);
  */
 int unsubscribe_pair(HashTable* ht, const char*key, int notif_fd);
 
+/**
+ * @brief Subscribes or unsubscribes a batch of keys for the given file
+ * descriptor. The keys are grouped by lock, so each lock is taken once.
+ *
+ * @param ht Hash table to be modified.
+ * @param keys Array of keys.
+ * @param num_keys Number of keys.
+ * @param notif_fd File descriptor.
+ * @param subscribe 1 to subscribe the keys, 0 to unsubscribe them.
+ * @param results Set to 1 for each key that exists, 0 otherwise.
+ * @return 0 if the keys were processed, 1 otherwise.
+ */
+int subscribe_keys(HashTable* ht, char keys[][MAX_STRING_SIZE], size_t num_keys,
+                   int notif_fd, int subscribe, char results[]);
+
+/**
+ * @brief Subscribes the keys for the given file descriptor, notifying it
+ * again of the changes made to them since the given sequence, before any
+ * newer change is notified.
+ *
+ * @param ht Hash table to be modified.
+ * @param keys Keys to be subscribed.
+ * @param num_keys Number of keys.
+ * @param notif_fd File descriptor.
+ * @param epoch Epoch of the server that numbered the sequence.
+ * @param since Last sequence the client was notified of.
+ * @param results Set to 1 for each key that exists, 0 otherwise.
+ * @param truncated Set to 1 if the changes since the sequence are no
+ * longer kept, or were made by another server, in which case none is
+ * notified.
+ * @return 0 if the keys were subscribed, 1 otherwise.
+ */
+int resume_keys(HashTable* ht, char keys[][MAX_STRING_SIZE], size_t num_keys,
+                int notif_fd, uint64_t epoch, uint64_t since, char results[], int* truncated);
+
+/**
+ * @brief Subscribes a pattern for the given file descriptor, which is
+ * notified about every key that matches it, even if it is created later.
+ *
+ * @param ht Hash table to be modified.
+ * @param pattern The pattern, where '*' matches any sequence of characters
+ * and '?' any character.
+ * @param notif_fd File descriptor.
+ * @return 0 if the pattern was subscribed, 1 otherwise.
+ */
+int subscribe_pattern_pair(HashTable* ht, const char* pattern, int notif_fd);
+
+/**
+ * @brief Unsubscribes a pattern for the given file descriptor.
+ *
+ * @param ht Hash table to be modified.
+ * @param pattern The pattern.
+ * @param notif_fd File descriptor.
+ * @return 0 if the pattern was subscribed, 1 otherwise.
+ */
+int unsubscribe_pattern_pair(HashTable* ht, const char* pattern, int notif_fd);
+
 /**
  * @brief Deletes all the file descriptors previously associated with 
  * any key in the hash table, so that from now on, their values will no longer 
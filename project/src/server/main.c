@@ -7,11 +7,27 @@
  * Receives four arguments, the file folder where are the .job files,
  * the number of backups which are permited to do simultaneously, the
  * maximum number of threads that can be used and the name of the pipe
- * which the clients will connect to, in this specific order.
+ * which the clients will connect to, in this specific order. The clients
+ * may also connect through the socket with the name of the pipe followed
+ * by ".sock".
+ * 
+ * The arguments may be followed by options:
+ *  --watch keeps the server watching the folder, so the .job files
+ *    written to it later are also executed as they arrive.
+ *  --wal=<path> logs the changes to the table in the given file, which
+ *    is replayed when the server starts.
+ *  --fsync=always|never|<ms> tells when the log is synced: before each
+ *    change is done (the default), never, or every given milliseconds.
+ *  --delta-backups=<n> writes in each backup of a job only the changes
+ *    since its previous backup, and the whole table every n backups. A
+ *    delta starts with "#DELTA <previous backup>" and has "-(key)" for
+ *    each key deleted; kvs-restore rebuilds the full backup.
  * 
  * The server obtais the specified .job files, executes the commands
  * that are in those files and writes the .out files with the output 
- * of the commands (and .bck if it there is a BACKUP command).
+ * of the commands (and .bck if it there is a BACKUP command). The .job
+ * files may also have been compiled by kvs-jobc, and are then executed
+ * without being parsed.
  * 
  * The server also send notifications to the connected clients about
  * the updates/modifications of the keys which they subscribed to.
@@ -21,17 +37,24 @@
  */
 
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <string.h>
-#include <sys/wait.h>
 #include <sys/stat.h>
+#include <poll.h>
+#include <sys/inotify.h>
 #include "constants.h"
 #include "parser.h"
+#include "pipeline.h"
 #include "operations.h"
+#include "output.h"
+#include "sessions.h"
+#include "timers.h"
+#include "wal.h"
 #include <signal.h>
 #include <pthread.h>
 #include <unistd.h>
@@ -39,75 +62,110 @@
 #include "../common/protocol.h"
 #include "../common/io.h"
 #include <errno.h>
-#include <semaphore.h>
 #include <bits/sigaction.h>
 #include <bits/types/sigset_t.h>
 
-// Locks to avoid file descriptors from being closed twice
-pthread_mutex_t FDS_LOCKS[MAX_SESSION_COUNT];
-
-// A Buffer that stores the pipes paths of the clients wishing to establish connection
-char BUFFER_SESSION_PATHS[MAX_SESSION_COUNT][3*MAX_PIPE_PATH_LENGTH];
-
-// A Buffer with the file descriptors of the connected clients pipes
-// 0 - Request pipe
-// 1 - Response pipe
-// 2 - Notifications pipe
-int BUFFER_SESSION_FDS[MAX_SESSION_COUNT][3];
-
 unsigned int MAX_BACKUPS, ACTIVE_BACKUPS = 0, CLOSED = 0;
+unsigned int FULL_BACKUPS = 1; // Every how many backups of a job one is full
 unsigned int SIGUSR1_RECEIVED = 0; // To verify if there is an signal routine in course
 
-// backup_lock - To prevent the kvs table from being modified while doing a bakup
-// dir_lock - To prevent two job threads from reading the same .job file
-// session_lock - To prevent two session threads from connecting to the same client
-pthread_mutex_t backup_lock, dir_lock, session_lock;
+// backup_lock - Guards the number of backups being written
+pthread_mutex_t backup_lock;
+pthread_cond_t backup_done;
 
-// To synchronize the manager thread and the session threads
-sem_t read_sessions_sem, write_sessions_sem;
-size_t read_i = 0;
+// Runs the commands of the jobs, the backups and the notifications of the
+// keys with many subscribers, NULL if it could not be created
+Pool* POOL = NULL;
 
 // To unlink the the fifo if the server is closed by a signal
 char fifo_name[MAX_PIPE_PATH_LENGTH] = {'\0'};
 
+// A .job file and its size, which estimates how long it takes to execute
+typedef struct{
+  char name[MAX_JOB_FILE_NAME_SIZE];
+  off_t size;
+  struct timespec mtime;    // To know if a watched file was already listed
+} jobEntry;
+
+struct jobContext;
+
 // Struct with the job info
 typedef struct{
   char* dir_path;
   DIR* dir;
+  // The .job files, the largest first, followed by the ones watched in the
+  // order they arrive, guarded by lock
+  jobEntry* jobs;
+  size_t num_jobs, capacity;
+  size_t num_scanned;       // Jobs listed before the watch started
+  size_t next_job;          // Next job to be taken by a job thread
+
+  // Jobs whose WAIT ended, to be taken back by a job thread, guarded by lock
+  struct jobContext *ready_first, *ready_last;
+  size_t parked;            // Jobs in a WAIT
+  int watching;             // New jobs may still arrive
+  pthread_mutex_t lock;
+  pthread_cond_t available; // A job was resumed or added
+
+  // Watch of the directory, and the pipe that stops the watcher
+  int watch_fd, stop_watch[2];
+  pthread_t watcher;
 } jobInfo;
 
-// CLOSE FIFOS OF CLIENTS //
-
-void close_session_fifos(int session_id){
-  pthread_mutex_lock(&(FDS_LOCKS[session_id]));
-
-  if(BUFFER_SESSION_FDS[session_id][0] != -1){
-    close(BUFFER_SESSION_FDS[session_id][0]);
-    BUFFER_SESSION_FDS[session_id][0] = -1;
-  }
-  if(BUFFER_SESSION_FDS[session_id][1] != -1){
-    close(BUFFER_SESSION_FDS[session_id][1]);
-    BUFFER_SESSION_FDS[session_id][1] = -1;
-  }
-  if(BUFFER_SESSION_FDS[session_id][2] != -1){
-    close(BUFFER_SESSION_FDS[session_id][2]);
-    BUFFER_SESSION_FDS[session_id][2] = -1;
-  }
-
-  pthread_mutex_unlock(&(FDS_LOCKS[session_id]));
-}
+// The state of a job being executed, which is kept while it is parked
+typedef struct jobContext{
+  char name[MAX_JOB_FILE_NAME_SIZE];
+  JobFile* input_file;
+  OutputFile* output_file;
+  JobPipeline pipeline;
+  unsigned int current_backup;
+  uint64_t backup_epoch;    // Epoch of the last backup, the next delta is since it
+  char last_backup[MAX_JOB_FILE_NAME_SIZE];
+  jobInfo* info;
+  struct jobContext* next;  // Next job resumed
+} jobContext;
+
+// A snapshot of the table, written to its backup file by the pool
+typedef struct{
+  char path[MAX_JOB_FILE_NAME_SIZE];
+  char base[MAX_JOB_FILE_NAME_SIZE]; // Backup a delta is applied to, empty if full
+  Snapshot* snapshot;
+} backupTask;
 
-// FREES ALL THE LOCKS AND SEMAPHORES //
+// FREES ALL THE LOCKS AND SESSIONS //
 
 void destroy_and_clean(){
+  sessions_terminate();
+  if(POOL != NULL)
+    pool_destroy(POOL);
+  outputs_terminate();
+  wal_close();
   kvs_terminate();
   pthread_mutex_destroy(&backup_lock);
-  pthread_mutex_destroy(&session_lock);
-  pthread_mutex_destroy(&dir_lock);
-  for(int i = 0; i < MAX_SESSION_COUNT; i++)
-    pthread_mutex_destroy(&FDS_LOCKS[i]);
-  sem_destroy(&read_sessions_sem);
-  sem_destroy(&write_sessions_sem);
+  pthread_cond_destroy(&backup_done);
+}
+
+// WRITE BACKUPS //
+
+void write_backup(void* arg){
+  backupTask* backup = (backupTask*) arg;
+  if(kvs_backup(backup->path, backup->base[0] != '\0' ? backup->base : NULL,
+                backup->snapshot))
+    fprintf(stderr, "[JOB THREAD] Failed to perform backup.\n");
+  free(backup);
+
+  // Frees the place of the backup for the jobs waiting for one
+  pthread_mutex_lock(&backup_lock);
+  ACTIVE_BACKUPS--;
+  pthread_cond_signal(&backup_done);
+  pthread_mutex_unlock(&backup_lock);
+}
+
+// The job takes no more deltas since its last backup
+void forget_last_backup(jobContext* job){
+  if(job->last_backup[0] != '\0')
+    kvs_release_snapshot(job->backup_epoch);
+  job->last_backup[0] = '\0';
 }
 
 // HANDLE SIGNALS //
@@ -122,431 +180,524 @@ void handle_signal(int sig){
   }
 }
 
-// READ JOBS //
+// SCAN JOBS //
 
-void* read_job(void* arg){
-  // Blocks SIGUSR1 in this thread
-  sigset_t sigset1;
-  sigemptyset(&sigset1);
-  sigaddset(&sigset1, SIGUSR1);
-  if(pthread_sigmask(SIG_BLOCK, &sigset1, NULL) != 0){
-    fprintf(stderr,"[JOB THREAD] Failed to mask SIGURSR1.\n");
-    pthread_exit(NULL);
+int compare_jobs(const void* a, const void* b){
+  off_t size_a = ((const jobEntry*) a)->size, size_b = ((const jobEntry*) b)->size;
+  return (size_a < size_b) - (size_a > size_b);
+}
+
+int is_job_file(const char* name){
+  size_t length = strlen(name);
+  return length >= 4 && strncmp(name + length - 4, ".job", 4) == 0;
+}
+
+// Adds a job to the end of the list, with the lock held if the job
+// threads are running
+int add_job(jobInfo* info, const char* name){
+  if(info->num_jobs == info->capacity){
+    size_t capacity = info->capacity ? 2 * info->capacity : 64;
+    jobEntry* jobs = realloc(info->jobs, capacity * sizeof(jobEntry));
+    if(jobs == NULL)
+      return 1;
+    info->jobs = jobs;
+    info->capacity = capacity;
   }
 
-  // Block SIGPIPE in this thread
-  sigset_t sigset2;
-  sigemptyset(&sigset2);
-  sigaddset(&sigset2, SIGPIPE);
-  if(pthread_sigmask(SIG_BLOCK, &sigset2, NULL) != 0){
-    fprintf(stderr,"[JOB THREAD] Failed to mask SIGPIPE.\n");
-    pthread_exit(NULL);
+  // A file that can not be stated is still executed, as the smallest
+  jobEntry* job = &info->jobs[info->num_jobs++];
+  struct stat st;
+  strncpy(job->name, name, MAX_JOB_FILE_NAME_SIZE - 1);
+  job->name[MAX_JOB_FILE_NAME_SIZE - 1] = '\0';
+  if(fstatat(dirfd(info->dir), name, &st, 0) == 0){
+    job->size = st.st_size;
+    job->mtime = st.st_mtim;
+  }else{
+    job->size = 0;
+    job->mtime = (struct timespec) {0, 0};
   }
+  return 0;
+}
 
-  jobInfo* info = (jobInfo*) arg;
-  unsigned int current_backup = 1;
-  int input_file, output_file;
+// Lists the .job files of the directory, the largest first, so that the
+// longest jobs start first and the shorter ones fill the job threads that
+// become free, instead of a long job being left to the end
+int scan_jobs(jobInfo* info){
   struct dirent* entry;
 
-  // Browse files
-  pthread_mutex_lock(&dir_lock);
   while((entry = readdir(info->dir)) != NULL){
-    pthread_mutex_unlock(&dir_lock);
-
-    int done = 0;
-    char input_path[MAX_JOB_FILE_NAME_SIZE];
-    char output_path[MAX_JOB_FILE_NAME_SIZE];
-
     // Skip "." and ".."
-    if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0){
-      pthread_mutex_lock(&dir_lock);
+    if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
       continue;
-    }
 
     // Check if the file type is .job
-    char extension[5];
-    strncpy(extension, entry->d_name + (strlen(entry->d_name) - 4), (size_t) 4);
-    if(strncmp(extension, ".job", 4)){
+    if(!is_job_file(entry->d_name)){
       fprintf(stderr, "[JOB THREAD] Wrong type of file.\n");
-      pthread_mutex_lock(&dir_lock);
       continue;
     }
 
-    // Get the input file path
-    if(snprintf(input_path, MAX_JOB_FILE_NAME_SIZE, "%s/%s",
-                info->dir_path, entry->d_name) >= MAX_JOB_FILE_NAME_SIZE){
-      fprintf(stderr, "[JOB THREAD] Input path size exceeded.\n");
-    }
-
-    // Get the output file name
-    char output_name[MAX_STRING_SIZE];
-    strncpy(output_name, entry->d_name, strlen(entry->d_name) - 4);
-    output_name[strlen(entry->d_name) - 4] = '\0';
-
-    // Get the output file path
-    if(snprintf(output_path, MAX_JOB_FILE_NAME_SIZE,"%s/%s.out",
-                info->dir_path, output_name) >= MAX_JOB_FILE_NAME_SIZE){
-      fprintf(stderr, "[JOB THREAD] Output path size exceeded.\n");
-    }
-
-    // Open the input file
-    input_file = open(input_path, O_RDONLY);
-    if(input_file < 0){
-      fprintf(stderr, "[JOB THREAD] Error opening input file %s\n", input_path);
-      pthread_mutex_lock(&dir_lock);
-      continue;
-    }
-
-    // Open the output file
-    output_file = open(output_path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR);
-    if(output_file < 0){
-      fprintf(stderr, "[JOB THREAD] Error opening output file %s\n", output_path);
-      close(input_file);
-      pthread_mutex_lock(&dir_lock);
-      continue;
-    }
-
-    // Execute file commands
-    while(!done){
-      char keys[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-      char values[MAX_WRITE_SIZE][MAX_STRING_SIZE] = {0};
-      unsigned int delay;
-      size_t num_pairs;
-
-      switch (get_next(input_file)){
-        case CMD_WRITE:
-          num_pairs = parse_write(input_file, keys, values, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-          
-          if(num_pairs == 0){
-            fprintf(stderr, "[JOB THREAD] Invalid command. See HELP for usage.\n");
-            continue;
-          }
-
-          if(kvs_write(num_pairs, keys, values)){
-            fprintf(stderr, "[JOB THREAD] Failed to write pair.\n");
-          }
-
-          break;
-
-        case CMD_READ:
-          num_pairs = parse_read_delete(input_file, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-
-          if(num_pairs == 0){
-            fprintf(stderr, "[JOB THREAD] Invalid command. See HELP for usage.\n");
-            continue;
-          }
-
-          if(kvs_read(num_pairs, keys, output_file)){
-            fprintf(stderr, "[JOB THREAD] Failed to read pair.\n");
-          }
-
-          break;
-
-        case CMD_DELETE:
-          num_pairs = parse_read_delete(input_file, keys, MAX_WRITE_SIZE, MAX_STRING_SIZE);
-
-          if (num_pairs == 0){
-            fprintf(stderr, "[JOB THREAD] Invalid command. See HELP for usage.\n");
-            continue;
-          }
-
-          if(kvs_delete(num_pairs, keys, output_file)){
-            fprintf(stderr, "[JOB THREAD] Failed to delete pair.\n");
-          }
-          
-          break;
+    if(add_job(info, entry->d_name))
+      return 1;
+  }
 
-        case CMD_SHOW:
-          kvs_show(output_file);
+  qsort(info->jobs, info->num_jobs, sizeof(jobEntry), compare_jobs);
+  info->num_scanned = info->num_jobs;
+  return 0;
+}
 
-          break;
+// WATCH JOBS //
 
-        case CMD_WAIT:
-          if(parse_wait(input_file, &delay, NULL) == -1){
-            fprintf(stderr, "[JOB THREAD] Invalid command. See HELP for usage.\n");
-            continue;
-          }
+// Tells if the watched file is one of the listed ones, unchanged since,
+// as the watch starts before the directory is listed
+int already_listed(jobInfo* info, const char* name){
+  struct stat st;
+  if(fstatat(dirfd(info->dir), name, &st, 0) != 0)
+    return 0;
 
-          if(delay >0) {
-              write_all(output_file, "Waiting..\n", MAX_WAIT_STRING);
-              kvs_wait(delay);
-          }
-          
-          break;
+  for(size_t i = 0; i < info->num_scanned; i++)
+    if(strcmp(info->jobs[i].name, name) == 0)
+      return info->jobs[i].mtime.tv_sec == st.st_mtim.tv_sec
+             && info->jobs[i].mtime.tv_nsec == st.st_mtim.tv_nsec;
+  return 0;
+}
 
-        case CMD_BACKUP:
-          ;// Get the backup path
-          char backup_path[MAX_JOB_FILE_NAME_SIZE];
-          char aux[MAX_JOB_FILE_NAME_SIZE];
-          strncpy(aux, entry->d_name, strlen(entry->d_name) - 4);
-          aux[strlen(entry->d_name) - 4] = '\0';
-          if(snprintf(backup_path, MAX_JOB_FILE_NAME_SIZE, 
-                      "%s/%s-%d.bck", info->dir_path, aux,
-                      current_backup) >= MAX_JOB_FILE_NAME_SIZE){
-            fprintf(stderr, "[JOB THREAD] Backup path size exceeded.\n");
-            continue;
-          }
+// Adds the .job files that are written to (or moved into) the directory
+// to the list of jobs, as soon as they are closed
+void* watch_jobs(void* arg){
+  jobInfo* info = (jobInfo*) arg;
 
-          // Check if it is possible to do a backup at the moment
-          pthread_mutex_lock(&backup_lock);
-          if(ACTIVE_BACKUPS == MAX_BACKUPS){
-            wait(NULL);
-            ACTIVE_BACKUPS--;
-          }
-
-          // Make a non-blocking backup
-          kvs_read_lock();
-          int pid = fork();
-          if(pid < 0){
-            fprintf(stderr, "[JOB THREAD] Error in forking the process.\n");
-          }else if(pid == 0){
-            if(kvs_backup(backup_path))
-              fprintf(stderr, "[JOB THREAD] Failed to perform backup.\n");
-
-            close(input_file);
-            close(output_file);
-            closedir(info->dir);
-            kvs_terminate();
-            pthread_mutex_destroy(&backup_lock);
-            pthread_mutex_destroy(&dir_lock);
-            pthread_mutex_destroy(&session_lock);
-            exit(0);
-          }else{
-            ACTIVE_BACKUPS++;
-            pthread_mutex_unlock(&backup_lock);
-            current_backup++;
-            kvs_unlock();
-          }
+  // Signals are handled by the host thread
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
 
-          break;
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct pollfd fds[2] = {{.fd = info->watch_fd, .events = POLLIN},
+                          {.fd = info->stop_watch[0], .events = POLLIN}};
 
-        case CMD_INVALID:
-          fprintf(stderr, "[JOB THREAD] Invalid command. See HELP for usage.\n");
-          
-          break;
+  while(1){
+    if(poll(fds, 2, -1) < 0){
+      if(errno == EINTR)
+        continue;
+      fprintf(stderr, "[WATCHER] Failed to wait for the directory.\n");
+      break;
+    }
+    if(fds[1].revents & POLLIN)
+      break;
 
-        case CMD_HELP:
-          write_all(output_file, 
-                "Available commands:\n"
-                "  WRITE [(key,value)(key2,value2),...]\n"
-                "  READ [key,key2,...]\n"
-                "  DELETE [key,key2,...]\n"
-                "  SHOW\n"
-                "  WAIT <delay_ms>\n"
-                "  BACKUP\n"
-                "  HELP\n",
-                MAX_HELP_STRING
-          );
+    ssize_t length = read(info->watch_fd, buffer, sizeof(buffer));
+    if(length <= 0){
+      if(length < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+      fprintf(stderr, "[WATCHER] Failed to read the changes of the directory.\n");
+      break;
+    }
 
-          break;
-              
-        case CMD_EMPTY:
-          break;
+    for(char* ptr = buffer; ptr < buffer + length; ){
+      const struct inotify_event* event = (const struct inotify_event*) (void*) ptr;
+      ptr += sizeof(struct inotify_event) + event->len;
 
-        case EOC:
-          close(input_file);
-          close(output_file);
-          done = 1;
-          pthread_mutex_lock(&dir_lock);
+      if(event->mask & IN_Q_OVERFLOW)
+        fprintf(stderr, "[WATCHER] Too many changes, some .job files were missed.\n");
+      if(event->len == 0 || !is_job_file(event->name))
+        continue;
 
-          break;
+      pthread_mutex_lock(&info->lock);
+      if(!already_listed(info, event->name)){
+        if(add_job(info, event->name))
+          fprintf(stderr, "[WATCHER] Failed to add the job %s.\n", event->name);
+        else
+          pthread_cond_signal(&info->available);
       }
-
+      pthread_mutex_unlock(&info->lock);
     }
-    current_backup = 1;
   }
 
-  pthread_mutex_unlock(&dir_lock);
-  pthread_exit(NULL);
+  return NULL;
 }
 
-
-// READ SESSIONS //
-
-void* read_session(void* args){
-  // Blocks SIGUSR1 in this thread
-  sigset_t sigset1;
-  sigemptyset(&sigset1);
-  sigaddset(&sigset1, SIGUSR1);
-  if(pthread_sigmask(SIG_BLOCK, &sigset1, NULL) != 0){
-    fprintf(stderr,"[SESSION THREAD] Failed to mask SIGURSR1 in a session thread.\n");
-    pthread_exit(NULL);
+// Starts watching the directory, before it is listed so no file is missed
+int start_watch(jobInfo* info){
+  info->watch_fd = inotify_init1(IN_CLOEXEC);
+  if(info->watch_fd < 0)
+    return 1;
+  if(inotify_add_watch(info->watch_fd, info->dir_path, IN_CLOSE_WRITE | IN_MOVED_TO) < 0
+     || pipe(info->stop_watch) != 0){
+    close(info->watch_fd);
+    return 1;
   }
+  info->watching = 1;
+  return 0;
+}
 
-  // Block SIGPIPE in this thread
-  sigset_t sigset2;
-  sigemptyset(&sigset2);
-  sigaddset(&sigset2, SIGPIPE);
-  if(pthread_sigmask(SIG_BLOCK, &sigset2, NULL) != 0){
-    fprintf(stderr,"[SESSION THREAD] Failed to mask SIGPIPE in a session thread.\n");
-    pthread_exit(NULL);
-  }
+void stop_watch(jobInfo* info){
+  if(write(info->stop_watch[1], "", 1) != 1)
+    fprintf(stderr, "[WATCHER] Failed to stop the watcher.\n");
+  pthread_join(info->watcher, NULL);
+  close(info->watch_fd);
+  close(info->stop_watch[0]);
+  close(info->stop_watch[1]);
+
+  // The job threads end once the jobs left are done
+  pthread_mutex_lock(&info->lock);
+  info->watching = 0;
+  pthread_cond_broadcast(&info->available);
+  pthread_mutex_unlock(&info->lock);
+}
 
-  int session_id = *((int*) args);
-  char req_path[MAX_PIPE_PATH_LENGTH] = {'\0'}, resp_path[MAX_PIPE_PATH_LENGTH] = {'\0'}, 
-       notif_path[MAX_PIPE_PATH_LENGTH] = {'\0'}, command[1] = {'\0'}, 
-       key[MAX_STRING_SIZE + 1] = {'\0'}, response[2] = {'\0'};
-  int done, req_fd, resp_fd, notif_fd, io_result;
+// READ JOBS //
 
-  while(!CLOSED){
+// Opens the given job and starts parsing it
+jobContext* open_job(jobInfo* info, const char* name){
+  char input_path[MAX_JOB_FILE_NAME_SIZE];
+  char output_path[MAX_JOB_FILE_NAME_SIZE];
 
-    // Reads a connection request
-    sem_wait(&read_sessions_sem);
-    pthread_mutex_lock(&session_lock);
+  // Get the input file path
+  if(snprintf(input_path, MAX_JOB_FILE_NAME_SIZE, "%s/%s",
+              info->dir_path, name) >= MAX_JOB_FILE_NAME_SIZE){
+    fprintf(stderr, "[JOB THREAD] Input path size exceeded.\n");
+  }
 
-    strncpy(req_path,
-            BUFFER_SESSION_PATHS[read_i], MAX_PIPE_PATH_LENGTH);
+  // Get the output file name
+  char output_name[MAX_STRING_SIZE];
+  strncpy(output_name, name, strlen(name) - 4);
+  output_name[strlen(name) - 4] = '\0';
 
-    strncpy(resp_path,
-            BUFFER_SESSION_PATHS[read_i] + MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH); 
+  // Get the output file path
+  if(snprintf(output_path, MAX_JOB_FILE_NAME_SIZE,"%s/%s.out",
+              info->dir_path, output_name) >= MAX_JOB_FILE_NAME_SIZE){
+    fprintf(stderr, "[JOB THREAD] Output path size exceeded.\n");
+  }
 
-    strncpy(notif_path,
-            BUFFER_SESSION_PATHS[read_i] + 2*MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH);
+  jobContext* job = malloc(sizeof(jobContext));
+  if(job == NULL){
+    fprintf(stderr, "[JOB THREAD] Failed to allocate the job %s\n", input_path);
+    return NULL;
+  }
+  strcpy(job->name, name);
+  job->current_backup = 1;
+  job->backup_epoch = 0;
+  job->last_backup[0] = '\0';
+  job->next = NULL;
+
+  // Open the input file
+  job->input_file = job_open(input_path);
+  if(job->input_file == NULL){
+    fprintf(stderr, "[JOB THREAD] Error opening input file %s\n", input_path);
+    free(job);
+    return NULL;
+  }
 
-    read_i = (read_i + 1) % MAX_SESSION_COUNT;
+  // Open the output file
+  job->output_file = output_open(output_path);
+  if(job->output_file == NULL){
+    fprintf(stderr, "[JOB THREAD] Error opening output file %s\n", output_path);
+    job_close(job->input_file);
+    free(job);
+    return NULL;
+  }
 
-    pthread_mutex_unlock(&session_lock);
-    sem_post(&write_sessions_sem);
+  // The commands are parsed by the pool while these are executed, the
+  // ones that do not conflict at the same time
+  if(pipeline_start(&job->pipeline, job->input_file, POOL)){
+    fprintf(stderr, "[JOB THREAD] Failed to start parsing the file %s\n", input_path);
+    job_close(job->input_file);
+    output_close(job->output_file);
+    free(job);
+    return NULL;
+  }
+  return job;
+}
 
-    char id[MAX_STRING_SIZE - 8];
-    strncpy(id, req_path + 8, MAX_STRING_SIZE - 8);
+// Called by the timer service once the delay of a parked job passed, hands
+// the job to the first job thread that is free
+void resume_job(void* arg){
+  jobContext* job = (jobContext*) arg;
+  jobInfo* info = job->info;
+
+  pthread_mutex_lock(&info->lock);
+  if(info->ready_last != NULL)
+    info->ready_last->next = job;
+  else
+    info->ready_first = job;
+  info->ready_last = job;
+  info->parked--;
+  pthread_cond_broadcast(&info->available);
+  pthread_mutex_unlock(&info->lock);
+}
 
-    response[0] = OP_CODE_CONNECT + '0';
-    // Opens the response pipe from the client
-    if((resp_fd = open(resp_path, O_WRONLY)) < 0){
-      fprintf(stderr, "[SESSION THREAD] Failed to open the client %s response pipe.\n", id);
-      continue;
-    }
+// Parks the job until the delay passes
+int park_job(jobInfo* info, jobContext* job, unsigned int delay){
+  pthread_mutex_lock(&info->lock);
+  info->parked++;
+  pthread_mutex_unlock(&info->lock);
+
+  job->info = info;
+  if(timer_add(delay, job)){
+    fprintf(stderr, "[JOB THREAD] Failed to park the job, waiting instead.\n");
+    pthread_mutex_lock(&info->lock);
+    info->parked--;
+    pthread_mutex_unlock(&info->lock);
+    return 1;
+  }
+  return 0;
+}
 
-    // Opens the request pipe from the client
-    if((req_fd = open(req_path, O_RDONLY)) < 0){
-      fprintf(stderr, "[SESSION THREAD] Failed to open the client %s request pipe.\n", id);
-      response[1] = '1';
-      if(write_all(resp_fd, response, 2) == -1)
-        fprintf(stderr, "[SESSION THREAD] Failed to write the connection result to the client %s response pipe.\n", id);
-      close(resp_fd);
-      continue;
-    }
-    
-    // Opens the notifications pipe from the cliente
-    if((notif_fd = open(notif_path, O_WRONLY)) < 0){
-      fprintf(stderr, "[SESSION THREAD] Failed to open the client %s notifications pipe.\n", id);
-      response[1] = '1';
-      if(write_all(resp_fd, response, 2) == -1)
-        fprintf(stderr, "[SESSION THREAD] Failed to write the connection result to the client %s response pipe.\n", id);
-      close(resp_fd);
-      close(req_fd);
-      continue;
+// Takes the next job to run: a resumed job, or else a new one, the
+// largest first. Waits for the parked jobs, and the ones that may arrive
+// while the directory is watched, while there is no other.
+jobContext* next_job(jobInfo* info){
+  pthread_mutex_lock(&info->lock);
+  while(1){
+    if(info->ready_first != NULL){
+      jobContext* job = info->ready_first;
+      info->ready_first = job->next;
+      if(info->ready_first == NULL)
+        info->ready_last = NULL;
+      job->next = NULL;
+      pthread_mutex_unlock(&info->lock);
+      return job;
     }
 
-    response[1] = '0';
-    
-    // Writes the connection result to the client response pipe
-    if(write_all(resp_fd, response, 2) == -1){
-      fprintf(stderr, "[SESSION THREAD] Failed to write the connection result to the client %s response pipe.\n", id);
-      close(req_fd);
-      close(resp_fd);
-      close(notif_fd);
-      continue;
+    // A parked job keeps its output file open, so no more jobs are opened
+    // while too many are parked
+    if(info->parked < MAX_PARKED_JOBS){
+      if(info->next_job < info->num_jobs){
+        // The list may grow while the job is opened
+        char name[MAX_JOB_FILE_NAME_SIZE];
+        strcpy(name, info->jobs[info->next_job++].name);
+        pthread_mutex_unlock(&info->lock);
+        jobContext* job = open_job(info, name);
+        pthread_mutex_lock(&info->lock);
+        if(job != NULL){
+          pthread_mutex_unlock(&info->lock);
+          return job;
+        }
+        continue;
+      }
+
+      if(info->parked == 0 && !info->watching)
+        break;
     }
+    pthread_cond_wait(&info->available, &info->lock);
+  }
+  pthread_mutex_unlock(&info->lock);
+  return NULL;
+}
 
-    // In order to stop the SIGUSR1 handler from closing the file descriptors
-    // before they are updated
-    pthread_mutex_lock(&(FDS_LOCKS[session_id]));
+// Executes the commands of the job until it ends, returning 0, or until
+// it is parked by a WAIT, returning 1
+int run_job(jobInfo* info, jobContext* job){
+  while(1){
+    ParsedCommand* parsed = pipeline_next(&job->pipeline);
 
-    BUFFER_SESSION_FDS[session_id][0] = req_fd;
-    BUFFER_SESSION_FDS[session_id][1] = resp_fd;
-    BUFFER_SESSION_FDS[session_id][2] = notif_fd;
+    switch (parsed->command){
+      case CMD_WRITE:
+        if(parsed->result){
+          fprintf(stderr, "[JOB THREAD] Failed to write pair.\n");
+        }
 
-    pthread_mutex_unlock(&(FDS_LOCKS[session_id]));
+        break;
 
-    char connection_message[29 + MAX_STRING_SIZE] = {'\0'};
-    snprintf(connection_message, 29 + MAX_STRING_SIZE, "[SESSION THREAD] Connected client %s.\n",id);
-    write_all(1, connection_message, strlen(connection_message));
+      case CMD_READ:
+        if(parsed->result || kvs_print_read(parsed->num_pairs, parsed->batch.keys,
+                                            parsed->batch.values, parsed->batch.found,
+                                            job->output_file)){
+          fprintf(stderr, "[JOB THREAD] Failed to read pair.\n");
+        }
 
-    done = 0;
-    while(!done){
-      if((io_result = read_all(req_fd, command, 1, NULL)) == 0 
-         || (io_result == -1 && errno == EBADF))
         break;
-      else if(io_result == -1){
-        fprintf(stderr, "[SESSION THREAD] Failed to read a session command of the client %s.\n", id);
-        continue;
-      }
 
-      response[0] = command[0];
-      switch(command[0] - '0'){
-        case OP_CODE_DISCONNECT:
-          done = 1;
-              
-          response[1] = '0';
-          if(write_all(resp_fd, response, 2) == -1)
-            fprintf(stderr, "[SESSION THREAD] Failed to write the disconnection response to the client %s response pipe.\n", id);
+      case CMD_DELETE:
+        if(parsed->result || kvs_print_delete(parsed->num_pairs, parsed->batch.keys,
+                                              parsed->batch.found, job->output_file)){
+          fprintf(stderr, "[JOB THREAD] Failed to delete pair.\n");
+        }
+        
+        break;
 
-          break;
+      case CMD_SHOW:
+        kvs_show(job->output_file);
 
-        case OP_CODE_SUBSCRIBE:
-          if((io_result = read_all(req_fd, key, MAX_STRING_SIZE, NULL)) <= 0){
-            fprintf(stderr, "[SESSION THREAD] Failed to read the key to be subscribed of client %s.\n", id);
-            done = 1;
-            continue;
-          }
+        break;
 
-          if(kvs_subscribe(notif_fd, key))
-            response[1] = '0';
-          else{
-            response[1] = '1';
-          }
+      case CMD_WAIT:
+        if(parsed->delay >0) {
+            output_write(job->output_file, "Waiting..\n", MAX_WAIT_STRING);
 
-          if(write_all(resp_fd, response, 2) == -1){
-            fprintf(stderr, "[SESSION THREAD] Failed to write the subscribing response to the client %s response pipe.\n", id);
-            done = 1;
+            // The job is parked until the delay passes, while this
+            // thread runs the other jobs. Its output so far is written
+            // meanwhile.
+            unsigned int delay = parsed->delay;
+            pipeline_release(&job->pipeline);
+            output_flush(job->output_file);
+            if(park_job(info, job, delay) == 0)
+              return 1;
+
+            kvs_wait(delay);
             continue;
-          }
+        }
+        
+        break;
 
+      case CMD_BACKUP:
+        ;// Get the backup path
+        char backup_path[MAX_JOB_FILE_NAME_SIZE];
+        char aux[MAX_JOB_FILE_NAME_SIZE];
+        strncpy(aux, job->name, strlen(job->name) - 4);
+        aux[strlen(job->name) - 4] = '\0';
+        if(snprintf(backup_path, MAX_JOB_FILE_NAME_SIZE, 
+                    "%s/%s-%d.bck", info->dir_path, aux,
+                    job->current_backup) >= MAX_JOB_FILE_NAME_SIZE){
+          fprintf(stderr, "[JOB THREAD] Backup path size exceeded.\n");
           break;
+        }
 
-        case OP_CODE_UNSUBSCRIBE:
-          if((io_result = read_all(req_fd, key, MAX_STRING_SIZE, NULL)) <= 0){
-            fprintf(stderr, "[SESSION THREAD] Failed to read the key to be unsubscribed of the client %s.\n", id);
-            done = 1;
-            continue;
-          }
+        // Wait until it is possible to do a backup
+        pthread_mutex_lock(&backup_lock);
+        while(MAX_BACKUPS > 0 && ACTIVE_BACKUPS >= MAX_BACKUPS)
+          pthread_cond_wait(&backup_done, &backup_lock);
+        ACTIVE_BACKUPS++;
+        pthread_mutex_unlock(&backup_lock);
+
+        // Every FULL_BACKUPS backups one is full, the others only have the
+        // changes since the previous backup of the job
+        int delta = job->last_backup[0] != '\0'
+                    && (job->current_backup - 1) % FULL_BACKUPS != 0;
+
+        // Make a non-blocking backup: a snapshot of the table is taken at
+        // once, and the pool copies and writes it while the job goes on
+        backupTask* backup = malloc(sizeof(backupTask));
+        if(backup == NULL
+           || (backup->snapshot = kvs_snapshot(delta, job->backup_epoch)) == NULL){
+          fprintf(stderr, "[JOB THREAD] Failed to perform backup.\n");
+          free(backup);
+          forget_last_backup(job);
+          pthread_mutex_lock(&backup_lock);
+          ACTIVE_BACKUPS--;
+          pthread_cond_signal(&backup_done);
+          pthread_mutex_unlock(&backup_lock);
+          break;
+        }
+        strcpy(backup->path, backup_path);
+        strcpy(backup->base, delta ? job->last_backup : "");
+        forget_last_backup(job);
+        job->backup_epoch = backup->snapshot->epoch;
+        strcpy(job->last_backup, strrchr(backup_path, '/') + 1);
+        job->current_backup++;
 
-          if(kvs_unsubscribe(notif_fd, key))
-            response[1] = '1';
-          else{
-            response[1] = '0';
-          }
+        if(POOL == NULL || pool_submit(POOL, POOL_BATCH, write_backup, backup))
+          write_backup(backup);
 
-          if(write_all(resp_fd, response, 2) == -1){
-            fprintf(stderr, "[SESSION THREAD] Failed to write the unsubscribing response to the client %s response pipe.\n", id);
-            done = 1;
-            continue;
-          }
+        break;
 
-          break;
-      }
+      case CMD_INVALID:
+        fprintf(stderr, "[JOB THREAD] Invalid command. See HELP for usage.\n");
+        
+        break;
+
+      case CMD_HELP:
+        output_write(job->output_file,
+              "Available commands:\n"
+              "  WRITE [(key,value)(key2,value2),...]\n"
+              "  READ [key,key2,...]\n"
+              "  DELETE [key,key2,...]\n"
+              "  SHOW\n"
+              "  WAIT <delay_ms>\n"
+              "  BACKUP\n"
+              "  HELP\n",
+              MAX_HELP_STRING
+        );
+
+        break;
+            
+      case CMD_EMPTY:
+        break;
+
+      case EOC:
+        pipeline_finish(&job->pipeline);
+        forget_last_backup(job);
+        job_close(job->input_file);
+        if(output_close(job->output_file))
+          fprintf(stderr, "[JOB THREAD] Failed to write the output of %s\n", job->name);
+        free(job);
+        return 0;
     }
 
-    char disconnection_message[32 + MAX_STRING_SIZE] = {'\0'};
-    snprintf(disconnection_message, 32 + MAX_STRING_SIZE, "[SESSION THREAD] Disconnected client %s.\n",id);
-    write_all(1, disconnection_message, strlen(disconnection_message));
+    pipeline_release(&job->pipeline);
+  }
+}
 
-    unsubscribe_fifo(notif_fd);
-    close_session_fifos(session_id);
+void* read_job(void* arg){
+  // Blocks SIGUSR1 in this thread
+  sigset_t sigset1;
+  sigemptyset(&sigset1);
+  sigaddset(&sigset1, SIGUSR1);
+  if(pthread_sigmask(SIG_BLOCK, &sigset1, NULL) != 0){
+    fprintf(stderr,"[JOB THREAD] Failed to mask SIGURSR1.\n");
+    pthread_exit(NULL);
+  }
+
+  // Block SIGPIPE in this thread
+  sigset_t sigset2;
+  sigemptyset(&sigset2);
+  sigaddset(&sigset2, SIGPIPE);
+  if(pthread_sigmask(SIG_BLOCK, &sigset2, NULL) != 0){
+    fprintf(stderr,"[JOB THREAD] Failed to mask SIGPIPE.\n");
+    pthread_exit(NULL);
   }
 
+  jobInfo* info = (jobInfo*) arg;
+  jobContext* job;
+
+  // Run the jobs until they all ended, a parked job is taken back by
+  // any job thread
+  while((job = next_job(info)) != NULL)
+    run_job(info, job);
+
   pthread_exit(NULL);
 }
 
+
 int main(int argc, char**argv){
   // Check if the number of arguments is correct
-  if(argc != 5){
+  if(argc < 5){
     fprintf(stderr,"Invalid number of arguments.\n");
     return 1;
   }
 
+  // Read the options that follow the arguments
+  int watch = 0;
+  const char* wal_path = NULL;
+  enum WalSync wal_sync = WAL_SYNC_ALWAYS;
+  unsigned int wal_interval = 0;
+  unsigned int full_backups;
+  for(int i = 5; i < argc; i++){
+    char* end;
+    if(strcmp(argv[i], "--watch") == 0){
+      watch = 1;
+    }else if(strncmp(argv[i], "--wal=", 6) == 0 && argv[i][6] != '\0'){
+      wal_path = argv[i] + 6;
+    }else if(strcmp(argv[i], "--fsync=always") == 0){
+      wal_sync = WAL_SYNC_ALWAYS;
+    }else if(strcmp(argv[i], "--fsync=never") == 0){
+      wal_sync = WAL_SYNC_NEVER;
+    }else if(strncmp(argv[i], "--fsync=", 8) == 0 && argv[i][8] != '\0'
+             && (wal_interval = (unsigned int) strtoul(argv[i] + 8, &end, 10)) > 0
+             && *end == '\0'){
+      wal_sync = WAL_SYNC_INTERVAL;
+    }else if(strncmp(argv[i], "--delta-backups=", 16) == 0 && argv[i][16] != '\0'
+             && (full_backups = (unsigned int) strtoul(argv[i] + 16, &end, 10)) > 0
+             && *end == '\0'){
+      FULL_BACKUPS = full_backups;
+    }else{
+      fprintf(stderr,"Invalid option: %s.\n", argv[i]);
+      return 1;
+    }
+  }
+
   // Deletes the server pipe if it already exists
   if(unlink(argv[4]) != 0 && errno != ENOENT){
     fprintf(stderr, "Unlink(%s) failed.\n", argv[4]);
@@ -574,67 +725,46 @@ int main(int argc, char**argv){
   }
 
   pthread_t jobs_ids[max_jobs];
-  pthread_t sessions_ids[MAX_SESSION_COUNT];
+
+  // One pool, as large as the number of processors, does the work of the
+  // jobs and the notifications. The job threads still drive the jobs, only
+  // waiting for the commands in order, and the event loops of the sessions
+  // keep their own threads. Without the pool, everything runs in the job
+  // threads, one command at a time.
+  long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  POOL = pool_create(num_cpus > 0 ? (size_t) num_cpus : max_jobs);
+  if(POOL == NULL)
+    fprintf(stderr, "Failed to create the pool, the commands run one at a time.\n");
+
+  // The outputs and backups are written through io_uring, if available
+  if(outputs_init())
+    fprintf(stderr, "io_uring is not available, the files are written by the job threads.\n");
 
   // Inicialize the kvs hashtable
-  if(kvs_init()){
+  if(kvs_init(POOL, FULL_BACKUPS > 1)){
     fprintf(stderr, "Failed to initialize KVS.\n");
+    if(POOL != NULL)
+      pool_destroy(POOL);
+    outputs_terminate();
     return 1;
   }
 
-  if(pthread_mutex_init(&backup_lock, NULL) < 0){
+  if(pthread_mutex_init(&backup_lock, NULL) < 0 || pthread_cond_init(&backup_done, NULL) < 0){
     fprintf(stderr, "Failed to initialize the backups lock.\n");
+    if(POOL != NULL)
+      pool_destroy(POOL);
+    outputs_terminate();
     kvs_terminate();
     return 1;
   }
 
-  if(pthread_mutex_init(&dir_lock, NULL) < 0){
-    fprintf(stderr, "Failed to initialize the directory lock.\n");
-    kvs_terminate();
-    pthread_mutex_destroy(&backup_lock);
-    return 1;
-  }
-
-  if(pthread_mutex_init(&session_lock, NULL) < 0){
-    fprintf(stderr, "Failed to initialize the session mutex.\n");
-    kvs_terminate();
-    pthread_mutex_destroy(&backup_lock);
-    pthread_mutex_destroy(&dir_lock);
-    return 1;
-  }
-
-  for(int i = 0; i < MAX_SESSION_COUNT; i++)
-    if(pthread_mutex_init(&(FDS_LOCKS[i]), NULL) < 0){
-      fprintf(stderr, "Failed to initialize the file descriptors lock.\n");
-      kvs_terminate();
-      pthread_mutex_destroy(&backup_lock);
-      pthread_mutex_destroy(&dir_lock);
-      pthread_mutex_destroy(&session_lock);
-      return 1;
-    }
-
-  if(sem_init(&read_sessions_sem, 0, 0) <0){
-    fprintf(stderr, "Failed to initialize the read semaphore.\n");
-    kvs_terminate();
-    pthread_mutex_destroy(&backup_lock);
-    pthread_mutex_destroy(&dir_lock);
-    pthread_mutex_destroy(&session_lock);
-    for(int i = 0; i < MAX_SESSION_COUNT; i++)
-      pthread_mutex_destroy(&(FDS_LOCKS[i]));
-    return 1;
-  }
-
-  if(sem_init(&write_sessions_sem, 0, MAX_SESSION_COUNT) < 0){
-    fprintf(stderr, "Failed to initialize the write semaphore.\n");
-    kvs_terminate();
-    pthread_mutex_destroy(&backup_lock);
-    pthread_mutex_destroy(&dir_lock);
-    pthread_mutex_destroy(&session_lock);
-    for(int i = 0; i < MAX_SESSION_COUNT; i++)
-      pthread_mutex_destroy(&(FDS_LOCKS[i]));
-    sem_destroy(&read_sessions_sem);
+  // Rebuild the table from the log, then log the changes made from now on
+  if(wal_path != NULL && wal_open(wal_path, wal_sync, wal_interval, kvs_write, kvs_delete_keys)){
+    fprintf(stderr, "Failed to open the log.\n");
+    destroy_and_clean();
     return 1;
   }
+  kvs_start_notifications();
 
   // Open the given directory
   DIR* dir = opendir(argv[1]);
@@ -649,6 +779,42 @@ int main(int argc, char**argv){
     jobInfo tinfo;
     tinfo.dir_path = argv[1];
     tinfo.dir = dir;
+    tinfo.jobs = NULL;
+    tinfo.num_jobs = tinfo.capacity = tinfo.num_scanned = tinfo.next_job = 0;
+    tinfo.ready_first = tinfo.ready_last = NULL;
+    tinfo.parked = 0;
+    tinfo.watching = 0;
+    pthread_mutex_init(&tinfo.lock, NULL);
+    pthread_cond_init(&tinfo.available, NULL);
+
+    // In watch mode the jobs are also taken as they arrive
+    if(watch && start_watch(&tinfo)){
+      fprintf(stderr, "Failed to watch the directory.\n");
+      destroy_and_clean();
+      closedir(dir);
+      return 1;
+    }
+
+    // Without the timer service, a WAIT keeps its job thread sleeping
+    if(timers_init(resume_job))
+      fprintf(stderr, "Failed to start the timers, the WAIT commands block the job threads.\n");
+
+    // List the jobs before the job threads start taking them
+    if(scan_jobs(&tinfo)){
+      fprintf(stderr, "Failed to list the jobs.\n");
+      free(tinfo.jobs);
+      destroy_and_clean();
+      closedir(dir);
+      return 1;
+    }
+
+    if(tinfo.watching && pthread_create(&tinfo.watcher, NULL, watch_jobs, &tinfo) != 0){
+      fprintf(stderr, "Failed to create the watcher thread.\n");
+      close(tinfo.watch_fd);
+      close(tinfo.stop_watch[0]);
+      close(tinfo.stop_watch[1]);
+      tinfo.watching = 0;
+    }
 
     // Create jobs threads
     for(int i = 0; i < (int) max_jobs; i++){
@@ -660,23 +826,12 @@ int main(int argc, char**argv){
       }
     }
 
-    // Resets all the fds of the sessions threads in order to stop the server
-    for(int i = 0; i < MAX_SESSION_COUNT; i++){
-      BUFFER_SESSION_FDS[i][0] = -1;
-      BUFFER_SESSION_FDS[i][1] = -1;
-      BUFFER_SESSION_FDS[i][2] = -1;
-    }
-    
-    // Create sessions threads
-    int session_ids[MAX_SESSION_COUNT];
-    for(int i = 0; i < MAX_SESSION_COUNT; i++){
-      session_ids[i] = i;
-      if(pthread_create(&(sessions_ids[i]), NULL, read_session, &(session_ids[i])) < 0){
-        fprintf(stderr, "Failed to create a session thread.\n");
-        destroy_and_clean();
-        closedir(dir);
-        return 1;
-      }
+    // Start the event loops of the sessions
+    if(sessions_init(POOL)){
+      fprintf(stderr, "Failed to initialize the sessions.\n");
+      destroy_and_clean();
+      closedir(dir);
+      return 1;
     }
 
     // Prepare to handle SIGUSR1
@@ -688,12 +843,12 @@ int main(int argc, char**argv){
     }
 
     // Read connection requests
-    size_t write_i = 0;
-    int server_fd, io_result;
+    int server_fd, listen_fd;
+    ssize_t io_result;
     char connection_request[1 + 3*MAX_PIPE_PATH_LENGTH];
 
-    // Open server pipe
-    while((server_fd = open(argv[4], O_RDONLY)) < 0){
+    // Open server pipe, without waiting for the first client
+    while((server_fd = open(argv[4], O_RDONLY | O_NONBLOCK)) < 0){
       // Try again if open was interrupted by a signal
       if(errno == EINTR)
         continue;
@@ -702,47 +857,84 @@ int main(int argc, char**argv){
       closedir(dir);
       return 1;
     }
-    
+
+    // Open the server socket, next to the server pipe
+    char socket_path[MAX_JOB_FILE_NAME_SIZE];
+    if(snprintf(socket_path, MAX_JOB_FILE_NAME_SIZE, "%s%s",
+                argv[4], SOCKET_PATH_SUFFIX) >= MAX_JOB_FILE_NAME_SIZE
+       || (unlink(socket_path) != 0 && errno != ENOENT)
+       || (listen_fd = session_listen(socket_path)) < 0){
+      fprintf(stderr, "Failed to create the server socket.\n");
+      close(server_fd);
+      destroy_and_clean();
+      closedir(dir);
+      return 1;
+    }
+
+    struct pollfd server_fds[2] = {{.fd = server_fd, .events = POLLIN},
+                                   {.fd = listen_fd, .events = POLLIN}};
+
     while(!CLOSED){
       if(SIGUSR1_RECEIVED){
         SIGUSR1_RECEIVED = 0;
 
         write_all(1, "[HOST] SIGUSR1 received.\n", 26);
 
-        // Verifies that all request, response and notification fifos are closed
-        for(int i = 0; i < MAX_SESSION_COUNT; i++){
-          close_session_fifos(i);
-        }
-        
+        // Disconnects all the clients
+        sessions_close_all();
+
         // Clears all subscriptions
         kvs_clear_subscriptions();
       }
 
+      // Wait for connection requests on the server pipe and socket
+      if(poll(server_fds, 2, -1) < 0){
+        if(errno != EINTR)
+          fprintf(stderr, "[HOST] Failed to wait for connection requests.\n");
+        continue;
+      }
+
+      // Accept the clients connecting through the server socket
+      if(server_fds[1].revents & POLLIN)
+        session_accept_socket(listen_fd);
+
+      if(!(server_fds[0].revents & (POLLIN | POLLHUP)))
+        continue;
+
       // Read connection requests from the server pipe
-      sem_wait(&write_sessions_sem);
-      if((io_result = read_all(server_fd, connection_request, 1 + 3*MAX_PIPE_PATH_LENGTH, NULL)) == 1){
+      io_result = read(server_fd, connection_request, 1 + 3*MAX_PIPE_PATH_LENGTH);
+      if(io_result == 1 + 3*MAX_PIPE_PATH_LENGTH){
         if(connection_request[0] != '1'){
           fprintf(stderr, "[HOST] Invalid command.\n"); 
           break;
         }
 
-        strncpy(BUFFER_SESSION_PATHS[write_i], connection_request + 1, MAX_PIPE_PATH_LENGTH);
-        strncpy(BUFFER_SESSION_PATHS[write_i] + MAX_PIPE_PATH_LENGTH, connection_request + 1 + MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH);
-        strncpy(BUFFER_SESSION_PATHS[write_i] + 2*MAX_PIPE_PATH_LENGTH, connection_request + 1 + 2*MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH);
-        write_i = (write_i + 1) % MAX_SESSION_COUNT;
-        sem_post(&read_sessions_sem);
-        continue;
-      }
-      if(io_result < 0){
+        // Opens the client pipes and hands the session to an event loop
+        session_accept(connection_request + 1);
+      }else if(io_result == 0){
+        // Every client closed the server pipe, reopens it so that
+        // poll does not keep reporting the end of file
+        close(server_fd);
+        if((server_fd = open(argv[4], O_RDONLY | O_NONBLOCK)) < 0){
+          fprintf(stderr, "[HOST] Failed to reopen the server pipe.\n");
+          break;
+        }
+        server_fds[0].fd = server_fd;
+      }else if(io_result > 0 || (errno != EAGAIN && errno != EINTR)){
         fprintf(stderr, "[HOST] Failed to read a connection request.\n");
       }
-      sem_post(&write_sessions_sem);
     }
 
+    // Closes the server socket
+    close(listen_fd);
+    unlink(socket_path);
+
     // Closes the server
     close(server_fd);
 
-    // Wait until all jobs finish
+    // Stop taking new jobs, then wait until all jobs finish
+    if(tinfo.watching)
+      stop_watch(&tinfo);
     for(int i = 0; i < (int) max_jobs; i++)
       if(pthread_join(jobs_ids[i], NULL) < 0){
         fprintf(stderr, "Failed to join a job thread.\n");
@@ -752,20 +944,18 @@ int main(int argc, char**argv){
       }
       
     // Wait until all backups finish
-    for(int i = 0; i < (int) ACTIVE_BACKUPS; i++)
-      wait(NULL);
-
+    pthread_mutex_lock(&backup_lock);
+    while(ACTIVE_BACKUPS > 0)
+      pthread_cond_wait(&backup_done, &backup_lock);
+    pthread_mutex_unlock(&backup_lock);
+
+    timers_terminate();
+    pthread_mutex_destroy(&tinfo.lock);
+    pthread_cond_destroy(&tinfo.available);
+    free(tinfo.jobs);
     closedir(dir);
 
-    // Wait until all sessions finish
-    for(int i = 0; i < MAX_SESSION_COUNT; i++)
-      if(pthread_join(sessions_ids[i], NULL) < 0){
-        fprintf(stderr, "failed to join a session thread.\n");
-        destroy_and_clean();
-        return 1;
-      }
-    
-    //Destroys the locks and the semaphores
+    //Disconnects the clients and destroys the locks
     destroy_and_clean();
 
     // Unlinks the server pipe
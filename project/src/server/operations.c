@@ -19,9 +19,11 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include "kvs.h"
+#include "operations.h"
 #include "constants.h"
 #include <pthread.h>
 #include "heap.h"
+#include "wal.h"
 #include "../common/io.h"
 
 static struct HashTable* KVS_TABLE = NULL;
@@ -34,7 +36,7 @@ static struct timespec delay_to_timespec(unsigned int delay_ms){
   return (struct timespec) {delay_ms / 1000, (delay_ms % 1000) * 1000000};
 }
 
-int kvs_init(){
+int kvs_init(Pool* pool, int delta_backups){
   if(KVS_TABLE != NULL){
     fprintf(stderr, "[OPERATIONS] KVS state has already been initialized.\n");
     return 1;
@@ -43,7 +45,11 @@ int kvs_init(){
   pthread_rwlock_init(&PERMISSION_LOCK, NULL);
 
   KVS_TABLE = create_hash_table();
-  return KVS_TABLE == NULL;
+  if(KVS_TABLE == NULL)
+    return 1;
+  KVS_TABLE->pool = pool;
+  KVS_TABLE->track_deletes = delta_backups;
+  return 0;
 }
 
 int kvs_terminate(){
@@ -57,15 +63,30 @@ int kvs_terminate(){
   return 0;
 }
 
-void kvs_read_lock(){
-  read_lock_all_keys(KVS_TABLE);
+void kvs_start_notifications(){
+  KVS_TABLE->notifying = 1;
 }
 
-void kvs_unlock(){
-  unlock_all_keys(KVS_TABLE);
+uint64_t kvs_epoch(){
+  return KVS_TABLE->changes->epoch;
 }
 
 int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]){
+  uint64_t position;
+  if(kvs_write_deferred(num_pairs, keys, values, &position))
+    return 1;
+
+  // Waits, without the locks, until the change is in the log
+  if(wal_commit(position)){
+    fprintf(stderr, "[OPERATIONS] Failed to log the written pairs.\n");
+    return 1;
+  }
+  return 0;
+}
+
+int kvs_write_deferred(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE],
+                       uint64_t* position){
+  *position = 0;
   if(KVS_TABLE == NULL){
     fprintf(stderr, "[OPERATIONS] KVS state must be initialized.\n");
     return 1;
@@ -90,6 +111,8 @@ int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_
     }
   }
 
+  // Logged before the keys are unlocked, in the order the keys change
+  *position = wal_log_write(num_pairs, keys, values);
   
   size_t i = 0;
   while (i < (num_pairs-1)){
@@ -111,139 +134,225 @@ int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_
   return 0;
 }
 
-int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd){
-    if(KVS_TABLE == NULL){
-      fprintf(stderr, "[OPERATIONS] KVS state must be initialized.\n");
-      return 1;
+int kvs_read_values(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                    char values[][MAX_STRING_SIZE], char found[]){
+  if(KVS_TABLE == NULL){
+    fprintf(stderr, "[OPERATIONS] KVS state must be initialized.\n");
+    return 1;
+  }
+
+  // The keys are locked through a sorted copy to avoid deadlocks,
+  // so the values are kept in the order of the given keys
+  char (*sorted)[MAX_STRING_SIZE] = malloc(num_pairs * sizeof(*sorted));
+  if(sorted == NULL){
+    fprintf(stderr, "[OPERATIONS] Failed to allocate the keys to be read.\n");
+    return 1;
+  }
+  memcpy(sorted, keys, num_pairs * sizeof(*sorted));
+  heap_sort(sorted, NULL, (int)num_pairs);
+
+  // Avoid performing while other thread is executing the show command
+  pthread_rwlock_rdlock(&PERMISSION_LOCK);
+
+  // Read lock the given keys of the hash table
+  read_lock_keys(KVS_TABLE, sorted, (int)num_pairs);
+
+  // Read all the given pairs
+  for(size_t i = 0; i < num_pairs; i++){
+    char *result = read_pair(KVS_TABLE, keys[i]);
+    found[i] = result != NULL;
+    values[i][0] = '\0';
+    if(result != NULL){
+      strncpy(values[i], result, MAX_STRING_SIZE - 1);
+      values[i][MAX_STRING_SIZE - 1] = '\0';
+      free(result);
     }
+  }
 
-    char aux[MAX_WRITE_SIZE];
+  // Unlock the keys that were previously locked
+  unlock_keys(KVS_TABLE, sorted, (int)num_pairs);
 
-    // Sorts the keys to avoid deadlocks
+  pthread_rwlock_unlock(&PERMISSION_LOCK);
+  free(sorted);
+  return 0;
+}
+
+int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], OutputFile* out){
+    char (*values)[MAX_STRING_SIZE] = malloc(num_pairs * sizeof(*values));
+    char* found = malloc(num_pairs);
+
+    // Sorts the keys, which are written in this order
     heap_sort(keys, NULL, (int)num_pairs);
 
-    // Avoid performing while other thread is executing the show command
-    pthread_rwlock_rdlock(&PERMISSION_LOCK);
+    if(values == NULL || found == NULL || kvs_read_values(num_pairs, keys, values, found)){
+      fprintf(stderr,"[OPERATIONS] Failed to read the keys.\n");
+      free(values);
+      free(found);
+      return 1;
+    }
 
-    // Read lock the given keys of the hash table
-    read_lock_keys(KVS_TABLE, keys, (int)num_pairs);
+    int result = kvs_print_read(num_pairs, keys, values, found, out);
+    free(values);
+    free(found);
+    return result;
+}
+
+int kvs_print_read(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                   char values[][MAX_STRING_SIZE], const char found[], OutputFile* out){
+    char aux[MAX_WRITE_SIZE];
 
     // Write opening bracket
-    if(write_all(fd, "[", 1) < 0){
+    int result = 0;
+    if(output_write(out, "[", 1)){
       fprintf(stderr,"[OPERATIONS] Error writing opening bracket.\n");
-      unlock_keys(KVS_TABLE, keys, (int)num_pairs);
-      pthread_rwlock_unlock(&PERMISSION_LOCK);
-      return 1;
+      result = 1;
     }
 
-    // Read all the given pairs
-    for(size_t i = 0; i < num_pairs; i++){
-      char *result = read_pair(KVS_TABLE, keys[i]); // Read the value associated with the key
-
-      if(result == NULL){
+    // Write all the given pairs
+    for(size_t i = 0; i < num_pairs && !result; i++){
+      if(!found[i]){
         snprintf(aux, sizeof(aux), "(%s,KVSERROR)", keys[i]); // Handle missing key
       }else{
-        snprintf(aux, sizeof(aux), "(%s,%s)", keys[i], result); // Format the key-value pair
-        free(result); // Free memory allocated by `read_pair`
+        snprintf(aux, sizeof(aux), "(%s,%s)", keys[i], values[i]); // Format the key-value pair
       }
 
       // Write formatted string
       size_t len = strlen(aux);
-      if(write_all(fd, aux, len) < 0) {
+      if(output_write(out, aux, len)) {
         fprintf(stderr,"[OPERATIONS] Error writing key-value pair.\n");
-        unlock_keys(KVS_TABLE, keys, (int)num_pairs);
-        pthread_rwlock_unlock(&PERMISSION_LOCK);
-        return 1;
+        result = 1;
       }
 
       // Add comma between pairs except for the last one
-      if(i < num_pairs - 1){
-        if(write_all(fd, ",", 1) <-1){
-          fprintf(stderr,"[OPERATIONS] Error writing comma separator.\n");
-          unlock_keys(KVS_TABLE, keys, (int)num_pairs);
-          pthread_rwlock_unlock(&PERMISSION_LOCK);
-          return 1;
-        }
+      else if(i < num_pairs - 1 && output_write(out, ",", 1)){
+        fprintf(stderr,"[OPERATIONS] Error writing comma separator.\n");
+        result = 1;
       }
     }
 
     // Write closing bracket and newline
-    if(write_all(fd, "]\n", 2) < 0){
+    if(!result && output_write(out, "]\n", 2)){
       fprintf(stderr,"[OPERATIONS] Error writing closing bracket.\n");
-      unlock_keys(KVS_TABLE, keys, (int)num_pairs);
-      pthread_rwlock_unlock(&PERMISSION_LOCK);
-      return 1;
+      result = 1;
     }
 
-    // Unlock the keys that were previously locked
-    unlock_keys(KVS_TABLE, keys, (int)num_pairs);
-
-    pthread_rwlock_unlock(&PERMISSION_LOCK);
-    return 0;
+    return result;
 }
 
+int kvs_delete_keys(size_t num_pairs, char keys[][MAX_STRING_SIZE], char missing[]){
+  uint64_t position;
+  if(kvs_delete_deferred(num_pairs, keys, missing, &position))
+    return 1;
 
-int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd){
+  // Waits, without the locks, until the change is in the log
+  if(wal_commit(position)){
+    fprintf(stderr, "[OPERATIONS] Failed to log the deleted keys.\n");
+    return 1;
+  }
+  return 0;
+}
+
+int kvs_delete_deferred(size_t num_pairs, char keys[][MAX_STRING_SIZE], char missing[], uint64_t* position){
+  *position = 0;
   if(KVS_TABLE == NULL){
     fprintf(stderr, "[OPERATIONS] KVS state must be initialized.\n");
     return 1;
   }
-  int aux = 0;
-  char aux_string[MAX_WRITE_SIZE];
 
-  // Sorts the keys to avoid deadlocks
-  heap_sort(keys, NULL, (int)num_pairs);
+  // The keys are locked through a sorted copy to avoid deadlocks,
+  // so the results are kept in the order of the given keys
+  char (*sorted)[MAX_STRING_SIZE] = malloc(num_pairs * sizeof(*sorted));
+  if(sorted == NULL){
+    fprintf(stderr, "[OPERATIONS] Failed to allocate the keys to be deleted.\n");
+    return 1;
+  }
+  memcpy(sorted, keys, num_pairs * sizeof(*sorted));
+  heap_sort(sorted, NULL, (int)num_pairs);
 
   // Avoid performing while other thread is executing the show command
   pthread_rwlock_rdlock(&PERMISSION_LOCK);
 
   // Write lock the given keys of the hash table
-  write_lock_keys(KVS_TABLE, keys, (int)num_pairs);
+  write_lock_keys(KVS_TABLE, sorted, (int)num_pairs);
 
   // Delete all the given pairs
+  for(size_t i = 0; i < num_pairs; i++)
+    missing[i] = delete_pair(KVS_TABLE, keys[i]) != 0;
+  *position = wal_log_delete(num_pairs, keys, missing);
+
+  // Unlock the keys that were previously locked
+  unlock_keys(KVS_TABLE, sorted, (int)num_pairs);
+
+  pthread_rwlock_unlock(&PERMISSION_LOCK);
+  free(sorted);
+  return 0;
+}
+
+int kvs_commit(uint64_t position){
+  if(wal_commit(position)){
+    fprintf(stderr, "[OPERATIONS] Failed to log the changes.\n");
+    return 1;
+  }
+  return 0;
+}
+
+int kvs_committed(uint64_t position){
+  return wal_committed(position);
+}
+
+int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], OutputFile* out){
+  char* missing = malloc(num_pairs);
+
+  // Sorts the keys, the missing ones are written in this order
+  heap_sort(keys, NULL, (int)num_pairs);
+
+  if(missing == NULL || kvs_delete_keys(num_pairs, keys, missing)){
+    fprintf(stderr, "[OPERATIONS] Failed to delete the keys.\n");
+    free(missing);
+    return 1;
+  }
+
+  int result = kvs_print_delete(num_pairs, keys, missing, out);
+  free(missing);
+  return result;
+}
+
+int kvs_print_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], const char missing[], OutputFile* out){
+  int aux = 0;
+  char aux_string[MAX_WRITE_SIZE];
+
   for(size_t i = 0; i < num_pairs; i++){
-    if(delete_pair(KVS_TABLE, keys[i]) != 0){
-      if(!aux){
-
-        // Writes the first bracket into the file
-        if(write_all(fd, "[", 1) < 0){
-          fprintf(stderr, "[OPERATIONS] Failed to write the initial bracket to the file.\n");
-          unlock_keys(KVS_TABLE, keys, (int)num_pairs);
-          pthread_rwlock_unlock(&PERMISSION_LOCK);
-          return 1;
-        }
-        aux = 1;
-      }
+    if(!missing[i])
+      continue;
 
-      // Obtains the formated string and writes into the file
-      sprintf(aux_string, "(%s,KVSMISSING)", keys[i]);
-      size_t len = strlen(aux_string);
-      if(write_all(fd, aux_string, len) < 0){
-        fprintf(stderr, "[OPERATIONS] Failed to write the key to the file.\n");
-        unlock_keys(KVS_TABLE, keys, (int)num_pairs);
-        pthread_rwlock_unlock(&PERMISSION_LOCK);
+    if(!aux){
+      // Writes the first bracket into the file
+      if(output_write(out, "[", 1)){
+        fprintf(stderr, "[OPERATIONS] Failed to write the initial bracket to the file.\n");
         return 1;
       }
+      aux = 1;
     }
-  }
 
-  // Writes the final bracket
-  if(aux){
-    if(write_all(fd, "]\n", 2)<0){
-      fprintf(stderr,"[OPERATIONS] Failed to write the final bracket to the file.\n");
-      pthread_rwlock_unlock(&PERMISSION_LOCK);
+    // Obtains the formated string and writes into the file
+    sprintf(aux_string, "(%s,KVSMISSING)", keys[i]);
+    size_t len = strlen(aux_string);
+    if(output_write(out, aux_string, len)){
+      fprintf(stderr, "[OPERATIONS] Failed to write the key to the file.\n");
       return 1;
-    } 
+    }
   }
 
-  // Unlock the keys that were previously locked
-  unlock_keys(KVS_TABLE, keys, (int)num_pairs);
+  // Writes the final bracket
+  if(aux && output_write(out, "]\n", 2)){
+    fprintf(stderr,"[OPERATIONS] Failed to write the final bracket to the file.\n");
+    return 1;
+  }
 
-  pthread_rwlock_unlock(&PERMISSION_LOCK);
   return 0;
 }
 
-void kvs_show(int fd){
+void kvs_show(OutputFile* out){
   // Avoid performing while other thread is executing the read/write/delete
   // command to run properly
   pthread_rwlock_wrlock(&PERMISSION_LOCK);
@@ -259,7 +368,7 @@ void kvs_show(int fd){
 
       // Writes into the file
       size_t len = strlen(aux);
-      if(write_all(fd, aux, len)  < 0)
+      if(output_write(out, aux, len))
         fprintf(stderr, "[OPERATIONS] Failed to write a pair to the file.\n");
       keyNode = keyNode->next; // Move to the next node
     }
@@ -268,36 +377,50 @@ void kvs_show(int fd){
   pthread_rwlock_unlock(&PERMISSION_LOCK);
 }
 
-int kvs_backup(char* name){
+Snapshot* kvs_snapshot(int delta, uint64_t since){
+  Snapshot* snapshot = take_snapshot(KVS_TABLE, delta, since);
+  if(snapshot == NULL)
+    fprintf(stderr, "[OPERATIONS] Failed to allocate the backup.\n");
+  return snapshot;
+}
+
+void kvs_release_snapshot(uint64_t epoch){
+  release_base(KVS_TABLE, epoch);
+}
+
+int kvs_backup(const char* name, const char* base, Snapshot* snapshot){
+  // Copy the pairs left, one bucket locked at a time
+  size_t size;
+  char* backup = serialize_snapshot(KVS_TABLE, snapshot, &size);
+  if(backup == NULL){
+    fprintf(stderr, "[OPERATIONS] Failed to copy the pairs to the backup.\n");
+    return 1;
+  }
+
   // Open the backup file
-  int fd_backup = open(name, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR | S_IWUSR);
-  if(fd_backup < 0){
+  OutputFile* file = output_open(name);
+  if(file == NULL){
     fprintf(stderr, "[OPERATIONS] Failed to open the backup file.\n");
+    free(backup);
     return 1;
   }
 
-  // Write on the backup file
-  for (int i = 0; i < TABLE_SIZE; i++) {
-    KeyNode *keyNode = KVS_TABLE->table[i];
-    while (keyNode != NULL) {
-      char aux[MAX_WRITE_SIZE];
+  // A delta starts with the backup it is applied to
+  int result = 0;
+  if(base != NULL){
+    char header[MAX_JOB_FILE_NAME_SIZE + 16];
+    int len = snprintf(header, sizeof(header), "%s%s\n", BACKUP_DELTA_HEADER, base);
+    result = output_write(file, header, (size_t) len);
+  }
 
-      // Obtains the formatted string to write into the file
-      if(sprintf(aux, "(%s, %s)\n", keyNode->key, keyNode->value) < 0){
-        fprintf(stderr,"[OPERATIONS] Failed to convert a pair to a string.\n");
-        return 1;
-      }
-      // Writes into the file
-      size_t len = strlen(aux);
-      if(write_all(fd_backup, aux, len) < 0){
-        fprintf(stderr, "[OPERATIONS] Failed to write a pair to the bcakup.\n");
-        return 1;
-      }
-      keyNode = keyNode->next; // Move to the next node
-    }
+  // Write on the backup file, the copy is written without copying it again
+  if(output_give(file, backup, size))
+    result = 1;
+  if(output_close(file) || result){
+    fprintf(stderr, "[OPERATIONS] Failed to write the pairs to the backup.\n");
+    return 1;
   }
 
-  close(fd_backup);
   return 0;
 }
 
@@ -313,6 +436,7 @@ int kvs_subscribe(int notif_fd, const char key[MAX_STRING_SIZE]){
   
   if(subscribe_pair(KVS_TABLE, key, notif_fd)){
     fprintf(stderr, "[OPERATIONS] Failed to subscribe the key.\n");
+    pthread_rwlock_unlock(&PERMISSION_LOCK);
     return 1;
   }
   
@@ -328,6 +452,7 @@ int kvs_unsubscribe(int notif_fd, const char key[MAX_STRING_SIZE]){
 
   if(unsubscribe_pair(KVS_TABLE, key, notif_fd)){
     fprintf(stderr, "[OPERATIONS] Failed to unsubscribe the key.\n");
+    pthread_rwlock_unlock(&PERMISSION_LOCK);
     return 1;
   }
 
@@ -336,6 +461,58 @@ int kvs_unsubscribe(int notif_fd, const char key[MAX_STRING_SIZE]){
   return 0;
 }
 
+int kvs_subscribe_keys(int notif_fd, char keys[][MAX_STRING_SIZE], size_t num_keys,
+                       int subscribe, char results[]){
+  // Avoid performing while other thread is executing the show command
+  pthread_rwlock_rdlock(&PERMISSION_LOCK);
+
+  int result = subscribe_keys(KVS_TABLE, keys, num_keys, notif_fd, subscribe, results);
+  if(result)
+    fprintf(stderr, "[OPERATIONS] Failed to %s the keys.\n", subscribe ? "subscribe" : "unsubscribe");
+
+  pthread_rwlock_unlock(&PERMISSION_LOCK);
+
+  return result;
+}
+
+int kvs_resume(int notif_fd, char keys[][MAX_STRING_SIZE], size_t num_keys,
+               uint64_t epoch, uint64_t since, char results[], int* truncated){
+  // Avoid performing while other thread is executing the show command
+  pthread_rwlock_rdlock(&PERMISSION_LOCK);
+
+  int result = resume_keys(KVS_TABLE, keys, num_keys, notif_fd, epoch, since, results, truncated);
+  if(result)
+    fprintf(stderr, "[OPERATIONS] Failed to resume the subscriptions.\n");
+
+  pthread_rwlock_unlock(&PERMISSION_LOCK);
+
+  return result;
+}
+
+int kvs_subscribe_pattern(int notif_fd, const char pattern[MAX_STRING_SIZE]){
+  // Avoid performing while other thread is executing the show command
+  pthread_rwlock_rdlock(&PERMISSION_LOCK);
+
+  int result = subscribe_pattern_pair(KVS_TABLE, pattern, notif_fd);
+  if(result)
+    fprintf(stderr, "[OPERATIONS] Failed to subscribe the pattern.\n");
+
+  pthread_rwlock_unlock(&PERMISSION_LOCK);
+
+  return result;
+}
+
+int kvs_unsubscribe_pattern(int notif_fd, const char pattern[MAX_STRING_SIZE]){
+  // Avoid performing while other thread is executing the show command
+  pthread_rwlock_rdlock(&PERMISSION_LOCK);
+
+  int result = unsubscribe_pattern_pair(KVS_TABLE, pattern, notif_fd);
+
+  pthread_rwlock_unlock(&PERMISSION_LOCK);
+
+  return result;
+}
+
 void kvs_clear_subscriptions(){
   // Avoid performing while other thread is executing the show command
   pthread_rwlock_rdlock(&PERMISSION_LOCK);
@@ -14,16 +14,33 @@
 #define KVS_OPERATIONS_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include "../common/subs_lists.h"
+#include "kvs.h"
+#include "output.h"
+#include "pool.h"
 
 /// Initializes the KVS state.
+/// @param pool Pool that sends the notifications of the keys with many
+/// subscribers, NULL to send them in the thread that changed the key.
+/// @param delta_backups 1 if the backups may be deltas, so the deleted
+/// keys are kept until no delta needs them.
 /// @return 0 if the KVS state was initialized successfully, 1 otherwise.
-int kvs_init();
+int kvs_init(Pool* pool, int delta_backups);
 
 /// Destroys the KVS state.
 /// @return 0 if the KVS state was terminated successfully, 1 otherwise.
 int kvs_terminate();
 
+/// Starts notifying and logging the changes of the keys, once the table is
+/// rebuilt from the log of the server, if there is one.
+void kvs_start_notifications();
+
+/// Epoch of the sequences of the changes, which differs from that of any
+/// previous server.
+/// @return The epoch.
+uint64_t kvs_epoch();
+
 /// Writes a key value pair to the KVS. If key already exists it is updated.
 /// @param num_pairs Number of pairs being written.
 /// @param keys Array of keys' strings.
@@ -31,35 +48,107 @@ int kvs_terminate();
 /// @return 0 if the pairs were written successfully, 1 otherwise.
 int kvs_write(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE]);
 
+/// Writes key value pairs to the KVS without waiting for the log.
+/// @param num_pairs Number of pairs being written.
+/// @param keys Array of keys' strings.
+/// @param values Array of values' strings.
+/// @param position Set to the position to give kvs_commit, 0 if not logged.
+/// @return 0 if the pairs were written successfully, 1 otherwise.
+int kvs_write_deferred(size_t num_pairs, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE],
+                       uint64_t* position);
+
 /// Reads values from the KVS.
 /// @param num_pairs Number of pairs to read.
 /// @param keys Array of keys' strings.
-/// @param fd File descriptor to write the (successful) output
+/// @param out File to write the (successful) output.
 /// @return 0 if the key reading, 1 otherwise.
-int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd);
+int kvs_read(size_t num_pairs, char keys[][MAX_STRING_SIZE], OutputFile* out);
+
+/// Reads values from the KVS into memory.
+/// @param num_pairs Number of pairs to read.
+/// @param keys Array of keys' strings.
+/// @param values Array where the value of each key is copied, in the order
+/// of the keys.
+/// @param found Set to 1 for each key that exists, 0 otherwise.
+/// @return 0 if the keys were read, 1 otherwise.
+int kvs_read_values(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                    char values[][MAX_STRING_SIZE], char found[]);
+
+/// Writes the output of a read, given the values read by kvs_read_values.
+/// @param num_pairs Number of pairs read.
+/// @param keys Array of keys' strings, in the order they are written.
+/// @param values Value of each key.
+/// @param found 1 for each key that exists, 0 otherwise.
+/// @param out File to write the output.
+/// @return 0 if the output was written, 1 otherwise.
+int kvs_print_read(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                   char values[][MAX_STRING_SIZE], const char found[], OutputFile* out);
 
 /// Deletes key value pairs from the KVS.
 /// @param num_pairs Number of pairs to read.
 /// @param keys Array of keys' strings.
-/// @param fd File descriptor to write the (successful) output.
+/// @param out File to write the (successful) output.
 /// @return 0 if the pairs were deleted successfully, 1 otherwise.
-int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], int fd);
-
-/// Writes the state of the KVS.
-/// @param fd File descriptor to write the output.
-void kvs_show(int fd);
+int kvs_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], OutputFile* out);
 
-/// Creates a backup of the KVS state and stores it in the correspondent
-/// backup file.
-/// @param name name of the backup. 
-/// @return 0 if the backup was successful, 1 otherwise.
-int kvs_backup(char* name);
+/// Deletes key value pairs from the KVS, telling in memory which were missing.
+/// @param num_pairs Number of pairs to delete.
+/// @param keys Array of keys' strings.
+/// @param missing Set to 1 for each key that did not exist, 0 otherwise.
+/// @return 0 if the keys were deleted, 1 otherwise.
+int kvs_delete_keys(size_t num_pairs, char keys[][MAX_STRING_SIZE], char missing[]);
 
-/// @brief Read locks all the keys of the hash table.
-void kvs_read_lock();
+/// Deletes key value pairs from the KVS without waiting for the log.
+/// @param num_pairs Number of pairs to delete.
+/// @param keys Array of keys' strings.
+/// @param missing Set to 1 for each key that did not exist, 0 otherwise.
+/// @param position Set to the position to give kvs_commit, 0 if not logged.
+/// @return 0 if the keys were deleted, 1 otherwise.
+int kvs_delete_deferred(size_t num_pairs, char keys[][MAX_STRING_SIZE], char missing[], uint64_t* position);
+
+/// Waits until the changes logged up to the given position are committed.
+/// @param position Position given by a deferred write or delete.
+/// @return 0 if the changes are committed, 1 if the log could not be written.
+int kvs_commit(uint64_t position);
+
+/// Tells, without waiting, whether the changes up to the position are committed.
+/// @param position Position given by a deferred write or delete.
+/// @return 1 if committed, 0 if not yet, -1 if the log could not be written.
+int kvs_committed(uint64_t position);
+
+/// Writes the output of a delete, given the keys kvs_delete_keys found missing.
+/// @param num_pairs Number of keys deleted.
+/// @param keys Array of keys' strings, in the order they are written.
+/// @param missing 1 for each key that did not exist, 0 otherwise.
+/// @param out File to write the output.
+/// @return 0 if the output was written, 1 otherwise.
+int kvs_print_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], const char missing[], OutputFile* out);
 
-/// @brief Unlocks all the keys of the hash table.
-void kvs_unlock();
+/// Writes the state of the KVS.
+/// @param out File to write the output.
+void kvs_show(OutputFile* out);
+
+/// Takes a snapshot of the state of the KVS. The keys are only locked
+/// for an instant, the pairs are copied as they were until the snapshot
+/// is written by kvs_backup.
+/// @param delta 1 to keep only the changes made after another snapshot.
+/// @param since Epoch of that snapshot.
+/// @return The snapshot, NULL on failure. Its epoch is the one a later
+/// delta is taken since, until it is released by kvs_release_snapshot.
+Snapshot* kvs_snapshot(int delta, uint64_t since);
+
+/// Tells that no more deltas are taken since a snapshot, so the keys
+/// deleted before it may be forgotten.
+/// @param epoch Epoch of the snapshot.
+void kvs_release_snapshot(uint64_t epoch);
+
+/// Stores a snapshot of the KVS state, taken by kvs_snapshot, in the
+/// correspondent backup file, and releases it.
+/// @param name name of the backup.
+/// @param base Name of the backup a delta is applied to, NULL for a full one.
+/// @param snapshot The snapshot.
+/// @return 0 if the backup was successful, 1 otherwise.
+int kvs_backup(const char* name, const char* base, Snapshot* snapshot);
 
 /// Waits for a given amount of time.
 /// @param delay_us Delay in milliseconds.
@@ -77,6 +166,47 @@ int kvs_subscribe(int notif_fd, const char key[MAX_STRING_SIZE]);
 /// @return 0 if it exists, otherwise.
 int kvs_unsubscribe(int notif_fd, const char key[MAX_STRING_SIZE]);
 
+/// @brief Subscribes or unsubscribes a batch of keys for a given client,
+/// taking each lock of the table once.
+/// @param notif_fd Notifications pipe of the client.
+/// @param keys Keys to be subscribed or unsubscribed.
+/// @param num_keys Number of keys.
+/// @param subscribe 1 to subscribe the keys, 0 to unsubscribe them.
+/// @param results Set to 1 for each key that exists, 0 otherwise.
+/// @return 0 if the keys were processed, 1 otherwise.
+int kvs_subscribe_keys(int notif_fd, char keys[][MAX_STRING_SIZE], size_t num_keys,
+                       int subscribe, char results[]);
+
+/// @brief Subscribes a batch of keys for a client that lost its session,
+/// notifying it again of the changes made to them since the last one it
+/// was notified of.
+/// @param notif_fd Notifications pipe of the client.
+/// @param keys Keys to be subscribed.
+/// @param num_keys Number of keys.
+/// @param epoch Epoch of the server that numbered the sequence.
+/// @param since Sequence of the last notification of the client.
+/// @param results Set to 1 for each key that exists, 0 otherwise.
+/// @param truncated Set to 1 if the changes since the sequence are no
+/// longer kept, or were made by another server, so the client must read
+/// the keys again.
+/// @return 0 if the keys were processed, 1 otherwise.
+int kvs_resume(int notif_fd, char keys[][MAX_STRING_SIZE], size_t num_keys,
+               uint64_t epoch, uint64_t since, char results[], int* truncated);
+
+/// @brief Subscribes a pattern for the given client, which is notified
+/// about every key that matches it.
+/// @param notif_fd Notifications pipe of the client.
+/// @param pattern Pattern, where '*' matches any sequence of characters
+/// and '?' any character.
+/// @return 0 if it was subscribed, 1 otherwise.
+int kvs_subscribe_pattern(int notif_fd, const char pattern[MAX_STRING_SIZE]);
+
+/// @brief Unsubscribes a pattern for the given client.
+/// @param notif_fd Notifications pipe of the client.
+/// @param pattern Pattern that the client wants to unsubscribe.
+/// @return 0 if it was subscribed, 1 otherwise.
+int kvs_unsubscribe_pattern(int notif_fd, const char pattern[MAX_STRING_SIZE]);
+
 /// @brief Unsubscribes all clients from all keys.
 void kvs_clear_subscriptions();
 
@@ -0,0 +1,438 @@
+/**
+ * @file output.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief The files written by the server, the outputs and the backups of
+ * the jobs. What is written to a file is gathered in a buffer and, once
+ * the buffer is full, it is written asynchronously through an io_uring
+ * shared by all the files, so a job thread does not wait for the disk
+ * and a few syscalls write the output of many commands. Where io_uring is
+ * not available the buffers are written by the thread that fills them.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+// For syscall, io_uring has no wrapper in the C library
+#define _GNU_SOURCE
+#include "output.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "constants.h"
+
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+// IORING_OP_WRITE came with the same kernel as IORING_FEAT_RW_CUR_POS
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define OUTPUT_IO_URING
+#endif
+#endif
+#endif
+
+// A block being written to a file
+typedef struct {
+  OutputFile* file;
+  char* data;
+  size_t size, done;
+  off_t offset;
+} WriteRequest;
+
+// Writes the rest of a block in the calling thread
+static int write_request(WriteRequest* request){
+  while(request->done < request->size){
+    ssize_t written = pwrite(request->file->fd, request->data + request->done,
+                             request->size - request->done,
+                             request->offset + (off_t) request->done);
+    if(written < 0 && errno == EINTR)
+      continue;
+    if(written <= 0)
+      return 1;
+    request->done += (size_t) written;
+  }
+  return 0;
+}
+
+// Frees a block once written, and wakes up whoever closes its file
+static void finish_request(WriteRequest* request, int failed){
+  OutputFile* file = request->file;
+  free(request->data);
+  free(request);
+
+  pthread_mutex_lock(&file->lock);
+  if(failed)
+    file->failed = 1;
+  file->pending--;
+  pthread_cond_broadcast(&file->written);
+  pthread_mutex_unlock(&file->lock);
+}
+
+#ifdef OUTPUT_IO_URING
+
+// The io_uring, its submission queue guarded by lock
+static struct {
+  int fd;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe* sqes;
+  struct io_uring_cqe* cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size, sqes_size;
+  unsigned entries;
+  unsigned in_flight;       // Writes submitted and not completed
+  int failed;               // The completions can no longer be waited for
+  int stopping;             // The completer stops once none is in flight
+  pthread_mutex_t lock;
+  pthread_cond_t room;      // A write was completed
+  pthread_t completer;
+} RING;
+
+static int RING_STARTED = 0;
+
+static int ring_enter(unsigned to_submit, unsigned min_complete, unsigned flags){
+  return (int) syscall(__NR_io_uring_enter, RING.fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+// Submits the rest of a block, with RING.lock held and a write counted
+// in RING.in_flight. A NULL request stops the completer.
+static int push_request(WriteRequest* request){
+  unsigned tail = *RING.sq_tail;
+  unsigned index = tail & *RING.sq_mask;
+  struct io_uring_sqe* sqe = &RING.sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  if(request == NULL){
+    sqe->opcode = IORING_OP_NOP;
+  }else{
+    // A longer block is written by more than one write
+    size_t left = request->size - request->done;
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = request->file->fd;
+    sqe->addr = (uint64_t) (uintptr_t) (request->data + request->done);
+    sqe->len = left > (1u << 30) ? 1u << 30 : (unsigned) left;
+    sqe->off = (uint64_t) request->offset + request->done;
+  }
+  sqe->user_data = (uint64_t) (uintptr_t) request;
+  RING.sq_array[index] = index;
+  __atomic_store_n(RING.sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  int result;
+  while((result = ring_enter(1, 0, 0)) < 0 && (errno == EINTR || errno == EAGAIN))
+    ;
+  if(result < 0){
+    // Taken back, the kernel only reads the queue inside io_uring_enter
+    __atomic_store_n(RING.sq_tail, tail, __ATOMIC_RELEASE);
+    return 1;
+  }
+  return 0;
+}
+
+// Fails once the ring can not be waited on, and the block is written by
+// the caller. The stop is then only recorded.
+static int submit_request(WriteRequest* request){
+  pthread_mutex_lock(&RING.lock);
+  if(RING.failed){
+    RING.stopping |= request == NULL;
+    pthread_mutex_unlock(&RING.lock);
+    return request != NULL;
+  }
+  while(RING.in_flight == RING.entries)
+    pthread_cond_wait(&RING.room, &RING.lock);
+  RING.in_flight++;
+  int result = push_request(request);
+  if(result)
+    RING.in_flight--;
+  pthread_mutex_unlock(&RING.lock);
+  return result;
+}
+
+// Handles the completion of a write, the rest of the block is submitted
+// again in the place of the write completed
+static void complete_request(WriteRequest* request, int result){
+  int failed = 0;
+  if(result > 0)
+    request->done += (size_t) result;
+  else if(result != -EINTR && result != -EAGAIN)
+    failed = 1;
+
+  if(!failed && request->done < request->size){
+    pthread_mutex_lock(&RING.lock);
+    int pushed = push_request(request) == 0;
+    pthread_mutex_unlock(&RING.lock);
+    if(pushed)
+      return;
+    failed = write_request(request);
+  }
+
+  pthread_mutex_lock(&RING.lock);
+  RING.in_flight--;
+  pthread_cond_signal(&RING.room);
+  pthread_mutex_unlock(&RING.lock);
+  finish_request(request, failed);
+}
+
+static void* complete_writes(void* arg){
+  (void) arg;
+
+  // Signals are handled by the host thread
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+  // Once waiting fails, the writes already submitted are still completed
+  // by the kernel, so the completions are polled until none is in flight
+  struct timespec poll_delay = {0, OUTPUT_POLL_MS * 1000000L};
+  int stop = 0, failed = 0;
+  while(!stop){
+    if(failed){
+      nanosleep(&poll_delay, NULL);
+    }else if(ring_enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR){
+      fprintf(stderr, "[OUTPUT] Failed to wait for the writes, the files are written by the job threads.\n");
+      pthread_mutex_lock(&RING.lock);
+      RING.failed = failed = 1;
+      pthread_mutex_unlock(&RING.lock);
+    }
+
+    unsigned head = *RING.cq_head;
+    unsigned tail = __atomic_load_n(RING.cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; head++){
+      struct io_uring_cqe* cqe = &RING.cqes[head & *RING.cq_mask];
+      WriteRequest* request = (WriteRequest*) (uintptr_t) cqe->user_data;
+      int result = cqe->res;
+
+      // Released before the write is handled, which may submit again
+      __atomic_store_n(RING.cq_head, head + 1, __ATOMIC_RELEASE);
+      if(request == NULL)
+        stop = 1;
+      else
+        complete_request(request, result);
+    }
+
+    if(failed){
+      pthread_mutex_lock(&RING.lock);
+      stop |= RING.stopping && RING.in_flight == 0;
+      pthread_mutex_unlock(&RING.lock);
+    }
+  }
+  return NULL;
+}
+
+static void unmap_ring(){
+  if(RING.sqes != NULL)
+    munmap(RING.sqes, RING.sqes_size);
+  if(RING.cq_ring != NULL && RING.cq_ring != RING.sq_ring)
+    munmap(RING.cq_ring, RING.cq_ring_size);
+  if(RING.sq_ring != NULL)
+    munmap(RING.sq_ring, RING.sq_ring_size);
+  close(RING.fd);
+}
+
+int outputs_init(){
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  memset(&RING, 0, sizeof(RING));
+  RING.fd = (int) syscall(__NR_io_uring_setup, OUTPUT_QUEUE_DEPTH, &params);
+  if(RING.fd < 0)
+    return 1;
+
+  // The queues and the submissions are shared with the kernel
+  RING.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  RING.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if(params.features & IORING_FEAT_SINGLE_MMAP){
+    if(RING.cq_ring_size > RING.sq_ring_size)
+      RING.sq_ring_size = RING.cq_ring_size;
+    RING.cq_ring_size = RING.sq_ring_size;
+  }
+  RING.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+  void* sq_ring = mmap(NULL, RING.sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, RING.fd, IORING_OFF_SQ_RING);
+  RING.sq_ring = sq_ring == MAP_FAILED ? NULL : sq_ring;
+  void* cq_ring = sq_ring;
+  if(!(params.features & IORING_FEAT_SINGLE_MMAP) && RING.sq_ring != NULL)
+    cq_ring = mmap(NULL, RING.cq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, RING.fd, IORING_OFF_CQ_RING);
+  RING.cq_ring = cq_ring == MAP_FAILED ? NULL : cq_ring;
+  void* sqes = RING.cq_ring == NULL ? MAP_FAILED
+               : mmap(NULL, RING.sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, RING.fd, IORING_OFF_SQES);
+  RING.sqes = sqes == MAP_FAILED ? NULL : sqes;
+  if(RING.sqes == NULL){
+    unmap_ring();
+    return 1;
+  }
+
+  char* sq = RING.sq_ring;
+  char* cq = RING.cq_ring;
+  RING.sq_tail = (unsigned*) (void*) (sq + params.sq_off.tail);
+  RING.sq_mask = (unsigned*) (void*) (sq + params.sq_off.ring_mask);
+  RING.sq_array = (unsigned*) (void*) (sq + params.sq_off.array);
+  RING.cq_head = (unsigned*) (void*) (cq + params.cq_off.head);
+  RING.cq_tail = (unsigned*) (void*) (cq + params.cq_off.tail);
+  RING.cq_mask = (unsigned*) (void*) (cq + params.cq_off.ring_mask);
+  RING.cqes = (struct io_uring_cqe*) (void*) (cq + params.cq_off.cqes);
+  RING.entries = params.sq_entries;
+
+  pthread_mutex_init(&RING.lock, NULL);
+  pthread_cond_init(&RING.room, NULL);
+  if(pthread_create(&RING.completer, NULL, complete_writes, NULL) != 0){
+    fprintf(stderr, "[OUTPUT] Failed to create the completion thread.\n");
+    pthread_mutex_destroy(&RING.lock);
+    pthread_cond_destroy(&RING.room);
+    unmap_ring();
+    return 1;
+  }
+  RING_STARTED = 1;
+  return 0;
+}
+
+void outputs_terminate(){
+  if(!RING_STARTED)
+    return;
+
+  // The completer stops once the writes before the stop are completed
+  if(submit_request(NULL)){
+    fprintf(stderr, "[OUTPUT] Failed to stop the completion thread.\n");
+    return;
+  }
+  pthread_join(RING.completer, NULL);
+  pthread_mutex_destroy(&RING.lock);
+  pthread_cond_destroy(&RING.room);
+  unmap_ring();
+  RING_STARTED = 0;
+}
+
+#else
+
+static int RING_STARTED = 0;
+
+static int submit_request(WriteRequest* request){
+  (void) request;
+  return 1;
+}
+
+int outputs_init(){
+  return 1;
+}
+
+void outputs_terminate(){
+}
+
+#endif
+
+// Writes a block at the given offset, through the ring if it was started
+static int write_block(OutputFile* out, char* data, size_t size, off_t offset){
+  // A write of nothing completes with 0 bytes, which is taken as a failure
+  if(size == 0){
+    free(data);
+    return 0;
+  }
+
+  WriteRequest* request = malloc(sizeof(WriteRequest));
+  if(request == NULL){
+    free(data);
+    return 1;
+  }
+  request->file = out;
+  request->data = data;
+  request->size = size;
+  request->done = 0;
+  request->offset = offset;
+
+  pthread_mutex_lock(&out->lock);
+  out->pending++;
+  pthread_mutex_unlock(&out->lock);
+
+  if(RING_STARTED && submit_request(request) == 0)
+    return 0;
+  int failed = write_request(request);
+  finish_request(request, failed);
+  return failed;
+}
+
+OutputFile* output_open(const char* path){
+  OutputFile* out = calloc(1, sizeof(OutputFile));
+  if(out == NULL)
+    return NULL;
+  out->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR);
+  if(out->fd < 0){
+    free(out);
+    return NULL;
+  }
+  pthread_mutex_init(&out->lock, NULL);
+  pthread_cond_init(&out->written, NULL);
+  return out;
+}
+
+int output_write(OutputFile* out, const void* data, size_t size){
+  const char* bytes = data;
+  while(size > 0){
+    if(out->buffer == NULL && (out->buffer = malloc(OUTPUT_BUFFER_SIZE)) == NULL)
+      return 1;
+
+    size_t n = OUTPUT_BUFFER_SIZE - out->used;
+    if(n > size)
+      n = size;
+    memcpy(out->buffer + out->used, bytes, n);
+    out->used += n;
+    bytes += n;
+    size -= n;
+
+    if(out->used == OUTPUT_BUFFER_SIZE && output_flush(out))
+      return 1;
+  }
+  return 0;
+}
+
+int output_give(OutputFile* out, char* data, size_t size){
+  if(output_flush(out)){
+    free(data);
+    return 1;
+  }
+  off_t offset = out->offset;
+  out->offset += (off_t) size;
+  return write_block(out, data, size, offset);
+}
+
+int output_flush(OutputFile* out){
+  if(out->used == 0)
+    return 0;
+
+  // The buffer is handed to the write, the next one is allocated later
+  char* buffer = out->buffer;
+  size_t size = out->used;
+  off_t offset = out->offset;
+  out->buffer = NULL;
+  out->used = 0;
+  out->offset += (off_t) size;
+  return write_block(out, buffer, size, offset);
+}
+
+int output_close(OutputFile* out){
+  int failed = output_flush(out);
+  free(out->buffer);
+
+  pthread_mutex_lock(&out->lock);
+  while(out->pending > 0)
+    pthread_cond_wait(&out->written, &out->lock);
+  failed |= out->failed;
+  pthread_mutex_unlock(&out->lock);
+
+  failed |= close(out->fd) != 0;
+  pthread_mutex_destroy(&out->lock);
+  pthread_cond_destroy(&out->written);
+  free(out);
+  return failed;
+}
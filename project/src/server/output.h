@@ -0,0 +1,95 @@
+/**
+ * @file output.h
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief The files written by the server, the outputs and the backups of
+ * the jobs. What is written to a file is gathered in a buffer and, once
+ * the buffer is full, it is written asynchronously through an io_uring
+ * shared by all the files, so a job thread does not wait for the disk
+ * and a few syscalls write the output of many commands. Where io_uring is
+ * not available the buffers are written by the thread that fills them.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef KVS_OUTPUT_H
+#define KVS_OUTPUT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+// A file being written, by one thread at a time
+typedef struct {
+  int fd;
+  off_t offset;             // Where the buffer is written once full
+  char* buffer;
+  size_t used;
+  size_t pending;           // Buffers being written, guarded by lock
+  int failed;               // A buffer could not be written, guarded by lock
+  pthread_mutex_t lock;
+  pthread_cond_t written;
+} OutputFile;
+
+/**
+ * @brief Starts writing the files through io_uring.
+ *
+ * @return 0 if io_uring is used, 1 if the files are written by the
+ * threads that write them.
+ */
+int outputs_init();
+
+/**
+ * @brief Opens a file to be written, truncating it.
+ *
+ * @param path Path of the file.
+ * @return The file, NULL on failure.
+ */
+OutputFile* output_open(const char* path);
+
+/**
+ * @brief Writes to a file, through its buffer.
+ *
+ * @param out The file.
+ * @param data Bytes to be written.
+ * @param size Number of bytes.
+ * @return 0 if the bytes were buffered or written, 1 otherwise.
+ */
+int output_write(OutputFile* out, const void* data, size_t size);
+
+/**
+ * @brief Writes an allocated block to a file without copying it, after
+ * what was written before.
+ *
+ * @param out The file.
+ * @param data Block to be written, freed once written.
+ * @param size Size of the block.
+ * @return 0 if the block is being written, 1 otherwise.
+ */
+int output_give(OutputFile* out, char* data, size_t size);
+
+/**
+ * @brief Starts writing the buffer of a file, without waiting for it.
+ *
+ * @param out The file.
+ * @return 0 if the buffer is being written, 1 otherwise.
+ */
+int output_flush(OutputFile* out);
+
+/**
+ * @brief Writes the buffer of a file, waits until everything is written
+ * and closes it.
+ *
+ * @param out The file.
+ * @return 0 if everything was written, 1 otherwise.
+ */
+int output_close(OutputFile* out);
+
+/**
+ * @brief Stops io_uring, once all the files were closed.
+ */
+void outputs_terminate();
+
+#endif  // KVS_OUTPUT_H
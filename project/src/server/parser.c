@@ -1,68 +1,271 @@
 #include "parser.h"
+#include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include "constants.h"
 
-static int read_string(int fd, char *buffer, size_t max) {
-  ssize_t bytes_read;
-  char ch;
-  size_t i = 0;
-  int value = -1;
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+JobFile *job_open(const char *path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
 
-  while (i < max) {
-    bytes_read = read(fd, &ch, 1);
+  struct stat st;
+  JobFile *job = calloc(1, sizeof(JobFile));
+  if (job == NULL || fstat(fd, &st) != 0) {
+    free(job);
+    close(fd);
+    return NULL;
+  }
+
+  job->size = (size_t)st.st_size;
+  if (job->size > 0) {
+    void *data = mmap(NULL, job->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      posix_madvise(data, job->size, POSIX_MADV_SEQUENTIAL);
+      job->data = data;
+      job->mapped = 1;
+    } else {
+      // Files that cannot be mapped are read at once into a buffer
+      char *buffer = malloc(job->size);
+      size_t done = 0;
+      ssize_t bytes_read = 1;
+      while (buffer != NULL && done < job->size &&
+             (bytes_read = read(fd, buffer + done, job->size - done)) > 0) {
+        done += (size_t)bytes_read;
+      }
 
-    if (bytes_read <= 0) {
-        return -1;
+      if (buffer == NULL || bytes_read < 0) {
+        free(buffer);
+        free(job);
+        close(fd);
+        return NULL;
+      }
+      job->data = buffer;
+      job->size = done;
     }
+  }
 
-    if (ch == ' ') {
-      return -1;
+  // Compiled files are read from their first record
+  if (job->size >= JOB_MAGIC_SIZE && memcmp(job->data, JOB_MAGIC, JOB_MAGIC_SIZE) == 0) {
+    job->compiled = 1;
+    job->pos = JOB_MAGIC_SIZE;
+  }
+
+  // The mapping stays valid after the file is closed
+  close(fd);
+  return job;
+}
+
+void job_close(JobFile *job) {
+  if (job == NULL) {
+    return;
+  }
+
+  if (job->mapped) {
+    munmap((void *)job->data, job->size);
+  } else {
+    free((void *)job->data);
+  }
+  free(job);
+}
+
+// Copies up to n bytes from the current position, as a read() would
+static size_t read_bytes(JobFile *job, char *buf, size_t n) {
+  size_t left = job->size - job->pos;
+  if (n > left) {
+    n = left;
+  }
+
+  memcpy(buf, job->data + job->pos, n);
+  job->pos += n;
+  return n;
+}
+
+static int read_char(JobFile *job, char *ch) {
+  if (job->pos == job->size) {
+    return 0;
+  }
+
+  *ch = job->data[job->pos++];
+  return 1;
+}
+
+// Stops reading a compiled file that is not well formed
+static size_t corrupted(JobFile *job) {
+  job->pos = job->size;
+  job->pending = 0;
+  return 0;
+}
+
+static int read_compiled_uint(JobFile *job, uint32_t *value) {
+  return read_bytes(job, (char *)value, sizeof(uint32_t)) == sizeof(uint32_t) ? 0 : 1;
+}
+
+// Copies a string of a compiled file, which must fit in max bytes
+static int read_compiled_string(JobFile *job, char *buffer, size_t max) {
+  char len;
+  if (read_char(job, &len) != 1 || (size_t)(unsigned char)len >= max ||
+      job->size - job->pos < (size_t)(unsigned char)len) {
+    return 1;
+  }
+
+  size_t size = (size_t)(unsigned char)len;
+  memcpy(buffer, job->data + job->pos, size);
+  buffer[size] = '\0';
+  job->pos += size;
+  return 0;
+}
+
+// Reads the keys (and the values, if not NULL) of a compiled command
+static size_t parse_compiled_keys(JobFile *job, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_keys, size_t max_string_size) {
+  size_t num_keys = job->pending;
+  if (num_keys == 0) {
+    uint32_t count;
+    if (read_compiled_uint(job, &count) != 0 || count == 0) {
+      return corrupted(job);
     }
+    num_keys = count;
+  }
+
+  // The keys that do not fit are left for the next call
+  if (num_keys > max_keys) {
+    job->pending = num_keys - max_keys;
+    num_keys = max_keys;
+  } else {
+    job->pending = 0;
+  }
 
-    if (ch == ',') {
+  for (size_t i = 0; i < num_keys; i++) {
+    if (read_compiled_string(job, keys[i], max_string_size) != 0 ||
+        (values != NULL && read_compiled_string(job, values[i], max_string_size) != 0)) {
+      return corrupted(job);
+    }
+  }
+
+  return num_keys;
+}
+
+static int is_delimiter(char ch) {
+  return ch == ' ' || ch == ',' || ch == ')' || ch == ']';
+}
+
+// Finds the first delimiter of a string within the next limit bytes of the
+// file, comparing many bytes at once when the CPU supports it. The vector
+// loads may go past the limit, but never past the end of the file.
+// Returns its offset, or limit if there is none.
+static size_t find_delimiter(const JobFile *job, size_t limit) {
+  const char *start = job->data + job->pos;
+  size_t left = job->size - job->pos;
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  const __m256i space = _mm256_set1_epi8(' '), comma = _mm256_set1_epi8(',');
+  const __m256i paren = _mm256_set1_epi8(')'), bracket = _mm256_set1_epi8(']');
+  for (; i < limit && left - i >= 32; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(start + i));
+    __m256i hits = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, comma)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, paren), _mm256_cmpeq_epi8(chunk, bracket)));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(hits);
+    if (mask != 0) {
+      i += (size_t)__builtin_ctz(mask);
+      return i < limit ? i : limit;
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i space = _mm_set1_epi8(' '), comma = _mm_set1_epi8(',');
+  const __m128i paren = _mm_set1_epi8(')'), bracket = _mm_set1_epi8(']');
+  for (; i < limit && left - i >= 16; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(start + i));
+    __m128i hits = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, comma)),
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, paren), _mm_cmpeq_epi8(chunk, bracket)));
+    unsigned int mask = (unsigned int)_mm_movemask_epi8(hits);
+    if (mask != 0) {
+      i += (size_t)__builtin_ctz(mask);
+      return i < limit ? i : limit;
+    }
+  }
+#endif
+
+  // The bytes the vectors did not cover are checked one at a time
+  for (; i < limit && i < left; i++) {
+    if (is_delimiter(start[i])) {
+      return i;
+    }
+  }
+  return limit;
+}
+
+static int read_string(JobFile *job, char *buffer, size_t max) {
+  const char *start = job->data + job->pos;
+  size_t left = job->size - job->pos;
+  size_t limit = left < max ? left : max;
+
+  // The string is the slice of the file up to its delimiter
+  size_t i = find_delimiter(job, limit);
+
+  if (i == limit) {
+    job->pos += limit;
+    return -1;
+  }
+  job->pos += i + 1;
+
+  int value;
+  switch (start[i]) {
+    case ',':
       value = 0;
       break;
-    }
-    else if (ch == ')') {
+    case ')':
       value = 1;
       break;
-    }
-    else if (ch == ']') {
+    case ']':
       value = 2;
       break;
-    }
-
-    buffer[i++] = ch;
+    default:
+      return -1;
   }
 
+  memcpy(buffer, start, i);
   buffer[i] = '\0';
 
   return value;
 }
 
-static int read_uint(int fd, unsigned int *value, char *next) {
+static int read_uint(JobFile *job, unsigned int *value, char *next) {
   char buf[16];
+  const char *start = job->data + job->pos;
+  size_t left = job->size - job->pos;
 
-  int i = 0;
-  while (1) {
-    if (read(fd, buf + i, 1) == 0) {
-      *next = '\0';
-      break;
-    }
-
-    *next = buf[i];
+  size_t i = 0;
+  while (i < left && start[i] >= '0' && start[i] <= '9') {
+    i++;
+  }
+  job->pos += i;
 
-    if (buf[i] > '9' || buf[i] < '0') {
-      buf[i] = '\0';
-      break;
-    }
+  if (read_char(job, next) == 0) {
+    *next = '\0';
+  }
 
-    i++;
+  if (i >= sizeof(buf)) {
+    return 1;
   }
 
+  memcpy(buf, start, i);
+  buf[i] = '\0';
+
   unsigned long ul = strtoul(buf, NULL, 10);
 
   if (ul > UINT_MAX) {
@@ -74,23 +277,30 @@ static int read_uint(int fd, unsigned int *value, char *next) {
   return 0;
 }
 
-static void cleanup(int fd) {
-  char ch;
-  while (read(fd, &ch, 1) == 1 && ch != '\n')
-    ;
+static void cleanup(JobFile *job) {
+  const char *end = memchr(job->data + job->pos, '\n', job->size - job->pos);
+  job->pos = end != NULL ? (size_t)(end - job->data) + 1 : job->size;
 }
 
-enum Command get_next(int fd) {
+enum Command get_next(JobFile *job) {
   char buf[16];
-  if (read(fd, buf, 1) != 1) {
+  if (read_bytes(job, buf, 1) != 1) {
     return EOC;
   }
 
+  if (job->compiled) {
+    if ((unsigned char)buf[0] >= EOC) {
+      corrupted(job);
+      return CMD_INVALID;
+    }
+    return (enum Command)buf[0];
+  }
+
   switch (buf[0]) {
     case 'W':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
-        if (read(fd, buf + 5, 1) != 1 || strncmp(buf, "WRITE ", 6) != 0) {
-          cleanup(fd);
+      if (read_bytes(job, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
+        if (read_bytes(job, buf + 5, 1) != 1 || strncmp(buf, "WRITE ", 6) != 0) {
+          cleanup(job);
           return CMD_INVALID;
         }
         return CMD_WRITE;
@@ -99,188 +309,206 @@ enum Command get_next(int fd) {
       return CMD_WAIT;
 
     case 'R':
-      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "READ ", 5) != 0) {
-        cleanup(fd);
+      if (read_bytes(job, buf + 1, 4) != 4 || strncmp(buf, "READ ", 5) != 0) {
+        cleanup(job);
         return CMD_INVALID;
       }
 
       return CMD_READ;
 
     case 'D':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "DELETE ", 7) != 0) {
-        cleanup(fd);
+      if (read_bytes(job, buf + 1, 6) != 6 || strncmp(buf, "DELETE ", 7) != 0) {
+        cleanup(job);
         return CMD_INVALID;
       }
 
       return CMD_DELETE;
 
     case 'S':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "SHOW", 4) != 0) {
-        cleanup(fd);
+      if (read_bytes(job, buf + 1, 3) != 3 || strncmp(buf, "SHOW", 4) != 0) {
+        cleanup(job);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
+      if (read_bytes(job, buf + 4, 1) != 0 && buf[4] != '\n') {
+        cleanup(job);
         return CMD_INVALID;
       }
 
       return CMD_SHOW;
 
     case 'B':
-      if (read(fd, buf + 1, 5) != 5 || strncmp(buf, "BACKUP", 6) != 0) {
-        cleanup(fd);
+      if (read_bytes(job, buf + 1, 5) != 5 || strncmp(buf, "BACKUP", 6) != 0) {
+        cleanup(job);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 6, 1) != 0 && buf[6] != '\n') {
-        cleanup(fd);
+      if (read_bytes(job, buf + 6, 1) != 0 && buf[6] != '\n') {
+        cleanup(job);
         return CMD_INVALID;
       }
 
       return CMD_BACKUP;
 
     case 'H':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
-        cleanup(fd);
+      if (read_bytes(job, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
+        cleanup(job);
         return CMD_INVALID;
       }
 
-      if (read(fd, buf + 4, 1) != 0 && buf[4] != '\n') {
-        cleanup(fd);
+      if (read_bytes(job, buf + 4, 1) != 0 && buf[4] != '\n') {
+        cleanup(job);
         return CMD_INVALID;
       }
 
       return CMD_HELP;
 
     case '#':
-      cleanup(fd);
+      cleanup(job);
       return CMD_EMPTY;
 
     case '\n':
       return CMD_EMPTY;
 
     default:
-      cleanup(fd);
+      cleanup(job);
       return CMD_INVALID;
   }
 }
 
-int parse_pair(int fd, char *key, char *value) {
-  if (read_string(fd, key, MAX_STRING_SIZE) != 0) {
-    cleanup(fd);
+int parse_pair(JobFile *job, char *key, char *value) {
+  if (read_string(job, key, MAX_STRING_SIZE) != 0) {
+    cleanup(job);
     return 0;
   }
 
-  if (read_string(fd, value, MAX_STRING_SIZE) != 1) {
-    cleanup(fd);
+  if (read_string(job, value, MAX_STRING_SIZE) != 1) {
+    cleanup(job);
     return 0;
   }
 
   return 1;
 }
 
-size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs, size_t max_string_size) {
+size_t parse_write(JobFile *job, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs, size_t max_string_size) {
   char ch;
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
-    return 0;
+  if (job->compiled) {
+    return parse_compiled_keys(job, keys, values, max_pairs, max_string_size);
   }
 
-  if (read(fd, &ch, 1) != 1 || ch != '(') {
-    cleanup(fd);
-    return 0;
+  // A command that goes on is parsed from its next pair
+  if (!job->pending) {
+    if (read_char(job, &ch) != 1 || ch != '[') {
+      cleanup(job);
+      return 0;
+    }
+
+    if (read_char(job, &ch) != 1 || ch != '(') {
+      cleanup(job);
+      return 0;
+    }
   }
+  job->pending = 0;
 
   size_t num_pairs = 0;
-  char key[max_string_size];
-  char value[max_string_size];
-  while (num_pairs < max_pairs) {
-    if(parse_pair(fd, key, value) == 0) {
-      cleanup(fd);
+  while (1) {
+    if(parse_pair(job, keys[num_pairs], values[num_pairs]) == 0) {
+      cleanup(job);
       return 0;
     }
+    num_pairs++;
 
-    strcpy(keys[num_pairs], key);
-    strcpy(values[num_pairs++], value);
-
-    if (read(fd, &ch, 1) != 1 || (ch != '(' && ch != ']')) {
-      cleanup(fd);
+    if (read_char(job, &ch) != 1 || (ch != '(' && ch != ']')) {
+      cleanup(job);
       return 0;
     }
 
     if (ch == ']') {
       break;
     }
-  }
 
-  if (num_pairs == max_pairs) {
-    cleanup(fd);
-    return 0;
+    if (num_pairs == max_pairs) {
+      job->pending = 1;
+      return num_pairs;
+    }
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_char(job, &ch) != 1 || (ch != '\n' && ch != '\0')) {
+    cleanup(job);
     return 0;
   }
 
   return num_pairs;
 }
 
-size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys, size_t max_string_size) {
+size_t parse_read_delete(JobFile *job, char keys[][MAX_STRING_SIZE], size_t max_keys, size_t max_string_size) {
   char ch;
 
-  if (read(fd, &ch, 1) != 1 || ch != '[') {
-    cleanup(fd);
+  if (job->compiled) {
+    return parse_compiled_keys(job, keys, NULL, max_keys, max_string_size);
+  }
+
+  // A command that goes on is parsed from its next key
+  if (!job->pending && (read_char(job, &ch) != 1 || ch != '[')) {
+    cleanup(job);
     return 0;
   }
+  job->pending = 0;
 
   size_t num_keys = 0;
-  char key[max_string_size];
-  while (num_keys < max_keys) {
-    int output = read_string(fd, key, max_string_size);
+  while (1) {
+    int output = read_string(job, keys[num_keys], max_string_size);
     if(output < 0 || output == 1) {
-      cleanup(fd);
+      cleanup(job);
       return 0;
     }
-
-    strcpy(keys[num_keys++], key);
+    num_keys++;
 
     if (output == 2){
       break;
     }
-  }
 
-  if (num_keys == max_keys) {
-    cleanup(fd);
-    return 0;
+    if (num_keys == max_keys) {
+      job->pending = 1;
+      return num_keys;
+    }
   }
 
-  if (read(fd, &ch, 1) != 1 || (ch != '\n' && ch != '\0')) {
-    cleanup(fd);
+  if (read_char(job, &ch) != 1 || (ch != '\n' && ch != '\0')) {
+    cleanup(job);
     return 0;
   }
 
   return num_keys;
 }
 
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
+int parse_wait(JobFile *job, unsigned int *delay, unsigned int *thread_id) {
   char ch;
 
-  if (read_uint(fd, delay, &ch) != 0) {
-    cleanup(fd);
+  if (job->compiled) {
+    uint32_t value;
+    if (read_compiled_uint(job, &value) != 0) {
+      corrupted(job);
+      return -1;
+    }
+    *delay = value;
+    return 0;
+  }
+
+  if (read_uint(job, delay, &ch) != 0) {
+    cleanup(job);
     return -1;
   }
 
   if (ch == ' ') {
     if (thread_id == NULL) {
-      cleanup(fd);
+      cleanup(job);
       return 0;
     }
 
-    if (read_uint(fd, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
-      cleanup(fd);
+    if (read_uint(job, thread_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+      cleanup(job);
       return -1;
     }
 
@@ -288,7 +516,7 @@ int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   } else if (ch == '\n' || ch == '\0') {
     return 0;
   } else {
-    cleanup(fd);
+    cleanup(job);
     return -1;
   }
 }
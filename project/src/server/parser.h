@@ -4,6 +4,35 @@
 #include <stddef.h>
 #include "constants.h"
 
+/// Job files compiled by kvs-jobc start with this, followed by one record per
+/// command: the command (one byte) and, for WRITE, READ and DELETE, the number
+/// of keys (uint32_t) followed by each key (and its value, for WRITE) as its
+/// length (one byte) and its characters, or, for WAIT, the delay (uint32_t).
+/// The commands that could not be parsed are kept as CMD_INVALID.
+#define JOB_MAGIC "\177KVSJOB1"
+#define JOB_MAGIC_SIZE 8
+
+/// A job file mapped in memory (or, if it cannot be mapped, read into a
+/// buffer), which the parser reads from its current position.
+typedef struct {
+  const char *data;
+  size_t size;
+  size_t pos;
+  int mapped;    // Whether data is mapped, or a buffer to be freed
+  int compiled;  // Whether the file was compiled by kvs-jobc
+  size_t pending;  // Whether the command being parsed has more keys than
+                   // the last call returned (how many, if compiled)
+} JobFile;
+
+/// Opens a job file.
+/// @param path Path of the file.
+/// @return The job file, NULL on failure.
+JobFile *job_open(const char *path);
+
+/// Closes a job file.
+/// @param job The job file.
+void job_close(JobFile *job);
+
 enum Command {
   CMD_WRITE,
   CMD_READ,
@@ -18,32 +47,34 @@ enum Command {
 };
 
 /// Reads a line and returns the corresponding command.
-/// @param fd File descriptor to read from.
+/// @param job Job file to read from.
 /// @return The command read.
-enum Command get_next(int fd);
+enum Command get_next(JobFile *job);
 
-/// Parses a WRITE command.
-/// @param fd File descriptor to read from.
+/// Parses a WRITE command. If it has more than max_pairs pairs, the first
+/// max_pairs are returned and job->pending is set, and each following call
+/// returns the next ones, until the last call leaves job->pending unset.
+/// @param job Job file to read from.
 /// @param keys Array of keys to be written.
 /// @param values Array of values to be written.
 /// @param max_pairs number of pairs to be written.
 /// @param max_string_size maximum size for keys and values.
-/// @return 0 if the command was parsed successfully, 1 otherwise.
-size_t parse_write(int fd, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs, size_t max_string_size);
+/// @return Number of pairs parsed. 0 on failure.
+size_t parse_write(JobFile *job, char keys[][MAX_STRING_SIZE], char values[][MAX_STRING_SIZE], size_t max_pairs, size_t max_string_size);
 
-/// Parses a READ or DELETE command.
-/// @param fd File descriptor to read from.
+/// Parses a READ or DELETE command, max_keys keys at a time as parse_write.
+/// @param job Job file to read from.
 /// @param keys Array of keys to be written.
 /// @param max_keys number of keys to be iread or deleted.
 /// @param max_string_size maximum size for keys and values.
 /// @return Number of keys read or deleted. 0 on failure.
-size_t parse_read_delete(int fd, char keys[][MAX_STRING_SIZE], size_t max_keys, size_t max_string_size);
+size_t parse_read_delete(JobFile *job, char keys[][MAX_STRING_SIZE], size_t max_keys, size_t max_string_size);
 
 /// Parses a WAIT command.
-/// @param fd File descriptor to read from.
+/// @param job Job file to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
 /// @param thread_id Pointer to the variable to store the thread ID in. May not be set.
 /// @return 0 if no thread was specified, 1 if a thread was specified, -1 on error.
-int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id);
+int parse_wait(JobFile *job, unsigned int *delay, unsigned int *thread_id);
 
 #endif  // KVS_PARSER_H
@@ -0,0 +1,252 @@
+/**
+ * @file patterns.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief The trie of the patterns subscribed by the clients. A key is
+ * matched by walking down the trie along it, where the node of a star may
+ * also stay where it is for any number of characters. The pairs of a star
+ * node and a position of the key already walked are remembered, so the
+ * stars do not walk the same part of the trie twice for the same position.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include "patterns.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Pairs remembered without allocating, which is enough for most keys
+#define VISITED_INITIAL_SIZE 64
+
+// A star node and a position of the key it was walked from
+typedef struct {
+    const PatternNode* node;
+    size_t offset;
+} Visit;
+
+typedef struct {
+    Visit* slots;       // Open addressing, the empty slots have no node
+    size_t len, cap;    // The capacity is a power of two
+    int allocated;
+} VisitedSet;
+
+PatternNode* create_pattern_trie(){
+    return calloc(1, sizeof(PatternNode));
+}
+
+static PatternNode* find_child(const PatternNode* node, char label){
+    PatternNode* child = node->children;
+    while(child != NULL && child->label != label)
+        child = child->next;
+    return child;
+}
+
+// Unlinks and frees the child if it holds no subscription
+static void prune_child(PatternNode* node, PatternNode* child){
+    if(child->fd != NULL || child->children != NULL)
+        return;
+
+    PatternNode** link = &node->children;
+    while(*link != child)
+        link = &(*link)->next;
+    *link = child->next;
+    free(child);
+}
+
+int subscribe_pattern(PatternNode* root, const char* pattern, int notif_fd){
+    PatternNode* node = root;
+    for(const char* c = pattern; *c != '\0'; c++){
+        unsigned char index = (unsigned char) *c;
+        if(index >= PATTERN_ALPHABET)
+            return 1;
+
+        // Consecutive stars match the same as a single one
+        if(index == '*' && c[1] == '*')
+            continue;
+
+        PatternNode* child = find_child(node, *c);
+        if(child == NULL){
+            if((child = calloc(1, sizeof(PatternNode))) == NULL)
+                return 1;
+            child->label = *c;
+            child->next = node->children;
+            node->children = child;
+        }
+        node = child;
+    }
+
+    // The pattern is only subscribed once by each client
+    for(KeyInt* aux = node->fd; aux != NULL; aux = aux->next)
+        if(aux->fd == notif_fd)
+            return 0;
+    node->fd = insert_KeyInt_List(node->fd, notif_fd);
+    return 0;
+}
+
+// Removes the subscription from the node of the rest of the pattern, freeing
+// the nodes left empty. Returns 0 if the subscription existed, 1 otherwise.
+static int unsubscribe_from(PatternNode* node, const char* pattern, int notif_fd){
+    if(*pattern == '\0'){
+        KeyInt* aux = node->fd;
+        while(aux != NULL && aux->fd != notif_fd)
+            aux = aux->next;
+        if(aux == NULL)
+            return 1;
+        node->fd = delete_KeyInt_List(node->fd, notif_fd);
+        return 0;
+    }
+
+    if(*pattern == '*' && pattern[1] == '*')
+        return unsubscribe_from(node, pattern + 1, notif_fd);
+    PatternNode* child = find_child(node, *pattern);
+    if(child == NULL)
+        return 1;
+
+    int result = unsubscribe_from(child, pattern + 1, notif_fd);
+    prune_child(node, child);
+    return result;
+}
+
+int unsubscribe_pattern(PatternNode* root, const char* pattern, int notif_fd){
+    return unsubscribe_from(root, pattern, notif_fd);
+}
+
+void clear_pattern_subscriptions(PatternNode* root, int notif_fd){
+    if(notif_fd < 0){
+        delete_All_Int(root->fd);
+        root->fd = NULL;
+    }else{
+        root->fd = delete_KeyInt_List(root->fd, notif_fd);
+    }
+
+    PatternNode* child = root->children;
+    while(child != NULL){
+        PatternNode* next = child->next;
+        clear_pattern_subscriptions(child, notif_fd);
+        prune_child(root, child);
+        child = next;
+    }
+}
+
+static size_t visit_slot(size_t cap, const PatternNode* node, size_t offset){
+    uint64_t hash = ((uint64_t) (uintptr_t) node ^ offset) * 11400714819323198485ULL;
+    return (size_t) (hash >> 32) & (cap - 1);
+}
+
+static void visit_insert(Visit* slots, size_t cap, const PatternNode* node, size_t offset){
+    size_t slot = visit_slot(cap, node, offset);
+    while(slots[slot].node != NULL)
+        slot = (slot + 1) & (cap - 1);
+    slots[slot].node = node;
+    slots[slot].offset = offset;
+}
+
+// Remembers that the star node was walked from the position of the key.
+// Returns 1 if it already was, 0 otherwise.
+static int visit(VisitedSet* visited, const PatternNode* node, size_t offset){
+    for(size_t slot = visit_slot(visited->cap, node, offset); visited->slots[slot].node != NULL;
+        slot = (slot + 1) & (visited->cap - 1))
+        if(visited->slots[slot].node == node && visited->slots[slot].offset == offset)
+            return 1;
+
+    if(2*(visited->len + 1) > visited->cap){
+        // Without room the pair is walked again, which is slower but still right
+        Visit* slots = calloc(2*visited->cap, sizeof(Visit));
+        if(slots == NULL)
+            return 0;
+        for(size_t i = 0; i < visited->cap; i++)
+            if(visited->slots[i].node != NULL)
+                visit_insert(slots, 2*visited->cap, visited->slots[i].node, visited->slots[i].offset);
+        if(visited->allocated)
+            free(visited->slots);
+        visited->slots = slots;
+        visited->cap *= 2;
+        visited->allocated = 1;
+    }
+
+    visit_insert(visited->slots, visited->cap, node, offset);
+    visited->len++;
+    return 0;
+}
+
+// Matches the key, from the given position, with the patterns that go on
+// from the node
+static void match_from(const PatternNode* node, const char* key, size_t offset,
+                       MatchedFds* matched, VisitedSet* visited){
+    // The star matches from the empty sequence on
+    const PatternNode* star = find_child(node, '*');
+    if(star != NULL && !visit(visited, star, offset))
+        match_from(star, key, offset, matched, visited);
+
+    char c = key[offset];
+    if(c == '\0'){
+        for(KeyInt* aux = node->fd; aux != NULL; aux = aux->next)
+            add_matched_fd(matched, aux->fd);
+        return;
+    }
+
+    // A star goes on matching one more character
+    if(node->label == '*' && !visit(visited, node, offset + 1))
+        match_from(node, key, offset + 1, matched, visited);
+
+    for(const PatternNode* child = node->children; child != NULL; child = child->next)
+        if(child->label == '?' || (child->label == c && c != '*'))
+            match_from(child, key, offset + 1, matched, visited);
+}
+
+void match_patterns(PatternNode* root, const char* key, MatchedFds* matched){
+    if(root == NULL)
+        return;
+
+    Visit slots[VISITED_INITIAL_SIZE] = {{NULL, 0}};
+    VisitedSet visited = {slots, 0, VISITED_INITIAL_SIZE, 0};
+    match_from(root, key, 0, matched, &visited);
+    if(visited.allocated)
+        free(visited.slots);
+}
+
+int add_matched_fd(MatchedFds* matched, int fd){
+    if(matched->len == matched->cap){
+        size_t cap = matched->cap ? 2*matched->cap : 8;
+        int* fds = realloc(matched->fds, cap * sizeof(int));
+        if(fds == NULL)
+            return 1;
+        matched->fds = fds;
+        matched->cap = cap;
+    }
+    matched->fds[matched->len++] = fd;
+    return 0;
+}
+
+static int compare_fds(const void* a, const void* b){
+    int fd_a = *(const int*) a, fd_b = *(const int*) b;
+    return (fd_a > fd_b) - (fd_a < fd_b);
+}
+
+void unique_matched_fds(MatchedFds* matched){
+    if(matched->len < 2)
+        return;
+
+    qsort(matched->fds, matched->len, sizeof(int), compare_fds);
+    size_t len = 1;
+    for(size_t i = 1; i < matched->len; i++)
+        if(matched->fds[i] != matched->fds[len - 1])
+            matched->fds[len++] = matched->fds[i];
+    matched->len = len;
+}
+
+void free_pattern_trie(PatternNode* root){
+    if(root == NULL)
+        return;
+    PatternNode* child = root->children;
+    while(child != NULL){
+        PatternNode* next = child->next;
+        free_pattern_trie(child);
+        child = next;
+    }
+    delete_All_Int(root->fd);
+    free(root);
+}
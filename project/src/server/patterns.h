@@ -0,0 +1,109 @@
+/**
+ * @file patterns.h
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A trie of the patterns subscribed by the clients, which may
+ * contain '*' (any sequence of characters) and '?' (any character).
+ * Matching a key only visits the nodes of the patterns whose beginning
+ * matches a part of the key, and each one at most once for each position
+ * of the key.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef KVS_PATTERNS_H
+#define KVS_PATTERNS_H
+
+#include <stddef.h>
+#include "../common/subs_lists.h"
+
+// The patterns are made of ASCII characters
+#define PATTERN_ALPHABET 128
+
+// The children of a node are a list, since most nodes have one or two
+typedef struct PatternNode {
+    char label;                     // Character of the pattern that leads here
+    struct PatternNode* children;   // First child
+    struct PatternNode* next;       // Next child of the same parent
+    struct KeyInt* fd;  // Clients subscribed to the pattern that ends here
+} PatternNode;
+
+// File descriptors of the clients to be notified about a key
+typedef struct {
+    int* fds;
+    size_t len, cap;
+} MatchedFds;
+
+/**
+ * @brief Creates an empty trie of patterns.
+ *
+ * @return The root of the trie, NULL on failure.
+ */
+PatternNode* create_pattern_trie();
+
+/**
+ * @brief Subscribes a pattern for the given file descriptor.
+ *
+ * @param root Root of the trie.
+ * @param pattern The pattern.
+ * @param notif_fd File descriptor.
+ * @return 0 if the pattern was subscribed, 1 if it is not valid or
+ * could not be stored.
+ */
+int subscribe_pattern(PatternNode* root, const char* pattern, int notif_fd);
+
+/**
+ * @brief Unsubscribes a pattern for the given file descriptor.
+ *
+ * @param root Root of the trie.
+ * @param pattern The pattern.
+ * @param notif_fd File descriptor.
+ * @return 0 if the pattern was subscribed by the file descriptor, 1 otherwise.
+ */
+int unsubscribe_pattern(PatternNode* root, const char* pattern, int notif_fd);
+
+/**
+ * @brief Unsubscribes all the patterns of a file descriptor or, if it is
+ * negative, of every file descriptor.
+ *
+ * @param root Root of the trie.
+ * @param notif_fd File descriptor.
+ */
+void clear_pattern_subscriptions(PatternNode* root, int notif_fd);
+
+/**
+ * @brief Adds to the given array the file descriptors subscribed to the
+ * patterns that match the key.
+ *
+ * @param root Root of the trie.
+ * @param key The key.
+ * @param matched Array where the file descriptors are added.
+ */
+void match_patterns(PatternNode* root, const char* key, MatchedFds* matched);
+
+/**
+ * @brief Adds a file descriptor to the given array.
+ *
+ * @param matched The array.
+ * @param fd File descriptor.
+ * @return 0 if the file descriptor was added, 1 otherwise.
+ */
+int add_matched_fd(MatchedFds* matched, int fd);
+
+/**
+ * @brief Sorts the given array, leaving each file descriptor only once.
+ *
+ * @param matched The array.
+ */
+void unique_matched_fds(MatchedFds* matched);
+
+/**
+ * @brief Frees the trie.
+ *
+ * @param root Root of the trie.
+ */
+void free_pattern_trie(PatternNode* root);
+
+#endif  // KVS_PATTERNS_H
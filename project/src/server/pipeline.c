@@ -0,0 +1,402 @@
+/**
+ * @file pipeline.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief Parses a job ahead of its execution: a task of the pool decodes
+ * the commands of the job into a bounded ring while the job thread
+ * executes them, so the parsing of the next commands overlaps the
+ * execution of the current one. The task ends once the ring is full and
+ * is submitted again when a command is released, so a job that is not
+ * being executed holds no thread.
+ *
+ * The WRITE, READ and DELETE commands in the ring that share no key (or
+ * only read the keys they share) run at the same time on a pool, each one
+ * after the earlier commands it conflicts with. Their results are handed
+ * to the job thread in the order of the job, so the output is the same as
+ * if they ran one at a time. SHOW, BACKUP and WAIT run alone, after every
+ * command before them.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include "pipeline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "heap.h"
+#include "kvs.h"
+#include "operations.h"
+
+// The commands waited for are kept in the bits of a uint64_t
+_Static_assert(PARSE_AHEAD_SIZE <= 64, "PARSE_AHEAD_SIZE must fit in a uint64_t");
+
+// Keys skipped at a time, once the batch of a command can not grow
+#define SKIP_CHUNK_SIZE 16
+
+// On failure the capacity is kept, and so is every array at least as large
+static int grow_batch(Batch* batch, size_t capacity){
+    if(capacity < 2 * batch->capacity)
+        capacity = 2 * batch->capacity;
+
+    char (*keys)[MAX_STRING_SIZE] = realloc(batch->keys, capacity * sizeof(*keys));
+    if(keys == NULL)
+        return 1;
+    batch->keys = keys;
+
+    char (*values)[MAX_STRING_SIZE] = realloc(batch->values, capacity * sizeof(*values));
+    if(values == NULL)
+        return 1;
+    batch->values = values;
+
+    char* found = realloc(batch->found, capacity);
+    if(found == NULL)
+        return 1;
+    batch->found = found;
+
+    uint64_t* hashes = realloc(batch->hashes, capacity * sizeof(*hashes));
+    if(hashes == NULL)
+        return 1;
+    batch->hashes = hashes;
+
+    batch->capacity = capacity;
+    return 0;
+}
+
+// Parses the rest of a command into a chunk of its own, to skip it
+static void skip_batch(JobFile* job, enum Command command){
+    char keys[SKIP_CHUNK_SIZE][MAX_STRING_SIZE];
+    char values[SKIP_CHUNK_SIZE][MAX_STRING_SIZE];
+    size_t parsed;
+
+    do{
+        if(command == CMD_WRITE)
+            parsed = parse_write(job, keys, values, SKIP_CHUNK_SIZE, MAX_STRING_SIZE);
+        else
+            parsed = parse_read_delete(job, keys, SKIP_CHUNK_SIZE, MAX_STRING_SIZE);
+    }while(parsed != 0 && job->pending);
+}
+
+// Parses all the pairs (or keys) of a WRITE, READ or DELETE into the batch,
+// returns their number, 0 if the command is not valid
+static size_t parse_batch(JobFile* job, enum Command command, Batch* batch){
+    size_t num_pairs = 0, parsed;
+
+    do{
+        if(num_pairs + MAX_WRITE_SIZE > batch->capacity
+           && grow_batch(batch, num_pairs + MAX_WRITE_SIZE)){
+            fprintf(stderr, "[PIPELINE] Failed to allocate the keys of the command.\n");
+            skip_batch(job, command);
+            return 0;
+        }
+
+        if(command == CMD_WRITE)
+            parsed = parse_write(job, batch->keys + num_pairs, batch->values + num_pairs,
+                                 MAX_WRITE_SIZE, MAX_STRING_SIZE);
+        else
+            parsed = parse_read_delete(job, batch->keys + num_pairs, MAX_WRITE_SIZE, MAX_STRING_SIZE);
+        num_pairs += parsed;
+    }while(parsed != 0 && job->pending);
+
+    return parsed == 0 ? 0 : num_pairs;
+}
+
+static uint64_t hash_key(const char* key){
+    uint64_t hash = 14695981039346656037ULL;
+    for(; *key != '\0'; key++){
+        hash ^= (unsigned char) *key;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int compare_hashes(const void* a, const void* b){
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+// The keys are compared through their hashes, a collision only makes two
+// commands that could run at the same time run one after the other
+static void hash_keys(ParsedCommand* parsed){
+    parsed->batch.buckets = 0;
+    for(size_t i = 0; i < parsed->num_pairs; i++){
+        parsed->batch.hashes[i] = hash_key(parsed->batch.keys[i]);
+        int index = hash(parsed->batch.keys[i]);
+        parsed->batch.buckets |= index < 0 ? UINT64_MAX : UINT64_C(1) << (index % 64);
+    }
+    qsort(parsed->batch.hashes, parsed->num_pairs, sizeof(uint64_t), compare_hashes);
+}
+
+static void parse_command(JobPipeline* pipeline, ParsedCommand* parsed){
+    switch(parsed->command){
+        case CMD_WRITE:
+        case CMD_READ:
+        case CMD_DELETE:
+            parsed->num_pairs = parse_batch(pipeline->job, parsed->command, &parsed->batch);
+            if(parsed->num_pairs == 0)
+                parsed->command = CMD_INVALID;
+            else
+                hash_keys(parsed);
+            break;
+
+        case CMD_WAIT:
+            if(parse_wait(pipeline->job, &parsed->delay, NULL) == -1)
+                parsed->command = CMD_INVALID;
+            break;
+
+        case CMD_SHOW:
+        case CMD_BACKUP:
+        case CMD_HELP:
+        case CMD_EMPTY:
+        case CMD_INVALID:
+        case EOC:
+            break;
+    }
+}
+
+// Parses commands until the ring is full or the job ends
+static void parse_ahead(void* arg){
+    JobPipeline* pipeline = (JobPipeline*) arg;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while(!pipeline->parsed_all && pipeline->count < PARSE_AHEAD_SIZE){
+        // The free command stays free while it is parsed, since the
+        // released commands are the first ones
+        ParsedCommand* parsed = &pipeline->commands[(pipeline->first + pipeline->count)
+                                                    % PARSE_AHEAD_SIZE];
+        pthread_mutex_unlock(&pipeline->lock);
+
+        // The command is parsed without the lock, while others are executed
+        enum Command command = get_next(pipeline->job);
+        if(command != CMD_EMPTY){
+            parsed->command = command;
+            parse_command(pipeline, parsed);
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+        if(command != CMD_EMPTY){
+            pipeline->count++;
+            pipeline->parsed_all = command == EOC;
+            pthread_cond_signal(&pipeline->changed);
+        }
+    }
+    pipeline->parsing = 0;
+    pthread_cond_signal(&pipeline->changed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+// Submits the parser if the ring has room for more commands, with the lock
+// held. If it can not be submitted, the job thread parses when it needs to.
+static void resume_parser(JobPipeline* pipeline){
+    if(pipeline->parsing || pipeline->parsed_all || pipeline->count == PARSE_AHEAD_SIZE
+       || pipeline->pool == NULL)
+        return;
+
+    pipeline->parsing = 1;
+    if(pool_submit(pipeline->pool, POOL_BATCH, parse_ahead, pipeline))
+        pipeline->parsing = 0;
+}
+
+static int uses_keys(enum Command command){
+    return command == CMD_WRITE || command == CMD_READ || command == CMD_DELETE;
+}
+
+static int is_barrier(enum Command command){
+    return command == CMD_SHOW || command == CMD_BACKUP || command == CMD_WAIT || command == EOC;
+}
+
+// Two commands conflict if they share a key and one of them changes it.
+// Two WRITEs also conflict if they fall in the same entry of the table,
+// where the order they add their keys is the order SHOW writes them.
+static int conflict(const ParsedCommand* a, const ParsedCommand* b){
+    if(a->command == CMD_READ && b->command == CMD_READ)
+        return 0;
+    if(a->command == CMD_WRITE && b->command == CMD_WRITE)
+        return (a->batch.buckets & b->batch.buckets) != 0;
+
+    size_t i = 0, j = 0;
+    while(i < a->num_pairs && j < b->num_pairs){
+        if(a->batch.hashes[i] == b->batch.hashes[j])
+            return 1;
+        if(a->batch.hashes[i] < b->batch.hashes[j])
+            i++;
+        else
+            j++;
+    }
+    return 0;
+}
+
+static ParsedCommand* command_at(JobPipeline* pipeline, size_t index){
+    return &pipeline->commands[(pipeline->first + index) % PARSE_AHEAD_SIZE];
+}
+
+static uint64_t command_bit(JobPipeline* pipeline, ParsedCommand* parsed){
+    return UINT64_C(1) << (parsed - pipeline->commands);
+}
+
+static void execute_command(void* arg);
+
+// Hands the command to the pool once it waits for no other, with the lock
+// held. If it can not be handed, it is left to the job thread.
+static void start_command(JobPipeline* pipeline, ParsedCommand* parsed){
+    if(parsed->state != COMMAND_PARSED || parsed->blockers != 0 || pipeline->pool == NULL)
+        return;
+
+    parsed->state = COMMAND_RUNNING;
+    if(pool_submit(pipeline->pool, POOL_BATCH, execute_command, parsed))
+        parsed->state = COMMAND_PARSED;
+}
+
+// Marks the command as done and starts the ones that waited for it, with
+// the lock held
+static void finish_command(JobPipeline* pipeline, ParsedCommand* parsed){
+    uint64_t bit = command_bit(pipeline, parsed);
+    parsed->state = COMMAND_DONE;
+
+    for(size_t i = 0; i < pipeline->admitted; i++){
+        ParsedCommand* other = command_at(pipeline, i);
+        if(other->blockers & bit){
+            other->blockers &= ~bit;
+            start_command(pipeline, other);
+        }
+    }
+    pthread_cond_signal(&pipeline->changed);
+}
+
+// Does the operation of a WRITE, READ or DELETE, whose keys are sorted as
+// kvs_write, kvs_read and kvs_delete sort them
+static void execute_command(void* arg){
+    ParsedCommand* parsed = (ParsedCommand*) arg;
+    JobPipeline* pipeline = parsed->pipeline;
+    Batch* batch = &parsed->batch;
+
+    if(parsed->command == CMD_WRITE){
+        parsed->result = kvs_write(parsed->num_pairs, batch->keys, batch->values);
+    }else if(parsed->command == CMD_READ){
+        heap_sort(batch->keys, NULL, (int) parsed->num_pairs);
+        parsed->result = kvs_read_values(parsed->num_pairs, batch->keys, batch->values, batch->found);
+    }else{
+        heap_sort(batch->keys, NULL, (int) parsed->num_pairs);
+        parsed->result = kvs_delete_keys(parsed->num_pairs, batch->keys, batch->found);
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    finish_command(pipeline, parsed);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+// Finds the conflicts of the commands parsed since the last call and
+// starts the ones that wait for no other, with the lock held. A barrier
+// is only admitted once it is the first command, and stops the ones after it.
+static void admit_commands(JobPipeline* pipeline){
+    while(pipeline->admitted < pipeline->count){
+        ParsedCommand* parsed = command_at(pipeline, pipeline->admitted);
+        if(pipeline->admitted > 0 && (is_barrier(parsed->command)
+                                      || is_barrier(command_at(pipeline, 0)->command)))
+            return;
+
+        parsed->blockers = 0;
+        parsed->result = 0;
+        if(uses_keys(parsed->command)){
+            parsed->state = COMMAND_PARSED;
+            for(size_t i = 0; i < pipeline->admitted; i++){
+                ParsedCommand* earlier = command_at(pipeline, i);
+                if(earlier->state != COMMAND_DONE && uses_keys(earlier->command)
+                   && conflict(earlier, parsed))
+                    parsed->blockers |= command_bit(pipeline, earlier);
+            }
+        }else{
+            // Nothing to be done before the job thread takes it
+            parsed->state = COMMAND_DONE;
+        }
+
+        pipeline->admitted++;
+        start_command(pipeline, parsed);
+    }
+}
+
+static void free_batches(JobPipeline* pipeline){
+    for(int i = 0; i < PARSE_AHEAD_SIZE; i++){
+        free(pipeline->commands[i].batch.keys);
+        free(pipeline->commands[i].batch.values);
+        free(pipeline->commands[i].batch.found);
+        free(pipeline->commands[i].batch.hashes);
+    }
+}
+
+int pipeline_start(JobPipeline* pipeline, JobFile* job, Pool* pool){
+    *pipeline = (JobPipeline) {0};
+    pipeline->job = job;
+    pipeline->pool = pool;
+
+    // The batches only grow once a command needs them
+    for(int i = 0; i < PARSE_AHEAD_SIZE; i++)
+        pipeline->commands[i].pipeline = pipeline;
+
+    if(pthread_mutex_init(&pipeline->lock, NULL) != 0)
+        return 1;
+    if(pthread_cond_init(&pipeline->changed, NULL) != 0){
+        pthread_mutex_destroy(&pipeline->lock);
+        return 1;
+    }
+
+    pthread_mutex_lock(&pipeline->lock);
+    resume_parser(pipeline);
+    pthread_mutex_unlock(&pipeline->lock);
+    return 0;
+}
+
+ParsedCommand* pipeline_next(JobPipeline* pipeline){
+    ParsedCommand* parsed;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while(1){
+        // Not parsed by the pool, so it is parsed here
+        if(pipeline->count == 0 && !pipeline->parsing){
+            pipeline->parsing = 1;
+            pthread_mutex_unlock(&pipeline->lock);
+            parse_ahead(pipeline);
+            pthread_mutex_lock(&pipeline->lock);
+        }
+
+        admit_commands(pipeline);
+        if(pipeline->count > 0){
+            parsed = command_at(pipeline, 0);
+            if(parsed->state == COMMAND_DONE)
+                break;
+
+            // Not taken by the pool, so it runs here
+            if(parsed->state == COMMAND_PARSED){
+                parsed->state = COMMAND_RUNNING;
+                pthread_mutex_unlock(&pipeline->lock);
+                execute_command(parsed);
+                pthread_mutex_lock(&pipeline->lock);
+                continue;
+            }
+        }
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return parsed;
+}
+
+void pipeline_release(JobPipeline* pipeline){
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->first = (pipeline->first + 1) % PARSE_AHEAD_SIZE;
+    pipeline->count--;
+    pipeline->admitted--;
+    resume_parser(pipeline);
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+void pipeline_finish(JobPipeline* pipeline){
+    // The parser may still be ending after it parsed EOC
+    pthread_mutex_lock(&pipeline->lock);
+    while(pipeline->parsing)
+        pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->changed);
+    free_batches(pipeline);
+}
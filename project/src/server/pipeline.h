@@ -0,0 +1,116 @@
+/**
+ * @file pipeline.h
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief Parses a job ahead of its execution: a task of the pool decodes
+ * the commands of the job into a bounded ring while the job thread
+ * executes them, so the parsing of the next commands overlaps the
+ * execution of the current one. The task ends once the ring is full and
+ * is submitted again when a command is released, so a job that is not
+ * being executed holds no thread.
+ *
+ * The WRITE, READ and DELETE commands in the ring that share no key (or
+ * only read the keys they share) run at the same time on a pool, each one
+ * after the earlier commands it conflicts with. Their results are handed
+ * to the job thread in the order of the job, so the output is the same as
+ * if they ran one at a time. SHOW, BACKUP and WAIT run alone, after every
+ * command before them.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef KVS_PIPELINE_H
+#define KVS_PIPELINE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "constants.h"
+#include "parser.h"
+#include "pool.h"
+
+// Keys and values of a command, which grow to fit the largest command,
+// parsed MAX_WRITE_SIZE pairs at a time
+typedef struct {
+    char (*keys)[MAX_STRING_SIZE];
+    char (*values)[MAX_STRING_SIZE];    // Values written, or read by a READ
+    char* found;            // Keys found by a READ, or missing in a DELETE
+    uint64_t* hashes;       // Hashes of the keys, sorted
+    uint64_t buckets;       // Entries of the table the keys fall in, one bit each
+    size_t capacity;
+} Batch;
+
+enum CommandState {
+    COMMAND_PARSED,         // Waits for the commands it conflicts with
+    COMMAND_RUNNING,
+    COMMAND_DONE            // Its results can be written by the job thread
+};
+
+struct JobPipeline;
+
+// A decoded command, CMD_INVALID if it could not be parsed
+typedef struct {
+    enum Command command;
+    size_t num_pairs;       // Pairs (or keys) of a WRITE, READ or DELETE
+    unsigned int delay;     // Delay of a WAIT
+    Batch batch;
+    enum CommandState state;
+    int result;             // 0 if the operation of the command succeeded
+    uint64_t blockers;      // Commands of the ring it waits for, one bit each
+    struct JobPipeline* pipeline;
+} ParsedCommand;
+
+typedef struct JobPipeline {
+    JobFile* job;
+    Pool* pool;
+    ParsedCommand commands[PARSE_AHEAD_SIZE];
+    size_t first;           // Next command to be returned
+    size_t count;           // Commands parsed and not yet returned
+    size_t admitted;        // Commands whose conflicts are known, from the first
+    int parsing;            // The parser is submitted or running
+    int parsed_all;         // EOC was parsed
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} JobPipeline;
+
+/**
+ * @brief Starts parsing a job.
+ *
+ * @param pipeline The pipeline.
+ * @param job The job file.
+ * @param pool Pool where the commands are parsed and run, NULL to parse
+ * and run them one at a time in the job thread.
+ * @return 0 if the pipeline was started, 1 otherwise.
+ */
+int pipeline_start(JobPipeline* pipeline, JobFile* job, Pool* pool);
+
+/**
+ * @brief Waits for the next command of the job, which is kept until
+ * pipeline_release is called. The operation of a WRITE, READ or DELETE
+ * was already done, its result is in the command and the output of a
+ * READ or DELETE is left to the job thread. The other commands are left
+ * to the job thread. The last command is EOC.
+ *
+ * @param pipeline The pipeline.
+ * @return The command.
+ */
+ParsedCommand* pipeline_next(JobPipeline* pipeline);
+
+/**
+ * @brief Releases the command returned by pipeline_next, after it was
+ * handled, so the parser can reuse it.
+ *
+ * @param pipeline The pipeline.
+ */
+void pipeline_release(JobPipeline* pipeline);
+
+/**
+ * @brief Waits for the parser, after EOC was returned, and frees the pipeline.
+ *
+ * @param pipeline The pipeline.
+ */
+void pipeline_finish(JobPipeline* pipeline);
+
+#endif  // KVS_PIPELINE_H
@@ -0,0 +1,206 @@
+/**
+ * @file pool.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A pool of worker threads, each one with its own deque of tasks.
+ * A worker runs the tasks of its deque, the newest first, and when it has
+ * none it steals the oldest task of another worker, so the work spreads
+ * over the workers without a queue shared by all of them.
+ *
+ * The tasks have a priority: a worker takes any interactive task, its own
+ * or stolen, before a batch one, so the notifications sent to the clients
+ * are not queued behind the commands of the jobs.
+ *
+ * The pool runs the parsing and the commands of the jobs, the writing of
+ * the backups and the fan-out of the notifications, and nothing more. A
+ * task must not block waiting for another one, so the threads that wait
+ * stay out of it: the job threads, which wait for the results of their
+ * commands in order and for a backup to be allowed, and the event loops of
+ * the sessions, which wait in epoll.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include "pool.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Pool and deque of the worker running in this thread, if any
+static _Thread_local Pool* CURRENT_POOL = NULL;
+static _Thread_local size_t CURRENT_WORKER = 0;
+
+typedef struct {
+    Pool* pool;
+    size_t index;
+} WorkerInfo;
+
+static int push_task(TaskDeque* deque, Task task){
+    pthread_mutex_lock(&deque->lock);
+    if(deque->count == deque->capacity){
+        size_t capacity = deque->capacity ? 2 * deque->capacity : 64;
+        Task* tasks = malloc(capacity * sizeof(Task));
+        if(tasks == NULL){
+            pthread_mutex_unlock(&deque->lock);
+            return 1;
+        }
+        for(size_t i = 0; i < deque->count; i++)
+            tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->head = 0;
+        deque->capacity = capacity;
+    }
+    deque->tasks[(deque->head + deque->count++) % deque->capacity] = task;
+    pthread_mutex_unlock(&deque->lock);
+    return 0;
+}
+
+// Takes the newest task of the deque (its owner) or the oldest (a thief)
+static int take_task(TaskDeque* deque, int newest, Task* task){
+    pthread_mutex_lock(&deque->lock);
+    if(deque->count == 0){
+        pthread_mutex_unlock(&deque->lock);
+        return 1;
+    }
+    if(newest){
+        *task = deque->tasks[(deque->head + deque->count - 1) % deque->capacity];
+    }else{
+        *task = deque->tasks[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+    }
+    deque->count--;
+    pthread_mutex_unlock(&deque->lock);
+    return 0;
+}
+
+static TaskDeque* deque_of(Pool* pool, size_t worker, int priority){
+    return &pool->deques[worker * POOL_PRIORITIES + (size_t) priority];
+}
+
+static int find_task(Pool* pool, size_t index, Task* task){
+    for(int priority = 0; priority < POOL_PRIORITIES; priority++){
+        if(take_task(deque_of(pool, index, priority), 1, task) == 0)
+            return 0;
+        for(size_t i = 1; i < pool->num_workers; i++)
+            if(take_task(deque_of(pool, (index + i) % pool->num_workers, priority), 0, task) == 0)
+                return 0;
+    }
+    return 1;
+}
+
+static void* work(void* arg){
+    WorkerInfo* info = (WorkerInfo*) arg;
+    Pool* pool = info->pool;
+    size_t index = info->index;
+    free(info);
+
+    // Signals are handled by the host thread
+    sigset_t sigset;
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGUSR1);
+    sigaddset(&sigset, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+    CURRENT_POOL = pool;
+    CURRENT_WORKER = index;
+
+    while(1){
+        Task task;
+        if(find_task(pool, index, &task) == 0){
+            atomic_fetch_sub(&pool->queued, 1);
+            task.run(task.arg);
+            continue;
+        }
+
+        // Sleeps until a task is submitted, the pool only stops once empty
+        pthread_mutex_lock(&pool->lock);
+        while(atomic_load(&pool->queued) == 0 && !pool->stopping)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        int stop = atomic_load(&pool->queued) == 0 && pool->stopping;
+        pthread_mutex_unlock(&pool->lock);
+        if(stop)
+            break;
+    }
+
+    return NULL;
+}
+
+Pool* pool_create(size_t num_workers){
+    if(num_workers == 0)
+        return NULL;
+
+    Pool* pool = calloc(1, sizeof(Pool));
+    if(pool == NULL)
+        return NULL;
+    pool->deques = calloc(num_workers * POOL_PRIORITIES, sizeof(TaskDeque));
+    pool->workers = calloc(num_workers, sizeof(pthread_t));
+    if(pool->deques == NULL || pool->workers == NULL){
+        free(pool->deques);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+
+    atomic_init(&pool->next_deque, 0);
+    atomic_init(&pool->queued, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    for(size_t i = 0; i < num_workers * POOL_PRIORITIES; i++)
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+
+    for(size_t i = 0; i < num_workers; i++){
+        WorkerInfo* info = malloc(sizeof(WorkerInfo));
+        if(info == NULL){
+            pool_destroy(pool);
+            return NULL;
+        }
+        info->pool = pool;
+        info->index = i;
+        if(pthread_create(&pool->workers[i], NULL, work, info) != 0){
+            fprintf(stderr, "[POOL] Failed to create a worker.\n");
+            free(info);
+            pool_destroy(pool);
+            return NULL;
+        }
+        pool->num_workers++;
+    }
+    return pool;
+}
+
+int pool_submit(Pool* pool, enum TaskPriority priority, void (*run)(void* arg), void* arg){
+    size_t index = CURRENT_POOL == pool ? CURRENT_WORKER
+                   : atomic_fetch_add(&pool->next_deque, 1) % pool->num_workers;
+    if(push_task(deque_of(pool, index, priority), (Task) {run, arg}))
+        return 1;
+
+    // Counted before waking a worker, so the wake up is not lost
+    atomic_fetch_add(&pool->queued, 1);
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+void pool_destroy(Pool* pool){
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(size_t i = 0; i < pool->num_workers; i++)
+        pthread_join(pool->workers[i], NULL);
+
+    size_t num_deques = pool->num_workers * POOL_PRIORITIES;
+    for(size_t i = 0; i < num_deques; i++){
+        free(pool->deques[i].tasks);
+        pthread_mutex_destroy(&pool->deques[i].lock);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->work);
+    free(pool->deques);
+    free(pool->workers);
+    free(pool);
+}
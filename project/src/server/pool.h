@@ -0,0 +1,91 @@
+/**
+ * @file pool.h
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A pool of worker threads, each one with its own deque of tasks.
+ * A worker runs the tasks of its deque, the newest first, and when it has
+ * none it steals the oldest task of another worker, so the work spreads
+ * over the workers without a queue shared by all of them.
+ *
+ * The tasks have a priority: a worker takes any interactive task, its own
+ * or stolen, before a batch one, so the notifications sent to the clients
+ * are not queued behind the commands of the jobs.
+ *
+ * The pool runs the parsing and the commands of the jobs, the writing of
+ * the backups, the fan-out of the notifications and the commits to the log
+ * of the writes of the clients, and nothing more. A
+ * task must not block waiting for another one, so the threads that wait
+ * stay out of it: the job threads, which wait for the results of their
+ * commands in order and for a backup to be allowed, and the event loops of
+ * the sessions, which wait in epoll.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef KVS_POOL_H
+#define KVS_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+enum TaskPriority {
+    POOL_INTERACTIVE,       // Fan-out of the notifications and commits of the clients
+    POOL_BATCH,             // Parsing and commands of the jobs, and backups
+    POOL_PRIORITIES
+};
+
+typedef struct {
+    void (*run)(void* arg);
+    void* arg;
+} Task;
+
+// Circular deque of tasks, its owner takes from the tail and the other
+// workers steal from the head
+typedef struct {
+    Task* tasks;
+    size_t head, count, capacity;
+    pthread_mutex_t lock;
+} TaskDeque;
+
+typedef struct Pool {
+    TaskDeque* deques;          // POOL_PRIORITIES deques per worker
+    pthread_t* workers;
+    size_t num_workers;
+    atomic_size_t next_deque;   // Deque of the next task submitted from outside
+    atomic_size_t queued;       // Tasks in the deques
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+} Pool;
+
+/**
+ * @brief Creates a pool and starts its workers.
+ *
+ * @param num_workers Number of workers.
+ * @return The pool, NULL on failure.
+ */
+Pool* pool_create(size_t num_workers);
+
+/**
+ * @brief Submits a task to the pool. A task submitted by a worker goes to
+ * its own deque, the others are spread over the deques of the workers.
+ *
+ * @param pool The pool.
+ * @param priority Priority of the task.
+ * @param run Function of the task.
+ * @param arg Argument of the function.
+ * @return 0 if the task was submitted, 1 otherwise.
+ */
+int pool_submit(Pool* pool, enum TaskPriority priority, void (*run)(void* arg), void* arg);
+
+/**
+ * @brief Runs the tasks left in the pool, stops its workers and frees it.
+ *
+ * @param pool The pool.
+ */
+void pool_destroy(Pool* pool);
+
+#endif  // KVS_POOL_H
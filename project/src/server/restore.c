@@ -0,0 +1,245 @@
+/**
+ * @file restore.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief Rebuilds a full backup from a delta backup written by the server
+ * with --delta-backups. Receives the path of a backup and, optionally, the
+ * path of the file where the full backup is written (the standard output
+ * by default).
+ *
+ * A delta starts with BACKUP_DELTA_HEADER and the name of the backup it is
+ * applied to, in the same directory, followed by the keys deleted since
+ * that backup, "-(key)", and the pairs written, "(key, value)". The chain
+ * of deltas is followed back to a full backup, which is then updated by
+ * each delta in turn. The pairs kept are in the order of the full backup,
+ * and the new ones follow in the order they were found.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "constants.h"
+#include "../common/io.h"
+
+// A pair of the backup, pointing into the files read
+typedef struct {
+  char* key;
+  char* value;              // NULL once the key is deleted
+} Pair;
+
+// The pairs in the order they are written, and an index of their keys
+typedef struct {
+  Pair* pairs;
+  size_t num_pairs, capacity;
+  size_t* index;            // Position of each key in pairs, plus one
+  size_t index_size;        // Power of two, at least twice the pairs
+} Backup;
+
+static size_t hash_key(const char* key){
+  uint64_t hash = 14695981039346656037ULL;
+  for(; *key != '\0'; key++)
+    hash = (hash ^ (unsigned char) *key) * 1099511628211ULL;
+  return (size_t) hash;
+}
+
+// Slot of a key in the index, empty if it is not there
+static size_t* find_slot(Backup* backup, const char* key){
+  size_t slot = hash_key(key) & (backup->index_size - 1);
+  while(backup->index[slot] != 0
+        && strcmp(backup->pairs[backup->index[slot] - 1].key, key) != 0)
+    slot = (slot + 1) & (backup->index_size - 1);
+  return &backup->index[slot];
+}
+
+static int grow(Backup* backup){
+  size_t capacity = backup->capacity ? 2*backup->capacity : 1024;
+  Pair* pairs = realloc(backup->pairs, capacity * sizeof(Pair));
+  if(pairs == NULL)
+    return 1;
+  backup->pairs = pairs;
+  backup->capacity = capacity;
+
+  size_t* index = calloc(2*capacity, sizeof(size_t));
+  if(index == NULL)
+    return 1;
+  free(backup->index);
+  backup->index = index;
+  backup->index_size = 2*capacity;
+  for(size_t i = 0; i < backup->num_pairs; i++)
+    *find_slot(backup, backup->pairs[i].key) = i + 1;
+  return 0;
+}
+
+// Writes a pair, in its place if the key is there, after the others if not
+static int put_pair(Backup* backup, char* key, char* value){
+  if(backup->num_pairs == backup->capacity && grow(backup))
+    return 1;
+
+  size_t* slot = find_slot(backup, key);
+  if(*slot != 0 && backup->pairs[*slot - 1].value != NULL){
+    backup->pairs[*slot - 1].value = value;
+    return 0;
+  }
+
+  // A key written again after it was deleted goes after the others
+  backup->pairs[backup->num_pairs].key = key;
+  backup->pairs[backup->num_pairs].value = value;
+  *slot = ++backup->num_pairs;
+  return 0;
+}
+
+static void delete_key(Backup* backup, const char* key){
+  size_t* slot = find_slot(backup, key);
+  if(*slot != 0)
+    backup->pairs[*slot - 1].value = NULL;
+}
+
+// Reads a whole file, terminated by '\0'
+static char* read_file(const char* path){
+  int fd = open(path, O_RDONLY);
+  if(fd < 0){
+    fprintf(stderr, "[RESTORE] Error opening the backup %s\n", path);
+    return NULL;
+  }
+
+  struct stat st;
+  char* data = NULL;
+  if(fstat(fd, &st) == 0 && (data = malloc((size_t) st.st_size + 1)) != NULL){
+    if(read_all(fd, data, (size_t) st.st_size, NULL) != 1){
+      free(data);
+      data = NULL;
+    }else{
+      data[st.st_size] = '\0';
+    }
+  }
+  if(data == NULL)
+    fprintf(stderr, "[RESTORE] Failed to read the backup %s\n", path);
+
+  close(fd);
+  return data;
+}
+
+// Name of the backup a delta is applied to, NULL if it is a full backup
+static char* delta_base(char* data){
+  size_t len = strlen(BACKUP_DELTA_HEADER);
+  if(strncmp(data, BACKUP_DELTA_HEADER, len) != 0)
+    return NULL;
+  return data + len;
+}
+
+// Applies the lines of a backup, after its header, to the pairs
+static int apply(Backup* backup, char* line, const char* path){
+  while(*line != '\0'){
+    char* end = strchr(line, '\n');
+    if(end == NULL){
+      fprintf(stderr, "[RESTORE] The backup %s is truncated.\n", path);
+      return 1;
+    }
+    *end = '\0';
+
+    // "(key, value)" or "-(key)"
+    char* separator = strstr(line, ", ");
+    if(line[0] == '(' && end[-1] == ')' && separator != NULL){
+      *separator = '\0';
+      end[-1] = '\0';
+      if(put_pair(backup, line + 1, separator + 2)){
+        fprintf(stderr, "[RESTORE] Failed to allocate the pairs.\n");
+        return 1;
+      }
+    }else if(line[0] == '-' && line[1] == '(' && end[-1] == ')'){
+      end[-1] = '\0';
+      delete_key(backup, line + 2);
+    }else{
+      fprintf(stderr, "[RESTORE] Invalid line in the backup %s: %s\n", path, line);
+      return 1;
+    }
+    line = end + 1;
+  }
+  return 0;
+}
+
+int main(int argc, char** argv){
+  if(argc != 2 && argc != 3){
+    fprintf(stderr, "Usage: %s <backup.bck> [output.bck]\n", argv[0]);
+    return 1;
+  }
+
+  // Follow the deltas back to the full backup
+  static char paths[MAX_DELTA_CHAIN][MAX_JOB_FILE_NAME_SIZE];
+  char* files[MAX_DELTA_CHAIN];
+  size_t num_files = 0;
+  int result = 0;
+  char* base = NULL;
+  strncpy(paths[0], argv[1], MAX_JOB_FILE_NAME_SIZE - 1);
+
+  do{
+    if(num_files == MAX_DELTA_CHAIN){
+      fprintf(stderr, "[RESTORE] The chain of deltas of %s is too long.\n", argv[1]);
+      result = 1;
+      break;
+    }
+    if(base != NULL){
+      // The base is in the directory of the delta
+      *strchr(base, '\n') = '\0';
+      const char* dir_end = strrchr(paths[num_files - 1], '/');
+      size_t dir_len = dir_end != NULL ? (size_t) (dir_end - paths[num_files - 1]) + 1 : 0;
+      if(dir_len + strlen(base) >= MAX_JOB_FILE_NAME_SIZE){
+        fprintf(stderr, "[RESTORE] Backup path size exceeded.\n");
+        result = 1;
+        break;
+      }
+      memcpy(paths[num_files], paths[num_files - 1], dir_len);
+      strcpy(paths[num_files] + dir_len, base);
+    }
+    if((files[num_files] = read_file(paths[num_files])) == NULL){
+      result = 1;
+      break;
+    }
+    base = delta_base(files[num_files++]);
+    if(base != NULL && strchr(base, '\n') == NULL){
+      fprintf(stderr, "[RESTORE] The backup %s is truncated.\n", paths[num_files - 1]);
+      result = 1;
+      break;
+    }
+  }while(base != NULL);
+
+  // Apply the deltas over the full backup, the oldest first. The header
+  // of a delta was cut by the chain, so it is skipped by its length
+  Backup backup = {NULL, 0, 0, NULL, 0};
+  for(size_t i = num_files; result == 0 && i > 0; i--){
+    char* data = files[i - 1];
+    if(delta_base(data) != NULL)
+      data += strlen(data) + 1;
+    result = apply(&backup, data, paths[i - 1]);
+  }
+
+  FILE* output = stdout;
+  if(result == 0 && argc == 3 && (output = fopen(argv[2], "w")) == NULL){
+    fprintf(stderr, "[RESTORE] Error opening output file %s\n", argv[2]);
+    result = 1;
+  }
+
+  if(result == 0){
+    for(size_t i = 0; i < backup.num_pairs; i++)
+      if(backup.pairs[i].value != NULL)
+        fprintf(output, "(%s, %s)\n", backup.pairs[i].key, backup.pairs[i].value);
+    if(fflush(output) != 0 || (output != stdout && fclose(output) != 0)){
+      fprintf(stderr, "[RESTORE] Failed to write the full backup.\n");
+      result = 1;
+    }
+  }
+
+  for(size_t i = 0; i < num_files; i++)
+    free(files[i]);
+  free(backup.pairs);
+  free(backup.index);
+  return result;
+}
@@ -0,0 +1,1243 @@
+/**
+ * @file sessions.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief The session layer of the server. The connected clients are
+ * spread over a small pool of event loops (epoll), each one serving
+ * many clients through non-blocking pipes, so the number of clients
+ * is bounded by the file descriptors and not by the threads.
+ *
+ * Every session is a small state machine fed with the bytes read from
+ * its request pipe. The responses and the notifications are queued and
+ * written whenever the client pipes have room for them.
+ *
+ * The clients may also connect through a Unix domain socket, which
+ * carries the requests, the responses and the notifications of the
+ * session. Each message sent through it starts with its channel.
+ *
+ * A client may ask for its notifications to be written to a ring in
+ * shared memory instead, which it reads without any system call.
+ *
+ * The event loops never wait for the log of the writes: the response of a
+ * write, and every response queued after it, is held until the pool has
+ * committed the write to the log.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include "sessions.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "constants.h"
+#include "operations.h"
+#include "../common/constants.h"
+#include "../common/protocol.h"
+#include "../common/io.h"
+#include "../common/ring.h"
+
+typedef enum {
+  SESSION_RENDEZVOUS,   // Waiting for the client to open its pipes (pipes)
+  SESSION_CONNECTING,   // Waiting for the connection request (sockets)
+  SESSION_OPEN,         // Executing the requests
+  SESSION_CLOSING,      // Disconnection requested, writing the last responses
+  SESSION_CLOSED        // The session must be torn down
+} SessionState;
+
+// Bytes waiting for room in a pipe or socket
+typedef struct {
+  char* data;
+  size_t len, cap;
+  int packets;  // Keeps the boundaries of the messages (sockets)
+} OutQueue;
+
+typedef struct Session {
+  // The three are the same socket when the client connected through one
+  int req_fd, resp_fd, notif_fd;
+  int is_socket;
+  char id[MAX_PIPE_PATH_LENGTH];
+  SessionState state;
+  char opcode;
+
+  // A request split between reads, gathered until it is whole
+  char* payload;
+  size_t payload_len, payload_cap;
+  uint32_t request_id;
+  int has_request_id;
+
+  // Protects the queues, the overflow flag and the registered events,
+  // since the notifications are queued by the job threads
+  pthread_mutex_t lock;
+  OutQueue responses, notifications;
+  int overflow;
+  uint32_t req_events, resp_events, notif_events;
+
+  // Shared memory ring of the notifications, if the client asked for one
+  NotifRing* ring;
+
+  // Position in the log the held responses wait for, 0 if none is held,
+  // and the bytes of the responses queued before them. Only changed by the
+  // event loop, with the session lock.
+  uint64_t commit_position;
+  size_t held_from;
+  struct Session* commit_next;
+
+  // Pipes a client connecting through them has yet to open, the result sent
+  // once it opens the response pipe, and until when it is waited for
+  char resp_path[MAX_PIPE_PATH_LENGTH + 1], notif_path[MAX_PIPE_PATH_LENGTH + 1];
+  char result;
+  uint64_t deadline;
+
+  struct SessionLoop* loop;
+  struct Session* next;
+} Session;
+
+typedef struct SessionLoop {
+  pthread_t thread;
+  int epoll_fd, wake_fd;
+
+  // Protects the pending sessions and the requests of the host thread
+  pthread_mutex_t lock;
+  Session* pending;
+  int close_all, stop;
+
+  // Sessions served by this loop and the ones whose client has not opened
+  // its pipes yet, only touched by the loop thread
+  Session* sessions;
+  Session* rendezvous;
+
+  // Sessions holding responses until their writes are in the log, only
+  // touched by the loop thread, and the commits the pool has yet to finish
+  Session* committing;
+  int commits;
+  pthread_cond_t commits_done;
+} SessionLoop;
+
+// A write the pool commits to the log for an event loop
+typedef struct {
+  SessionLoop* loop;
+  uint64_t position;
+} Commit;
+
+static SessionLoop LOOPS[SESSION_LOOP_COUNT];
+static size_t NEXT_LOOP = 0;
+static Pool* COMMIT_POOL = NULL;
+
+// The sessions indexed by the file descriptors of their pipes
+static Session** SESSIONS_TABLE = NULL;
+static size_t SESSIONS_TABLE_SIZE = 0;
+static pthread_rwlock_t SESSIONS_TABLE_LOCK;
+
+// OUTPUT QUEUES //
+
+static int queue_append(OutQueue* queue, char channel, const char* data, size_t size){
+  size_t needed = queue->packets ? size + 3 : size;
+  if(queue->len + needed > queue->cap){
+    size_t cap = queue->cap ? queue->cap : SESSION_BUFFER_SIZE;
+    while(cap < queue->len + needed)
+      cap *= 2;
+
+    char* new_data = realloc(queue->data, cap);
+    if(new_data == NULL)
+      return 1;
+    queue->data = new_data;
+    queue->cap = cap;
+  }
+
+  // Each message is stored after its size and its channel
+  if(queue->packets){
+    uint16_t packet_size = (uint16_t) (size + 1);
+    memcpy(queue->data + queue->len, &packet_size, sizeof(packet_size));
+    queue->data[queue->len + 2] = channel;
+    queue->len += 3;
+  }
+
+  memcpy(queue->data + queue->len, data, size);
+  queue->len += size;
+  return 0;
+}
+
+// Writes as much of the first limit bytes of the queue as the pipe (or
+// socket) accepts. Returns the number of bytes left in the queue or -1 on error.
+static ssize_t queue_flush(OutQueue* queue, int fd, size_t limit){
+  size_t written = 0;
+  while(written < limit){
+    ssize_t result;
+    if(queue->packets){
+      // A socket message is sent whole or not at all
+      uint16_t packet_size;
+      memcpy(&packet_size, queue->data + written, sizeof(packet_size));
+      if((result = send(fd, queue->data + written + 2, packet_size, MSG_NOSIGNAL)) >= 0)
+        result = packet_size + 2;
+    }else{
+      result = write(fd, queue->data + written, limit - written);
+    }
+
+    if(result < 0){
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return -1;
+    }
+    written += (size_t) result;
+  }
+
+  memmove(queue->data, queue->data + written, queue->len - written);
+  queue->len -= written;
+  return (ssize_t) queue->len;
+}
+
+// SESSIONS //
+
+// Milliseconds of the monotonic clock
+static uint64_t clock_ms(){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000 + (uint64_t) now.tv_nsec / 1000000;
+}
+
+// A descriptor not opened yet fits in the table as well
+static int session_fits(int fd){
+  return fd < 0 || (size_t) fd < SESSIONS_TABLE_SIZE;
+}
+
+static Session* session_lookup(int fd){
+  Session* session = NULL;
+  pthread_rwlock_rdlock(&SESSIONS_TABLE_LOCK);
+  if(fd >= 0 && (size_t) fd < SESSIONS_TABLE_SIZE)
+    session = SESSIONS_TABLE[fd];
+  pthread_rwlock_unlock(&SESSIONS_TABLE_LOCK);
+  return session;
+}
+
+static void set_events(Session* session, int fd, uint32_t* current, uint32_t wanted){
+  if(*current == wanted)
+    return;
+
+  struct epoll_event event = {.events = wanted, .data.fd = fd};
+  if(epoll_ctl(session->loop->epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0)
+    fprintf(stderr, "[SESSIONS] Failed to update the events of client %s.\n", session->id);
+  *current = wanted;
+}
+
+// Registers the events wanted for each pipe of the session.
+// Must be called with the session lock.
+static void session_update_events(Session* session){
+  // Stops reading requests while the client does not read the responses,
+  // and the held responses are not waited for in the pipe
+  size_t sendable = session->commit_position != 0 ? session->held_from : session->responses.len;
+  uint32_t req_events = session->responses.len > SESSION_BUFFER_SIZE ? 0 : EPOLLIN;
+  uint32_t resp_events = sendable > 0 ? EPOLLOUT : 0;
+  uint32_t notif_events = session->notifications.len > 0 || session->overflow ? EPOLLOUT : 0;
+
+  if(session->is_socket){
+    set_events(session, session->req_fd, &session->req_events,
+               req_events | resp_events | notif_events);
+    return;
+  }
+
+  // The ring is not polled, an overflow of it is handled through the response pipe
+  if(session->ring != NULL)
+    resp_events |= notif_events;
+
+  set_events(session, session->req_fd, &session->req_events, req_events);
+  set_events(session, session->resp_fd, &session->resp_events, resp_events);
+  if(session->ring == NULL)
+    set_events(session, session->notif_fd, &session->notif_events, notif_events);
+}
+
+// Maps the ring named by the notifications path, if it has the ring scheme.
+// Returns 0 if the ring was mapped or none was asked for, 1 otherwise.
+static int session_open_ring(const char* notif_path, NotifRing** ring, int* ring_fd){
+  size_t scheme_length = strlen(RING_SCHEME);
+  *ring = NULL;
+  if(strncmp(notif_path, RING_SCHEME, scheme_length) != 0)
+    return 0;
+
+  *ring = ring_open(notif_path + scheme_length, ring_fd);
+  return *ring == NULL;
+}
+
+// Queues the response of the current request, after its id if it has one
+static void session_queue_response(Session* session, const char* response, size_t size){
+  char identified[sizeof(uint32_t) + MAX_RESPONSE_SIZE];
+  if(session->has_request_id){
+    memcpy(identified, &session->request_id, sizeof(uint32_t));
+    memcpy(identified + sizeof(uint32_t), response, size);
+    response = identified;
+    size += sizeof(uint32_t);
+    session->has_request_id = 0;
+  }
+
+  pthread_mutex_lock(&session->lock);
+  if(queue_append(&session->responses, CHANNEL_RESPONSE, response, size)){
+    fprintf(stderr, "[SESSIONS] Failed to queue a response to the client %s.\n", session->id);
+    session->state = SESSION_CLOSED;
+  }
+  pthread_mutex_unlock(&session->lock);
+}
+
+static void session_respond(Session* session, char opcode, char result){
+  char response[2] = {opcode, result};
+  session_queue_response(session, response, 2);
+}
+
+// Tells the client it is connected, with the epoch of the sequences of the
+// notifications, so it can tell them from those of another server
+static void session_connected(Session* session){
+  char response[2 + sizeof(uint64_t)] = {OP_CODE_CONNECT + '0', '0'};
+  uint64_t epoch = kvs_epoch();
+  memcpy(response + 2, &epoch, sizeof(epoch));
+  session_queue_response(session, response, sizeof(response));
+}
+
+// Completes the connection of a client that connected through a socket,
+// given the id and the notifications path of its connection request
+static void session_handshake(Session* session, char* fields){
+  fields[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+  strncpy(session->id, fields, MAX_PIPE_PATH_LENGTH - 1);
+
+  // The notifications keep going through the socket unless a ring is asked for
+  char* notif_path = fields + MAX_PIPE_PATH_LENGTH;
+  int ring_fd;
+  notif_path[MAX_PIPE_PATH_LENGTH - 1] = '\0';
+  if(session_open_ring(notif_path, &session->ring, &ring_fd)){
+    fprintf(stderr, "[SESSIONS] Failed to map the client %s notifications ring.\n", session->id);
+    session_respond(session, session->opcode, '1');
+    session->state = SESSION_CLOSING;
+    return;
+  }
+  if(session->ring != NULL)
+    close(ring_fd);
+
+  session_connected(session);
+  session->state = SESSION_OPEN;
+
+  char connection_message[31 + MAX_PIPE_PATH_LENGTH] = {'\0'};
+  snprintf(connection_message, 31 + MAX_PIPE_PATH_LENGTH, "[SESSIONS] Connected client %s.\n", session->id);
+  write_all(1, connection_message, strlen(connection_message));
+}
+
+static void loop_wake_up(SessionLoop* loop);
+
+// Commits a write to the log for an event loop, which is woken to send the
+// responses held for it
+static void session_commit(void* arg){
+  Commit* commit = (Commit*) arg;
+  SessionLoop* loop = commit->loop;
+  kvs_commit(commit->position);
+  free(commit);
+
+  pthread_mutex_lock(&loop->lock);
+  loop->commits--;
+  loop_wake_up(loop);
+  pthread_cond_signal(&loop->commits_done);
+  pthread_mutex_unlock(&loop->lock);
+}
+
+// Holds the responses queued from now on until the log is committed up to
+// the given position. Returns 1 if the log could not be written.
+static int session_hold(Session* session, uint64_t position){
+  int committed = kvs_committed(position);
+  if(committed != 0)
+    return committed < 0;
+
+  // Falls back to waiting here if the pool cannot take the commit
+  SessionLoop* loop = session->loop;
+  Commit* commit = malloc(sizeof(Commit));
+  if(commit == NULL)
+    return kvs_commit(position);
+  commit->loop = loop;
+  commit->position = position;
+
+  pthread_mutex_lock(&loop->lock);
+  loop->commits++;
+  pthread_mutex_unlock(&loop->lock);
+  if(COMMIT_POOL == NULL || pool_submit(COMMIT_POOL, POOL_INTERACTIVE, session_commit, commit)){
+    pthread_mutex_lock(&loop->lock);
+    loop->commits--;
+    pthread_mutex_unlock(&loop->lock);
+    free(commit);
+    return kvs_commit(position);
+  }
+
+  pthread_mutex_lock(&session->lock);
+  if(session->commit_position == 0){
+    session->held_from = session->responses.len;
+    session->commit_next = loop->committing;
+    loop->committing = session;
+  }
+  session->commit_position = position;
+  pthread_mutex_unlock(&session->lock);
+  return 0;
+}
+
+// Keys sent by a client may lack the terminator or not be valid for the table
+static int session_check_keys(char keys[][MAX_STRING_SIZE], size_t num_keys){
+  for(size_t i = 0; i < num_keys; i++){
+    keys[i][MAX_STRING_SIZE - 1] = '\0';
+    if(!isalnum((unsigned char) keys[i][0]))
+      return 1;
+  }
+  return 0;
+}
+
+// Executes a batched request, given what follows its op code, responding
+// with the results. Returns 1 if its size does not match its number of keys.
+static int session_execute_batch(Session* session, char* request, size_t size){
+  uint16_t batch_size;
+  if(size < sizeof(batch_size))
+    return 1;
+  memcpy(&batch_size, request, sizeof(batch_size));
+
+  // The values follow the keys of the writes, the sequence and its epoch
+  // those of the resumes
+  size_t num_keys = batch_size;
+  size_t entry_size = session->opcode - '0' == OP_CODE_WRITE ? 2*MAX_STRING_SIZE : MAX_STRING_SIZE;
+  size_t trailer_size = session->opcode - '0' == OP_CODE_RESUME ? 2*sizeof(uint64_t) : 0;
+  if(num_keys == 0 || num_keys > MAX_BATCH_SIZE
+     || size != sizeof(batch_size) + num_keys*entry_size + trailer_size)
+    return 1;
+
+  char (*keys)[MAX_STRING_SIZE] = (char (*)[MAX_STRING_SIZE]) (request + sizeof(batch_size));
+  char response[MAX_RESPONSE_SIZE];
+  char values[MAX_BATCH_SIZE][MAX_STRING_SIZE], flags[MAX_BATCH_SIZE];
+  size_t response_size = 2;
+  uint64_t position = 0;
+
+  response[0] = session->opcode;
+  response[1] = '1';
+  if(session_check_keys(keys, num_keys)){
+    fprintf(stderr, "[SESSIONS] Invalid keys requested by the client %s.\n", session->id);
+  }else{
+    switch(session->opcode - '0'){
+      case OP_CODE_READ:
+        if(kvs_read_values(num_keys, keys, values, flags))
+          break;
+        for(size_t i = 0; i < num_keys; i++){
+          response[response_size++] = flags[i];
+          memcpy(response + response_size, values[i], MAX_STRING_SIZE);
+          response_size += MAX_STRING_SIZE;
+        }
+        response[1] = '0';
+        break;
+
+      case OP_CODE_WRITE:
+        // The values follow the keys
+        for(size_t i = 0; i < num_keys; i++)
+          keys[num_keys + i][MAX_STRING_SIZE - 1] = '\0';
+        if(!kvs_write_deferred(num_keys, keys, keys + num_keys, &position))
+          response[1] = '0';
+        break;
+
+      case OP_CODE_DELETE:
+        if(kvs_delete_deferred(num_keys, keys, flags, &position))
+          break;
+        memcpy(response + response_size, flags, num_keys);
+        response_size += num_keys;
+        response[1] = '0';
+        break;
+
+      case OP_CODE_SUBSCRIBE_KEYS:
+      case OP_CODE_UNSUBSCRIBE_KEYS:
+        if(kvs_subscribe_keys(session->notif_fd, keys, num_keys,
+                              session->opcode - '0' == OP_CODE_SUBSCRIBE_KEYS, flags))
+          break;
+        memset(response + response_size, 0, (num_keys + 7) / 8);
+        for(size_t i = 0; i < num_keys; i++)
+          if(flags[i])
+            response[response_size + i/8] |= (char) (1 << i%8);
+        response_size += (num_keys + 7) / 8;
+        response[1] = '0';
+        break;
+
+      case OP_CODE_RESUME:
+        // The sequence and its epoch follow the keys
+        ;uint64_t since, epoch;
+        int truncated;
+        memcpy(&since, keys + num_keys, sizeof(since));
+        memcpy(&epoch, (char*) (keys + num_keys) + sizeof(since), sizeof(epoch));
+        if(kvs_resume(session->notif_fd, keys, num_keys, epoch, since, flags, &truncated))
+          break;
+        response[response_size++] = (char) truncated;
+        memset(response + response_size, 0, (num_keys + 7) / 8);
+        for(size_t i = 0; i < num_keys; i++)
+          if(flags[i])
+            response[response_size + i/8] |= (char) (1 << i%8);
+        response_size += (num_keys + 7) / 8;
+        response[1] = '0';
+        break;
+    }
+  }
+
+  // The change is answered once it is in the log
+  if(position != 0 && session_hold(session, position)){
+    fprintf(stderr, "[SESSIONS] Failed to log the changes of the client %s.\n", session->id);
+    response[1] = '1';
+    response_size = 2;
+  }
+  session_queue_response(session, response, response_size);
+  return 0;
+}
+
+// Executes a request, given its op code and what follows it
+static void session_execute(Session* session, char* request, size_t size){
+  session->opcode = request[0];
+  request++;
+  size--;
+
+  int invalid = 0;
+  char key[MAX_STRING_SIZE];
+  switch(session->opcode - '0'){
+    case OP_CODE_DISCONNECT:
+      session_respond(session, session->opcode, '0');
+      if(session->state != SESSION_CLOSED)
+        session->state = SESSION_CLOSING;
+      return;
+
+    case OP_CODE_REQUEST_ID:
+      // The request itself follows its id
+      if(size <= sizeof(uint32_t)){
+        invalid = 1;
+        break;
+      }
+      memcpy(&session->request_id, request, sizeof(uint32_t));
+      session->has_request_id = 1;
+      session_execute(session, request + sizeof(uint32_t), size - sizeof(uint32_t));
+      return;
+
+    case OP_CODE_SUBSCRIBE:
+    case OP_CODE_UNSUBSCRIBE:
+    case OP_CODE_SUBSCRIBE_PATTERN:
+    case OP_CODE_UNSUBSCRIBE_PATTERN:
+      if(size != MAX_STRING_SIZE){
+        invalid = 1;
+        break;
+      }
+      memcpy(key, request, MAX_STRING_SIZE);
+      key[MAX_STRING_SIZE - 1] = '\0';
+
+      if(session->opcode - '0' == OP_CODE_SUBSCRIBE)
+        session_respond(session, session->opcode, kvs_subscribe(session->notif_fd, key) ? '0' : '1');
+      else if(session->opcode - '0' == OP_CODE_UNSUBSCRIBE)
+        session_respond(session, session->opcode, kvs_unsubscribe(session->notif_fd, key) ? '1' : '0');
+      else if(session->opcode - '0' == OP_CODE_SUBSCRIBE_PATTERN)
+        session_respond(session, session->opcode,
+                        kvs_subscribe_pattern(session->notif_fd, key) ? '0' : '1');
+      else
+        session_respond(session, session->opcode,
+                        kvs_unsubscribe_pattern(session->notif_fd, key) ? '1' : '0');
+      return;
+
+    case OP_CODE_READ:
+    case OP_CODE_WRITE:
+    case OP_CODE_DELETE:
+    case OP_CODE_SUBSCRIBE_KEYS:
+    case OP_CODE_UNSUBSCRIBE_KEYS:
+    case OP_CODE_RESUME:
+      invalid = session_execute_batch(session, request, size);
+      break;
+
+    default:
+      invalid = 1;
+      break;
+  }
+
+  // The next request is found through the size of this one, so the
+  // session can go on
+  if(invalid){
+    fprintf(stderr, "[SESSIONS] Invalid request of the client %s.\n", session->id);
+    session_respond(session, session->opcode, '1');
+  }
+}
+
+// Size of the request at the start of the given bytes, with its header,
+// 0 if its header is incomplete and SIZE_MAX if it is not valid
+static size_t session_frame_size(Session* session, const char* data, size_t size){
+  // The connection request of the sockets has no header
+  if(session->state == SESSION_CONNECTING)
+    return size < SOCKET_CONNECT_SIZE ? 0 : SOCKET_CONNECT_SIZE;
+
+  uint32_t request_size;
+  if(size < REQUEST_HEADER_SIZE)
+    return 0;
+  memcpy(&request_size, data, sizeof(request_size));
+  if(request_size == 0 || request_size > MAX_REQUEST_SIZE)
+    return SIZE_MAX;
+  return REQUEST_HEADER_SIZE + request_size;
+}
+
+// Executes a whole request, with its header
+static void session_dispatch_frame(Session* session, char* frame, size_t size){
+  if(session->state != SESSION_CONNECTING){
+    session_execute(session, frame + REQUEST_HEADER_SIZE, size - REQUEST_HEADER_SIZE);
+    return;
+  }
+
+  session->opcode = frame[0];
+  if(session->opcode - '0' != OP_CODE_CONNECT){
+    fprintf(stderr, "[SESSIONS] Invalid connection request.\n");
+    session->state = SESSION_CLOSED;
+    return;
+  }
+  session_handshake(session, frame + 1);
+}
+
+// Executes the requests in the bytes read from the request pipe. The
+// requests read whole are executed where they were read, only those split
+// between reads are gathered in the payload of the session.
+static void session_feed(Session* session, char* data, size_t size){
+  while(size > 0 && session->state != SESSION_CLOSING && session->state != SESSION_CLOSED){
+    size_t frame_size;
+    if(session->payload_len == 0){
+      frame_size = session_frame_size(session, data, size);
+      if(frame_size != 0 && frame_size != SIZE_MAX && frame_size <= size){
+        session_dispatch_frame(session, data, frame_size);
+        data += frame_size;
+        size -= frame_size;
+        continue;
+      }
+    }else{
+      frame_size = session_frame_size(session, session->payload, session->payload_len);
+    }
+
+    // Gathers the header first, then the rest of the request
+    size_t wanted = frame_size != 0 ? frame_size
+                    : session->state == SESSION_CONNECTING ? SOCKET_CONNECT_SIZE
+                    : REQUEST_HEADER_SIZE;
+    if(wanted != SIZE_MAX && wanted > session->payload_cap){
+      char* payload = realloc(session->payload, wanted);
+      if(payload == NULL){
+        fprintf(stderr, "[SESSIONS] Failed to allocate a request of the client %s.\n", session->id);
+        session->state = SESSION_CLOSED;
+        return;
+      }
+      session->payload = payload;
+      session->payload_cap = wanted;
+    }
+
+    if(wanted != SIZE_MAX){
+      size_t available = size < wanted - session->payload_len ? size : wanted - session->payload_len;
+      memcpy(session->payload + session->payload_len, data, available);
+      session->payload_len += available;
+      data += available;
+      size -= available;
+      frame_size = session_frame_size(session, session->payload, session->payload_len);
+    }
+
+    // Without a valid size the next requests cannot be found
+    if(frame_size == SIZE_MAX){
+      fprintf(stderr, "[SESSIONS] Invalid request size sent by the client %s.\n", session->id);
+      session->state = SESSION_CLOSED;
+      return;
+    }
+    if(frame_size != 0 && session->payload_len == frame_size){
+      session->payload_len = 0;
+      session_dispatch_frame(session, session->payload, frame_size);
+    }
+  }
+}
+
+static void session_read_requests(Session* session){
+  // Large enough for a whole socket message, which would be truncated otherwise
+  char buffer[MAX_SOCKET_MESSAGE_SIZE];
+
+  while(session->state != SESSION_CLOSING && session->state != SESSION_CLOSED){
+    pthread_mutex_lock(&session->lock);
+    int full = session->responses.len > SESSION_BUFFER_SIZE;
+    pthread_mutex_unlock(&session->lock);
+    if(full)
+      break;
+
+    ssize_t result = read(session->req_fd, buffer, MAX_SOCKET_MESSAGE_SIZE);
+    if(result < 0){
+      if(errno == EINTR)
+        continue;
+      if(errno != EAGAIN && errno != EWOULDBLOCK){
+        fprintf(stderr, "[SESSIONS] Failed to read a request of the client %s.\n", session->id);
+        session->state = SESSION_CLOSED;
+      }
+      break;
+    }
+    if(result == 0){
+      session->state = SESSION_CLOSED;
+      break;
+    }
+
+    session_feed(session, buffer, (size_t) result);
+  }
+}
+
+static void session_flush(Session* session){
+  pthread_mutex_lock(&session->lock);
+
+  // The held responses are left in the queue
+  size_t queued = session->responses.len;
+  size_t sendable = session->commit_position != 0 ? session->held_from : queued;
+  ssize_t left = queue_flush(&session->responses, session->resp_fd, sendable);
+  if(left >= 0 && session->commit_position != 0)
+    session->held_from -= queued - (size_t) left;
+
+  if(left < 0 || queue_flush(&session->notifications, session->notif_fd, session->notifications.len) < 0){
+    session->state = SESSION_CLOSED;
+  }else if(session->overflow){
+    fprintf(stderr, "[SESSIONS] The client %s is not reading its notifications.\n", session->id);
+    session->state = SESSION_CLOSED;
+  }else if(session->state == SESSION_CLOSING && session->responses.len == 0){
+    session->state = SESSION_CLOSED;
+  }
+
+  if(session->state != SESSION_CLOSED)
+    session_update_events(session);
+
+  pthread_mutex_unlock(&session->lock);
+}
+
+static void session_free(Session* session){
+  close(session->req_fd);
+  if(!session->is_socket){
+    close(session->resp_fd);
+    close(session->notif_fd);
+  }
+  if(session->ring != NULL){
+    ring_close(session->ring);
+    ring_unmap(session->ring);
+  }
+  free(session->payload);
+  free(session->responses.data);
+  free(session->notifications.data);
+  pthread_mutex_destroy(&session->lock);
+  free(session);
+}
+
+static void session_close(Session* session){
+  SessionLoop* loop = session->loop;
+
+  // No notification is sent to the session after its subscriptions are gone
+  unsubscribe_fifo(session->notif_fd);
+
+  pthread_rwlock_wrlock(&SESSIONS_TABLE_LOCK);
+  SESSIONS_TABLE[session->req_fd] = NULL;
+  SESSIONS_TABLE[session->resp_fd] = NULL;
+  SESSIONS_TABLE[session->notif_fd] = NULL;
+  pthread_rwlock_unlock(&SESSIONS_TABLE_LOCK);
+
+  if(session->commit_position != 0)
+    for(Session** link = &loop->committing; *link != NULL; link = &(*link)->commit_next)
+      if(*link == session){
+        *link = session->commit_next;
+        break;
+      }
+
+  if(loop->sessions == session)
+    loop->sessions = session->next;
+  else
+    for(Session* aux = loop->sessions; aux != NULL; aux = aux->next)
+      if(aux->next == session){
+        aux->next = session->next;
+        break;
+      }
+
+  char disconnection_message[34 + MAX_PIPE_PATH_LENGTH] = {'\0'};
+  snprintf(disconnection_message, 34 + MAX_PIPE_PATH_LENGTH, "[SESSIONS] Disconnected client %s.\n", session->id);
+  write_all(1, disconnection_message, strlen(disconnection_message));
+
+  session_free(session);
+}
+
+static int session_register(SessionLoop* loop, int fd, uint32_t events){
+  struct epoll_event event = {.events = events, .data.fd = fd};
+  return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+}
+
+// Starts serving a session accepted by the host thread.
+// Returns 1 if the session was dropped.
+static int session_adopt(SessionLoop* loop, Session* session){
+  // The socket carries the three channels, it is only registered once,
+  // and the ring of the notifications is not registered at all
+  session->req_events = EPOLLIN;
+  if(session_register(loop, session->req_fd, EPOLLIN) < 0
+     || (!session->is_socket && (session_register(loop, session->resp_fd, 0) < 0
+                                 || (session->ring == NULL
+                                     && session_register(loop, session->notif_fd, 0) < 0)))){
+    fprintf(stderr, "[SESSIONS] Failed to register the pipes of client %s.\n", session->id);
+    session_free(session);
+    return 1;
+  }
+
+  pthread_rwlock_wrlock(&SESSIONS_TABLE_LOCK);
+  SESSIONS_TABLE[session->req_fd] = session;
+  SESSIONS_TABLE[session->resp_fd] = session;
+  SESSIONS_TABLE[session->notif_fd] = session;
+  pthread_rwlock_unlock(&SESSIONS_TABLE_LOCK);
+
+  session->next = loop->sessions;
+  loop->sessions = session;
+  return 0;
+}
+
+// Tells a client connecting through pipes that its connection failed,
+// if its response pipe is open
+static void session_refuse(int resp_fd, const char* id){
+  char response[2] = {OP_CODE_CONNECT + '0', '1'};
+  if(resp_fd >= 0 && write_all(resp_fd, response, 2) == -1)
+    fprintf(stderr, "[SESSIONS] Failed to write the connection result to the client %s response pipe.\n", id);
+}
+
+// Opens the pipes the client of a session opened since the last attempt,
+// without waiting for it, and starts serving the session once they are all
+// open. Returns 1 once the session is served or dropped.
+static int session_rendezvous(SessionLoop* loop, Session* session, uint64_t now){
+  // Opening a pipe for writing fails with ENXIO until the client opens it for reading
+  int error = 0;
+  if(session->resp_fd < 0 && (session->resp_fd = open(session->resp_path, O_WRONLY | O_NONBLOCK)) < 0)
+    error = errno;
+  else if(session->result == '0' && session->notif_fd < 0
+          && (session->notif_fd = open(session->notif_path, O_WRONLY | O_NONBLOCK)) < 0)
+    error = errno;
+
+  if(error == ENXIO && now < session->deadline)
+    return 0;
+
+  if(error == 0 && session->result == '0'
+     && (!session_fits(session->resp_fd) || !session_fits(session->notif_fd))){
+    fprintf(stderr, "[SESSIONS] Failed to establish the connection with the client %s.\n", session->id);
+    session->result = '1';
+  }
+  if(error != 0 || session->result != '0'){
+    if(error == ENXIO)
+      fprintf(stderr, "[SESSIONS] The client %s did not open its pipes in time.\n", session->id);
+    else if(error != 0)
+      fprintf(stderr, "[SESSIONS] Failed to open the client %s pipes.\n", session->id);
+    session_refuse(session->resp_fd, session->id);
+    session_free(session);
+    return 1;
+  }
+
+  session_connected(session);
+  session->state = SESSION_OPEN;
+  if(session_adopt(loop, session))
+    return 1;
+
+  char connection_message[31 + MAX_PIPE_PATH_LENGTH] = {'\0'};
+  snprintf(connection_message, 31 + MAX_PIPE_PATH_LENGTH, "[SESSIONS] Connected client %s.\n", session->id);
+  write_all(1, connection_message, strlen(connection_message));
+
+  session_flush(session);
+  if(session->state == SESSION_CLOSED)
+    session_close(session);
+  return 1;
+}
+
+// Retries the sessions whose clients have not opened their pipes yet
+static void loop_rendezvous(SessionLoop* loop){
+  uint64_t now = clock_ms();
+  Session** link = &loop->rendezvous;
+  while(*link != NULL){
+    Session* session = *link;
+    Session* next = session->next;
+    if(session_rendezvous(loop, session, now))
+      *link = next;
+    else
+      link = &session->next;
+  }
+}
+
+// Sends the responses held for the writes the log has committed since
+static void loop_commits(SessionLoop* loop){
+  Session** link = &loop->committing;
+  while(*link != NULL){
+    Session* session = *link;
+    int committed = kvs_committed(session->commit_position);
+    if(committed == 0){
+      link = &session->commit_next;
+      continue;
+    }
+
+    *link = session->commit_next;
+    pthread_mutex_lock(&session->lock);
+    session->commit_position = 0;
+    pthread_mutex_unlock(&session->lock);
+
+    // The client must not take the held responses for successful changes
+    if(committed < 0){
+      fprintf(stderr, "[SESSIONS] Failed to log the changes of the client %s.\n", session->id);
+      session->state = SESSION_CLOSED;
+    }else{
+      session_flush(session);
+    }
+    if(session->state == SESSION_CLOSED)
+      session_close(session);
+  }
+}
+
+// Handles the requests of the host thread. Returns 1 if the loop must stop.
+static int loop_wake(SessionLoop* loop){
+  uint64_t value;
+  if(read(loop->wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+    fprintf(stderr, "[SESSIONS] Failed to read the wake up of an event loop.\n");
+
+  pthread_mutex_lock(&loop->lock);
+  Session* pending = loop->pending;
+  int close_all = loop->close_all, stop = loop->stop;
+  loop->pending = NULL;
+  loop->close_all = 0;
+  pthread_mutex_unlock(&loop->lock);
+
+  while(pending != NULL){
+    Session* next = pending->next;
+    if(pending->state == SESSION_RENDEZVOUS){
+      pending->next = loop->rendezvous;
+      loop->rendezvous = pending;
+    }else{
+      session_adopt(loop, pending);
+    }
+    pending = next;
+  }
+
+  if(loop->committing != NULL)
+    loop_commits(loop);
+
+  if(close_all || stop)
+    while(loop->sessions != NULL)
+      session_close(loop->sessions);
+
+  // The clients still connecting are left to finish unless the server stops
+  while(stop && loop->rendezvous != NULL){
+    Session* next = loop->rendezvous->next;
+    session_free(loop->rendezvous);
+    loop->rendezvous = next;
+  }
+
+  return stop;
+}
+
+static void* session_loop(void* arg){
+  // Blocks SIGUSR1 and SIGPIPE in this thread
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGPIPE);
+  if(pthread_sigmask(SIG_BLOCK, &sigset, NULL) != 0){
+    fprintf(stderr,"[SESSIONS] Failed to mask SIGUSR1 and SIGPIPE in an event loop.\n");
+    pthread_exit(NULL);
+  }
+
+  SessionLoop* loop = (SessionLoop*) arg;
+  struct epoll_event events[MAX_EPOLL_EVENTS];
+
+  while(1){
+    // The clients opening their pipes are retried until they do or time out
+    int timeout = loop->rendezvous != NULL ? SESSION_CONNECT_RETRY_MS : -1;
+    int num_events = epoll_wait(loop->epoll_fd, events, MAX_EPOLL_EVENTS, timeout);
+    if(num_events < 0){
+      if(errno == EINTR)
+        continue;
+      fprintf(stderr, "[SESSIONS] Failed to wait for the events of the sessions.\n");
+      break;
+    }
+
+    for(int i = 0; i < num_events; i++){
+      int fd = events[i].data.fd;
+      if(fd == loop->wake_fd){
+        if(loop_wake(loop))
+          pthread_exit(NULL);
+        continue;
+      }
+
+      // Events of sessions closed earlier in this batch are skipped
+      Session* session = session_lookup(fd);
+      if(session == NULL || session->loop != loop)
+        continue;
+
+      if(fd == session->req_fd)
+        session_read_requests(session);
+      else if(events[i].events & (EPOLLERR | EPOLLHUP))
+        session->state = SESSION_CLOSED;
+
+      if(session->state != SESSION_CLOSED)
+        session_flush(session);
+
+      if(session->state == SESSION_CLOSED)
+        session_close(session);
+    }
+
+    if(loop->rendezvous != NULL)
+      loop_rendezvous(loop);
+  }
+
+  pthread_exit(NULL);
+}
+
+static void loop_wake_up(SessionLoop* loop){
+  uint64_t value = 1;
+  if(write(loop->wake_fd, &value, sizeof(value)) < 0)
+    fprintf(stderr, "[SESSIONS] Failed to wake up an event loop.\n");
+}
+
+int sessions_init(Pool* pool){
+  COMMIT_POOL = pool;
+
+  // Every file descriptor of the process may belong to a session
+  struct rlimit limit;
+  if(getrlimit(RLIMIT_NOFILE, &limit) < 0 || limit.rlim_cur == RLIM_INFINITY)
+    SESSIONS_TABLE_SIZE = MAX_SESSIONS_TABLE_SIZE;
+  else
+    SESSIONS_TABLE_SIZE = (size_t) limit.rlim_cur;
+
+  SESSIONS_TABLE = calloc(SESSIONS_TABLE_SIZE, sizeof(Session*));
+  if(SESSIONS_TABLE == NULL){
+    fprintf(stderr, "[SESSIONS] Failed to allocate the sessions table.\n");
+    return 1;
+  }
+  pthread_rwlock_init(&SESSIONS_TABLE_LOCK, NULL);
+
+  for(int i = 0; i < SESSION_LOOP_COUNT; i++){
+    SessionLoop* loop = &LOOPS[i];
+    loop->sessions = loop->pending = loop->rendezvous = loop->committing = NULL;
+    loop->close_all = loop->stop = loop->commits = 0;
+    pthread_mutex_init(&loop->lock, NULL);
+    pthread_cond_init(&loop->commits_done, NULL);
+
+    if((loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0
+       || (loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0){
+      fprintf(stderr, "[SESSIONS] Failed to create an event loop.\n");
+      return 1;
+    }
+
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = loop->wake_fd};
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) < 0
+       || pthread_create(&loop->thread, NULL, session_loop, loop) != 0){
+      fprintf(stderr, "[SESSIONS] Failed to start an event loop.\n");
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+void sessions_terminate(){
+  if(SESSIONS_TABLE == NULL)
+    return;
+
+  for(int i = 0; i < SESSION_LOOP_COUNT; i++){
+    pthread_mutex_lock(&LOOPS[i].lock);
+    LOOPS[i].stop = 1;
+    pthread_mutex_unlock(&LOOPS[i].lock);
+    loop_wake_up(&LOOPS[i]);
+  }
+
+  for(int i = 0; i < SESSION_LOOP_COUNT; i++){
+    pthread_join(LOOPS[i].thread, NULL);
+
+    // The commits still in the pool wake the loop when they finish
+    pthread_mutex_lock(&LOOPS[i].lock);
+    while(LOOPS[i].commits > 0)
+      pthread_cond_wait(&LOOPS[i].commits_done, &LOOPS[i].lock);
+    pthread_mutex_unlock(&LOOPS[i].lock);
+
+    close(LOOPS[i].epoll_fd);
+    close(LOOPS[i].wake_fd);
+    pthread_mutex_destroy(&LOOPS[i].lock);
+    pthread_cond_destroy(&LOOPS[i].commits_done);
+  }
+
+  pthread_rwlock_destroy(&SESSIONS_TABLE_LOCK);
+  free(SESSIONS_TABLE);
+  SESSIONS_TABLE = NULL;
+}
+
+// Hands the session to the event loops in turns
+static void session_dispatch(Session* session){
+  SessionLoop* loop = &LOOPS[NEXT_LOOP];
+  NEXT_LOOP = (NEXT_LOOP + 1) % SESSION_LOOP_COUNT;
+  session->loop = loop;
+
+  pthread_mutex_lock(&loop->lock);
+  session->next = loop->pending;
+  loop->pending = session;
+  pthread_mutex_unlock(&loop->lock);
+  loop_wake_up(loop);
+}
+
+static Session* session_create(int req_fd, int resp_fd, int notif_fd, int is_socket){
+  if(!session_fits(req_fd) || !session_fits(resp_fd) || !session_fits(notif_fd))
+    return NULL;
+
+  Session* session = calloc(1, sizeof(Session));
+  if(session == NULL)
+    return NULL;
+
+  session->req_fd = req_fd;
+  session->resp_fd = resp_fd;
+  session->notif_fd = notif_fd;
+  session->is_socket = is_socket;
+  session->responses.packets = session->notifications.packets = is_socket;
+  session->state = is_socket ? SESSION_CONNECTING : SESSION_OPEN;
+  pthread_mutex_init(&session->lock, NULL);
+  return session;
+}
+
+int session_accept(const char* paths){
+  char req_path[MAX_PIPE_PATH_LENGTH + 1] = {'\0'};
+  int req_fd, notif_fd = -1;
+  NotifRing* ring = NULL;
+
+  Session* session = calloc(1, sizeof(Session));
+  if(session == NULL){
+    fprintf(stderr, "[SESSIONS] Failed to allocate the session of a client.\n");
+    return 1;
+  }
+  strncpy(req_path, paths, MAX_PIPE_PATH_LENGTH);
+  strncpy(session->resp_path, paths + MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH);
+  strncpy(session->notif_path, paths + 2*MAX_PIPE_PATH_LENGTH, MAX_PIPE_PATH_LENGTH);
+
+  // The client id follows the "/tmp/req" prefix of the request pipe
+  strncpy(session->id, strlen(req_path) > 8 ? req_path + 8 : req_path, MAX_PIPE_PATH_LENGTH - 1);
+  session->result = '0';
+
+  // Only what does not wait for the client is opened here, so a client that
+  // never opens its pipes does not hold the others back. Reading a pipe does
+  // not wait for its writer, the response and notifications pipes are opened
+  // by an event loop once the client opens them.
+  if((req_fd = open(req_path, O_RDONLY | O_NONBLOCK)) < 0){
+    fprintf(stderr, "[SESSIONS] Failed to open the client %s request pipe.\n", session->id);
+    session->result = '1';
+  }else if(session_open_ring(session->notif_path, &ring, &notif_fd)){
+    // The descriptor of the ring stands for the notifications pipe of the session
+    fprintf(stderr, "[SESSIONS] Failed to open the client %s notifications pipe.\n", session->id);
+    session->result = '1';
+  }else if(!session_fits(req_fd) || !session_fits(notif_fd)){
+    fprintf(stderr, "[SESSIONS] Failed to establish the connection with the client %s.\n", session->id);
+    session->result = '1';
+  }
+
+  session->req_fd = req_fd;
+  session->resp_fd = -1;
+  session->notif_fd = notif_fd;
+  session->ring = ring;
+  session->state = SESSION_RENDEZVOUS;
+  session->deadline = clock_ms() + SESSION_CONNECT_TIMEOUT_MS;
+  pthread_mutex_init(&session->lock, NULL);
+
+  // The session belongs to the event loop once it is handed to it
+  int result = session->result != '0';
+  session_dispatch(session);
+  return result;
+}
+
+int session_listen(const char* path){
+  struct sockaddr_un address;
+  if(strlen(path) >= sizeof(address.sun_path)){
+    fprintf(stderr, "[SESSIONS] The socket path %s is too long.\n", path);
+    return -1;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+  int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if(listen_fd < 0){
+    fprintf(stderr, "[SESSIONS] Failed to create the server socket.\n");
+    return -1;
+  }
+
+  if(bind(listen_fd, (struct sockaddr*) &address, sizeof(address)) < 0
+     || listen(listen_fd, SOMAXCONN) < 0){
+    fprintf(stderr, "[SESSIONS] Failed to listen on the server socket %s.\n", path);
+    close(listen_fd);
+    return -1;
+  }
+
+  fcntl(listen_fd, F_SETFL, O_NONBLOCK);
+  fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
+  return listen_fd;
+}
+
+int session_accept_socket(int listen_fd){
+  int fd;
+  while((fd = accept(listen_fd, NULL, NULL)) < 0 && errno == EINTR);
+  if(fd < 0){
+    if(errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    fprintf(stderr, "[SESSIONS] Failed to accept a connection on the server socket.\n");
+    return 1;
+  }
+
+  // The connection is completed by the event loop, when the client
+  // sends its connection request through the socket
+  Session* session = session_create(fd, fd, fd, 1);
+  if(session == NULL){
+    fprintf(stderr, "[SESSIONS] Failed to establish a connection through the server socket.\n");
+    close(fd);
+    return 1;
+  }
+
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  strncpy(session->id, "(socket)", MAX_PIPE_PATH_LENGTH);
+  session_dispatch(session);
+  return 0;
+}
+
+void sessions_close_all(){
+  for(int i = 0; i < SESSION_LOOP_COUNT; i++){
+    pthread_mutex_lock(&LOOPS[i].lock);
+    LOOPS[i].close_all = 1;
+    pthread_mutex_unlock(&LOOPS[i].lock);
+    loop_wake_up(&LOOPS[i]);
+  }
+}
+
+int session_notify(int notif_fd, const char* message, size_t size){
+  int result = 0;
+
+  // The session cannot be closed while it is being notified
+  pthread_rwlock_rdlock(&SESSIONS_TABLE_LOCK);
+  Session* session = NULL;
+  if(notif_fd >= 0 && (size_t) notif_fd < SESSIONS_TABLE_SIZE)
+    session = SESSIONS_TABLE[notif_fd];
+  if(session == NULL || session->notif_fd != notif_fd){
+    pthread_rwlock_unlock(&SESSIONS_TABLE_LOCK);
+    return 1;
+  }
+
+  pthread_mutex_lock(&session->lock);
+  if(session->overflow){
+    result = 1;
+  }else if(session->ring != NULL){
+    // The client reads the ring without being woken unless it is parked
+    if(ring_write(session->ring, message, size))
+      session->overflow = result = 1;
+  }else if(session->notifications.len + size > SESSION_MAX_BACKLOG){
+    session->overflow = 1;
+    result = 1;
+  }else if(queue_append(&session->notifications, CHANNEL_NOTIFICATION, message, size)){
+    result = 1;
+  }else{
+    // Writes straight away what the pipe accepts, the rest is written by the event loop
+    queue_flush(&session->notifications, notif_fd, session->notifications.len);
+  }
+  session_update_events(session);
+  pthread_mutex_unlock(&session->lock);
+
+  pthread_rwlock_unlock(&SESSIONS_TABLE_LOCK);
+  return result;
+}
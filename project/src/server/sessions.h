@@ -0,0 +1,91 @@
+/**
+ * @file sessions.h
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief The session layer of the server. The connected clients are
+ * spread over a small pool of event loops (epoll), each one serving
+ * many clients through non-blocking pipes, so the number of clients
+ * is bounded by the file descriptors and not by the threads.
+ *
+ * The clients connect through the server pipe or, alternatively,
+ * through a Unix domain socket (SOCK_SEQPACKET).
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef KVS_SESSIONS_H
+#define KVS_SESSIONS_H
+
+#include <stddef.h>
+#include "pool.h"
+
+/**
+ * @brief Initializes the sessions table and starts the event loops.
+ *
+ * @param pool Pool that commits the writes of the clients to the log, so
+ * the event loops do not wait for it. NULL to wait in the event loops.
+ * @return 0 if the session layer was initialized successfully, 1 otherwise.
+ */
+int sessions_init(Pool* pool);
+
+/**
+ * @brief Stops the event loops, disconnects every client and frees
+ * the sessions table.
+ */
+void sessions_terminate();
+
+/**
+ * @brief Starts the connection with a client and hands the new session to
+ * one of the event loops, which opens the pipes of the client as soon as it
+ * opens them, without waiting, and drops it if it does not within
+ * SESSION_CONNECT_TIMEOUT_MS.
+ *
+ * @param paths The request, response and notifications pipes paths of the
+ * client, each one with MAX_PIPE_PATH_LENGTH bytes, in this order. A
+ * notifications path with the RING_SCHEME names a shared memory ring.
+ * @return 0 if the session was handed to an event loop, 1 if the
+ * connection is refused.
+ */
+int session_accept(const char* paths);
+
+/**
+ * @brief Creates the socket where the clients may connect instead of
+ * using the server pipe.
+ *
+ * @param path Path of the socket.
+ * @return The non-blocking listening socket, -1 on failure.
+ */
+int session_listen(const char* path);
+
+/**
+ * @brief Accepts a connection pending on the listening socket and hands
+ * the new session to one of the event loops, which completes the
+ * connection once the client sends its connection request.
+ *
+ * @param listen_fd The listening socket.
+ * @return 0 if a client was accepted or none was pending, 1 otherwise.
+ */
+int session_accept_socket(int listen_fd);
+
+/**
+ * @brief Disconnects all the clients. The sessions are closed by their
+ * event loops, so this function returns before they are all closed.
+ */
+void sessions_close_all();
+
+/**
+ * @brief Sends a notification to the client that owns the given
+ * notifications pipe. The notification is queued if the pipe is full
+ * and written by the event loop of the session as soon as possible, or
+ * written to the ring of the session if the client uses one.
+ *
+ * @param notif_fd Notifications pipe of the client.
+ * @param message The notification.
+ * @param size Size of the notification.
+ * @return 0 if the notification was written or queued, 1 otherwise.
+ */
+int session_notify(int notif_fd, const char* message, size_t size);
+
+#endif  // KVS_SESSIONS_H
@@ -0,0 +1,177 @@
+/**
+ * @file timers.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A timer service: a single thread keeps the pending timers in a
+ * heap ordered by deadline and, as each deadline passes, hands its item
+ * to the expiration function given when the service was started.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include "timers.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct {
+  struct timespec deadline;
+  void* item;
+} Timer;
+
+// Pending timers, a heap with the earliest deadline first
+static Timer* TIMERS = NULL;
+static size_t NUM_TIMERS = 0, TIMERS_CAPACITY = 0;
+
+static void (*EXPIRE)(void* item) = NULL;
+static int STARTED = 0, STOPPING = 0;
+static pthread_mutex_t TIMERS_LOCK = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t TIMERS_CHANGED;
+static pthread_t TIMERS_THREAD;
+
+static int before(const struct timespec* a, const struct timespec* b){
+  return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void swap_timers(size_t i, size_t j){
+  Timer aux = TIMERS[i];
+  TIMERS[i] = TIMERS[j];
+  TIMERS[j] = aux;
+}
+
+static void push_timer(Timer timer){
+  size_t i = NUM_TIMERS++;
+  TIMERS[i] = timer;
+  while(i > 0 && before(&TIMERS[i].deadline, &TIMERS[(i - 1) / 2].deadline)){
+    swap_timers(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static Timer pop_timer(){
+  Timer first = TIMERS[0];
+  TIMERS[0] = TIMERS[--NUM_TIMERS];
+
+  size_t i = 0;
+  while(1){
+    size_t smallest = i, left = 2*i + 1, right = 2*i + 2;
+    if(left < NUM_TIMERS && before(&TIMERS[left].deadline, &TIMERS[smallest].deadline))
+      smallest = left;
+    if(right < NUM_TIMERS && before(&TIMERS[right].deadline, &TIMERS[smallest].deadline))
+      smallest = right;
+    if(smallest == i)
+      break;
+    swap_timers(i, smallest);
+    i = smallest;
+  }
+  return first;
+}
+
+static void* run_timers(void* arg){
+  (void) arg;
+
+  // Signals are handled by the host thread
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+  pthread_mutex_lock(&TIMERS_LOCK);
+  while(!STOPPING){
+    if(NUM_TIMERS == 0){
+      pthread_cond_wait(&TIMERS_CHANGED, &TIMERS_LOCK);
+      continue;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(before(&now, &TIMERS[0].deadline)){
+      // Woken up earlier if a timer with an earlier deadline is added
+      pthread_cond_timedwait(&TIMERS_CHANGED, &TIMERS_LOCK, &TIMERS[0].deadline);
+      continue;
+    }
+
+    // The item is handed without the lock, so timers can be added meanwhile
+    Timer timer = pop_timer();
+    pthread_mutex_unlock(&TIMERS_LOCK);
+    EXPIRE(timer.item);
+    pthread_mutex_lock(&TIMERS_LOCK);
+  }
+  pthread_mutex_unlock(&TIMERS_LOCK);
+
+  return NULL;
+}
+
+int timers_init(void (*expire)(void* item)){
+  // The deadlines are not affected by changes of the time of day
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  int result = pthread_cond_init(&TIMERS_CHANGED, &attr);
+  pthread_condattr_destroy(&attr);
+  if(result != 0)
+    return 1;
+
+  EXPIRE = expire;
+  STOPPING = 0;
+  if(pthread_create(&TIMERS_THREAD, NULL, run_timers, NULL) != 0){
+    fprintf(stderr, "[TIMERS] Failed to create the timers thread.\n");
+    pthread_cond_destroy(&TIMERS_CHANGED);
+    return 1;
+  }
+  STARTED = 1;
+  return 0;
+}
+
+int timer_add(unsigned int delay_ms, void* item){
+  Timer timer = {.item = item};
+  clock_gettime(CLOCK_MONOTONIC, &timer.deadline);
+  timer.deadline.tv_sec += delay_ms / 1000;
+  timer.deadline.tv_nsec += (long) (delay_ms % 1000) * 1000000;
+  if(timer.deadline.tv_nsec >= 1000000000){
+    timer.deadline.tv_sec++;
+    timer.deadline.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&TIMERS_LOCK);
+  if(!STARTED){
+    pthread_mutex_unlock(&TIMERS_LOCK);
+    return 1;
+  }
+  if(NUM_TIMERS == TIMERS_CAPACITY){
+    size_t capacity = TIMERS_CAPACITY ? 2 * TIMERS_CAPACITY : 64;
+    Timer* timers = realloc(TIMERS, capacity * sizeof(Timer));
+    if(timers == NULL){
+      pthread_mutex_unlock(&TIMERS_LOCK);
+      return 1;
+    }
+    TIMERS = timers;
+    TIMERS_CAPACITY = capacity;
+  }
+  push_timer(timer);
+  pthread_cond_signal(&TIMERS_CHANGED);
+  pthread_mutex_unlock(&TIMERS_LOCK);
+  return 0;
+}
+
+void timers_terminate(){
+  if(!STARTED)
+    return;
+
+  pthread_mutex_lock(&TIMERS_LOCK);
+  STOPPING = 1;
+  pthread_cond_signal(&TIMERS_CHANGED);
+  pthread_mutex_unlock(&TIMERS_LOCK);
+
+  pthread_join(TIMERS_THREAD, NULL);
+  pthread_cond_destroy(&TIMERS_CHANGED);
+  free(TIMERS);
+  TIMERS = NULL;
+  NUM_TIMERS = TIMERS_CAPACITY = 0;
+  STARTED = 0;
+}
@@ -0,0 +1,41 @@
+/**
+ * @file timers.h
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A timer service: a single thread keeps the pending timers in a
+ * heap ordered by deadline and, as each deadline passes, hands its item
+ * to the expiration function given when the service was started.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef KVS_TIMERS_H
+#define KVS_TIMERS_H
+
+/**
+ * @brief Starts the timer service.
+ *
+ * @param expire Function called, in the thread of the service, with the
+ * item of each timer whose deadline passed.
+ * @return 0 if the service was started, 1 otherwise.
+ */
+int timers_init(void (*expire)(void* item));
+
+/**
+ * @brief Adds a timer.
+ *
+ * @param delay_ms Delay in milliseconds until the timer expires.
+ * @param item Item given to the expiration function.
+ * @return 0 if the timer was added, 1 otherwise, also if the service is
+ * not running.
+ */
+int timer_add(unsigned int delay_ms, void* item);
+
+/**
+ * @brief Stops the timer service. The timers still pending are dropped.
+ */
+void timers_terminate();
+
+#endif  // KVS_TIMERS_H
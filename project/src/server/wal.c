@@ -0,0 +1,469 @@
+/**
+ * @file wal.c
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A write-ahead log of the changes made to the KVS. Each batch of
+ * writes or deletes is appended as a record while its keys are locked,
+ * so the log keeps the order in which the changes were made to each key.
+ * The threads that commit at the same time share one write and one
+ * fdatasync: the first one writes the records of all of them, and the
+ * ones that arrive meanwhile are written together next. When the server
+ * starts the log is replayed, which rebuilds the table.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#include "wal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "../common/io.h"
+
+enum RecordType {
+  RECORD_WRITE = 'W',
+  RECORD_DELETE = 'D'
+};
+
+// Size and checksum before each record
+#define RECORD_HEADER_SIZE (2 * sizeof(uint32_t))
+
+static struct {
+  int fd;
+  enum WalSync sync;
+  unsigned int interval_ms;
+
+  // Records logged and not yet written, and the buffer being written
+  char *buffer, *spare;
+  size_t used, capacity, spare_capacity;
+
+  uint64_t appended;        // End of the last record logged
+  uint64_t flushed;         // End of the log written (and synced)
+  int flushing;             // A thread is writing the log
+  int failed;               // The log could not be written
+  int stopping;
+  pthread_mutex_t lock;
+  pthread_cond_t flushed_cond;
+  pthread_cond_t stop_cond;
+  pthread_t syncer;
+} WAL = {.fd = -1};
+
+static uint32_t checksum(const char* data, size_t size){
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for(size_t i = 0; i < size; i++){
+    hash ^= (unsigned char) data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// REPLAY //
+
+// Reads a key or value of a record, 0 if it does not fit in the record
+static size_t get_string(const char* data, size_t size, size_t pos, char str[MAX_STRING_SIZE]){
+  if(pos >= size)
+    return 0;
+  size_t len = (unsigned char) data[pos];
+  if(len >= MAX_STRING_SIZE || pos + 1 + len > size)
+    return 0;
+  memcpy(str, data + pos + 1, len);
+  str[len] = '\0';
+  return 1 + len;
+}
+
+// Applies a record, 1 if it is malformed
+static int replay_record(const char* data, size_t size,
+                         int (*write_pairs)(size_t, char[][MAX_STRING_SIZE], char[][MAX_STRING_SIZE]),
+                         int (*delete_keys)(size_t, char[][MAX_STRING_SIZE], char[])){
+  uint32_t count;
+  if(size < 1 + sizeof(count))
+    return 1;
+  char type = data[0];
+  memcpy(&count, data + 1, sizeof(count));
+  if(count == 0 || (type != RECORD_WRITE && type != RECORD_DELETE))
+    return 1;
+
+  char (*keys)[MAX_STRING_SIZE] = malloc(count * sizeof(*keys));
+  char (*values)[MAX_STRING_SIZE] = type == RECORD_WRITE ? malloc(count * sizeof(*values)) : NULL;
+  char* missing = type == RECORD_DELETE ? malloc(count) : NULL;
+  int result = keys == NULL || (values == NULL && missing == NULL);
+
+  size_t pos = 1 + sizeof(count);
+  for(uint32_t i = 0; i < count && !result; i++){
+    size_t len = get_string(data, size, pos, keys[i]);
+    pos += len;
+    if(len > 0 && type == RECORD_WRITE){
+      size_t value_len = get_string(data, size, pos, values[i]);
+      len = value_len > 0 ? len : 0;
+      pos += value_len;
+    }
+    result = len == 0;
+  }
+
+  if(!result)
+    result = type == RECORD_WRITE ? write_pairs(count, keys, values)
+                                  : delete_keys(count, keys, missing);
+  free(keys);
+  free(values);
+  free(missing);
+  return result;
+}
+
+// Replays the records of the log and sets where the valid records end.
+// Returns 1 if a valid record could not be applied, the records after it
+// being committed changes that must not be dropped.
+static int replay_log(const char* data, size_t size,
+                      int (*write_pairs)(size_t, char[][MAX_STRING_SIZE], char[][MAX_STRING_SIZE]),
+                      int (*delete_keys)(size_t, char[][MAX_STRING_SIZE], char[]),
+                      size_t* end, size_t* num_records){
+  size_t pos = WAL_MAGIC_SIZE;
+  *num_records = 0;
+  while(pos + RECORD_HEADER_SIZE <= size){
+    uint32_t record_size, record_checksum;
+    memcpy(&record_size, data + pos, sizeof(record_size));
+    memcpy(&record_checksum, data + pos + sizeof(record_size), sizeof(record_checksum));
+
+    // A record cut short or corrupted ends the log
+    const char* record = data + pos + RECORD_HEADER_SIZE;
+    if(record_size > size - pos - RECORD_HEADER_SIZE
+       || checksum(record, record_size) != record_checksum)
+      break;
+    if(replay_record(record, record_size, write_pairs, delete_keys)){
+      fprintf(stderr, "[WAL] Failed to replay the record at byte %zu.\n", pos);
+      return 1;
+    }
+    pos += RECORD_HEADER_SIZE + record_size;
+    (*num_records)++;
+  }
+  *end = pos;
+  return 0;
+}
+
+// Reads the whole log, which is replayed before the server starts
+static char* read_log(int fd, size_t* size){
+  struct stat st;
+  if(fstat(fd, &st) != 0)
+    return NULL;
+  *size = (size_t) st.st_size;
+  char* data = malloc(*size + 1);
+  if(data == NULL)
+    return NULL;
+
+  size_t done = 0;
+  while(done < *size){
+    ssize_t bytes_read = read(fd, data + done, *size - done);
+    if(bytes_read < 0 && errno == EINTR)
+      continue;
+    if(bytes_read <= 0)
+      break;
+    done += (size_t) bytes_read;
+  }
+  *size = done;
+  return data;
+}
+
+// WRITE THE LOG //
+
+// Writes the records logged so far, with WAL.lock held. The lock is
+// released meanwhile, so the next records are logged to the other buffer.
+static void flush_log(int sync){
+  char* data = WAL.buffer;
+  size_t size = WAL.used, capacity = WAL.capacity;
+  uint64_t end = WAL.appended;
+  WAL.buffer = WAL.spare;
+  WAL.capacity = WAL.spare_capacity;
+  WAL.used = 0;
+  WAL.flushing = 1;
+  pthread_mutex_unlock(&WAL.lock);
+
+  int failed = (size > 0 && write_all(WAL.fd, data, size) < 0)
+               || (sync && fdatasync(WAL.fd) != 0);
+
+  pthread_mutex_lock(&WAL.lock);
+  WAL.spare = data;
+  WAL.spare_capacity = capacity;
+  if(failed){
+    fprintf(stderr, "[WAL] Failed to write the log.\n");
+    WAL.failed = 1;
+  }else{
+    WAL.flushed = end;
+  }
+  WAL.flushing = 0;
+  pthread_cond_broadcast(&WAL.flushed_cond);
+}
+
+// Syncs the log periodically, for WAL_SYNC_INTERVAL
+static void* sync_log(void* arg){
+  (void) arg;
+
+  // Signals are handled by the host thread
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGUSR1);
+  sigaddset(&sigset, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+
+  pthread_mutex_lock(&WAL.lock);
+  while(!WAL.stopping){
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += WAL.interval_ms / 1000;
+    deadline.tv_nsec += (long) (WAL.interval_ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000){
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    while(!WAL.stopping && pthread_cond_timedwait(&WAL.stop_cond, &WAL.lock, &deadline) != ETIMEDOUT)
+      ;
+
+    if(WAL.appended > WAL.flushed && !WAL.flushing)
+      flush_log(1);
+  }
+  pthread_mutex_unlock(&WAL.lock);
+  return NULL;
+}
+
+// Reserves room for a record in the buffer, with WAL.lock held
+static char* reserve_record(size_t size){
+  if(WAL.used + size > WAL.capacity){
+    size_t capacity = WAL.capacity ? WAL.capacity : 4096;
+    while(WAL.used + size > capacity)
+      capacity *= 2;
+    char* buffer = realloc(WAL.buffer, capacity);
+    if(buffer == NULL){
+      fprintf(stderr, "[WAL] Failed to allocate a record.\n");
+      WAL.failed = 1;
+      return NULL;
+    }
+    WAL.buffer = buffer;
+    WAL.capacity = capacity;
+  }
+  char* record = WAL.buffer + WAL.used;
+  WAL.used += size;
+  WAL.appended += size;
+  return record;
+}
+
+static size_t put_string(char* dest, const char* str){
+  size_t len = strnlen(str, MAX_STRING_SIZE - 1);
+  dest[0] = (char) len;
+  memcpy(dest + 1, str, len);
+  return 1 + len;
+}
+
+// Appends a record with the given keys (and values), skipping the keys
+// marked in skip. Returns the end of the record, 0 if nothing was logged.
+static uint64_t log_record(enum RecordType type, size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                           char values[][MAX_STRING_SIZE], const char skip[]){
+  uint32_t count = 0;
+  size_t size = 1 + sizeof(count);
+  for(size_t i = 0; i < num_pairs; i++){
+    if(skip != NULL && skip[i])
+      continue;
+    count++;
+    size += 1 + strnlen(keys[i], MAX_STRING_SIZE - 1);
+    if(values != NULL)
+      size += 1 + strnlen(values[i], MAX_STRING_SIZE - 1);
+  }
+  if(count == 0)
+    return 0;
+
+  pthread_mutex_lock(&WAL.lock);
+  char* record = reserve_record(RECORD_HEADER_SIZE + size);
+  if(record == NULL){
+    uint64_t end = WAL.appended;
+    pthread_mutex_unlock(&WAL.lock);
+    return end;
+  }
+
+  char* payload = record + RECORD_HEADER_SIZE;
+  size_t pos = 0;
+  payload[pos++] = (char) type;
+  memcpy(payload + pos, &count, sizeof(count));
+  pos += sizeof(count);
+  for(size_t i = 0; i < num_pairs; i++){
+    if(skip != NULL && skip[i])
+      continue;
+    pos += put_string(payload + pos, keys[i]);
+    if(values != NULL)
+      pos += put_string(payload + pos, values[i]);
+  }
+
+  uint32_t record_size = (uint32_t) size, record_checksum = checksum(payload, size);
+  memcpy(record, &record_size, sizeof(record_size));
+  memcpy(record + sizeof(record_size), &record_checksum, sizeof(record_checksum));
+  uint64_t end = WAL.appended;
+  pthread_mutex_unlock(&WAL.lock);
+  return end;
+}
+
+int wal_open(const char* path, enum WalSync sync, unsigned int interval_ms,
+             int (*write_pairs)(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                                char values[][MAX_STRING_SIZE]),
+             int (*delete_keys)(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                                char missing[])){
+  int fd = open(path, O_RDWR|O_CREAT, S_IRUSR|S_IWUSR);
+  if(fd < 0){
+    fprintf(stderr, "[WAL] Failed to open the log %s\n", path);
+    return 1;
+  }
+
+  size_t size;
+  char* data = read_log(fd, &size);
+  if(data == NULL){
+    fprintf(stderr, "[WAL] Failed to read the log %s\n", path);
+    close(fd);
+    return 1;
+  }
+
+  // An empty log is started, any other must be a log
+  size_t end = WAL_MAGIC_SIZE, num_records = 0;
+  if(size == 0){
+    if(write_all(fd, WAL_MAGIC, WAL_MAGIC_SIZE) < 0){
+      free(data);
+      close(fd);
+      return 1;
+    }
+  }else if(size < WAL_MAGIC_SIZE || memcmp(data, WAL_MAGIC, WAL_MAGIC_SIZE) != 0){
+    fprintf(stderr, "[WAL] %s is not a log.\n", path);
+    free(data);
+    close(fd);
+    return 1;
+  }else if(replay_log(data, size, write_pairs, delete_keys, &end, &num_records)){
+    fprintf(stderr, "[WAL] The log %s is kept as it is, the server does not start.\n", path);
+    free(data);
+    close(fd);
+    return 1;
+  }
+  free(data);
+
+  // Only a record cut short or corrupted, and what follows it, is dropped
+  if((end < size && ftruncate(fd, (off_t) end) != 0)
+     || lseek(fd, (off_t) end, SEEK_SET) < 0 || fdatasync(fd) != 0){
+    fprintf(stderr, "[WAL] Failed to prepare the log %s\n", path);
+    close(fd);
+    return 1;
+  }
+  if(num_records > 0){
+    fprintf(stdout, "[WAL] Replayed %zu changes from %s\n", num_records, path);
+    fflush(stdout);
+  }
+
+  WAL.fd = fd;
+  WAL.sync = sync;
+  WAL.interval_ms = interval_ms > 0 ? interval_ms : 1;
+  WAL.appended = WAL.flushed = end;
+  WAL.stopping = 0;
+  pthread_mutex_init(&WAL.lock, NULL);
+  pthread_cond_init(&WAL.flushed_cond, NULL);
+
+  // The interval is not affected by changes of the time of day
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&WAL.stop_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if(sync == WAL_SYNC_INTERVAL && pthread_create(&WAL.syncer, NULL, sync_log, NULL) != 0){
+    fprintf(stderr, "[WAL] Failed to create the sync thread, every commit is synced.\n");
+    WAL.sync = WAL_SYNC_ALWAYS;
+  }
+  return 0;
+}
+
+uint64_t wal_log_write(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                       char values[][MAX_STRING_SIZE]){
+  if(WAL.fd < 0)
+    return 0;
+
+  // A key written more than once in the batch keeps its last value, so
+  // only that one is logged
+  char* skip = malloc(num_pairs);
+  if(skip == NULL){
+    fprintf(stderr, "[WAL] Failed to allocate a record.\n");
+    return log_record(RECORD_WRITE, num_pairs, keys, values, NULL);
+  }
+  for(size_t i = 0; i < num_pairs; i++)
+    skip[i] = i + 1 < num_pairs && strncmp(keys[i], keys[i + 1], MAX_STRING_SIZE) == 0;
+  uint64_t end = log_record(RECORD_WRITE, num_pairs, keys, values, skip);
+  free(skip);
+  return end;
+}
+
+uint64_t wal_log_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], const char missing[]){
+  if(WAL.fd < 0)
+    return 0;
+  return log_record(RECORD_DELETE, num_pairs, keys, NULL, missing);
+}
+
+int wal_commit(uint64_t position){
+  if(position == 0 || WAL.fd < 0)
+    return 0;
+
+  pthread_mutex_lock(&WAL.lock);
+  if(WAL.sync == WAL_SYNC_INTERVAL){
+    int failed = WAL.failed;
+    pthread_mutex_unlock(&WAL.lock);
+    return failed;
+  }
+
+  // The first thread to commit writes the records of the others as well
+  while(WAL.flushed < position && !WAL.failed){
+    if(WAL.flushing)
+      pthread_cond_wait(&WAL.flushed_cond, &WAL.lock);
+    else
+      flush_log(WAL.sync == WAL_SYNC_ALWAYS);
+  }
+  int failed = WAL.failed;
+  pthread_mutex_unlock(&WAL.lock);
+  return failed;
+}
+
+int wal_committed(uint64_t position){
+  if(position == 0 || WAL.fd < 0)
+    return 1;
+
+  pthread_mutex_lock(&WAL.lock);
+  int committed = WAL.failed ? -1 : WAL.sync == WAL_SYNC_INTERVAL || WAL.flushed >= position;
+  pthread_mutex_unlock(&WAL.lock);
+  return committed;
+}
+
+void wal_close(){
+  if(WAL.fd < 0)
+    return;
+
+  pthread_mutex_lock(&WAL.lock);
+  WAL.stopping = 1;
+  pthread_cond_signal(&WAL.stop_cond);
+  pthread_mutex_unlock(&WAL.lock);
+  if(WAL.sync == WAL_SYNC_INTERVAL)
+    pthread_join(WAL.syncer, NULL);
+
+  // What is left is synced, whatever the policy
+  pthread_mutex_lock(&WAL.lock);
+  while(WAL.flushing)
+    pthread_cond_wait(&WAL.flushed_cond, &WAL.lock);
+  if(!WAL.failed)
+    flush_log(1);
+  pthread_mutex_unlock(&WAL.lock);
+
+  close(WAL.fd);
+  WAL.fd = -1;
+  free(WAL.buffer);
+  free(WAL.spare);
+  WAL.buffer = WAL.spare = NULL;
+  WAL.used = WAL.capacity = WAL.spare_capacity = 0;
+  pthread_mutex_destroy(&WAL.lock);
+  pthread_cond_destroy(&WAL.flushed_cond);
+  pthread_cond_destroy(&WAL.stop_cond);
+}
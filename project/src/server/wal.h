@@ -0,0 +1,103 @@
+/**
+ * @file wal.h
+ *
+ * @author Pedro Vicente (ist1109852), Pedro Jerónimo (ist1110375)
+ *
+ * @brief A write-ahead log of the changes made to the KVS. Each batch of
+ * writes or deletes is appended as a record while its keys are locked,
+ * so the log keeps the order in which the changes were made to each key.
+ * The threads that commit at the same time share one write and one
+ * fdatasync: the first one writes the records of all of them, and the
+ * ones that arrive meanwhile are written together next. When the server
+ * starts the log is replayed, which rebuilds the table.
+ *
+ * The file starts with WAL_MAGIC, followed by the records: the size of
+ * the record (uint32_t), its checksum (uint32_t), the type (one byte),
+ * the number of keys (uint32_t) and each key (and its value, for a
+ * write) as its length (one byte) and its characters.
+ *
+ * @copyright Copyright (c) 2025
+ *
+ */
+
+#ifndef KVS_WAL_H
+#define KVS_WAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "constants.h"
+
+#define WAL_MAGIC "\177KVSWAL1"
+#define WAL_MAGIC_SIZE 8
+
+// When a committed change is on the disk
+enum WalSync {
+  WAL_SYNC_ALWAYS,      // Before the commit returns
+  WAL_SYNC_INTERVAL,    // Within the interval of the log
+  WAL_SYNC_NEVER        // When the system writes it, the log is only written
+};
+
+/**
+ * @brief Replays the log, if it exists, and opens it to append the
+ * changes made from now on. A record that was not fully written when the
+ * server stopped is dropped.
+ *
+ * @param path Path of the log.
+ * @param sync When the committed changes are synced.
+ * @param interval_ms Interval between syncs, for WAL_SYNC_INTERVAL.
+ * @param write_pairs Applies a write replayed.
+ * @param delete_keys Applies a delete replayed.
+ * @return 0 if the log was replayed and opened, 1 otherwise.
+ */
+int wal_open(const char* path, enum WalSync sync, unsigned int interval_ms,
+             int (*write_pairs)(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                                char values[][MAX_STRING_SIZE]),
+             int (*delete_keys)(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                                char missing[]));
+
+/**
+ * @brief Appends a write to the log, with its keys locked.
+ *
+ * @param num_pairs Number of pairs, sorted by key.
+ * @param keys Keys written.
+ * @param values Values written.
+ * @return Position of the record, to be committed, 0 if the log is not open.
+ */
+uint64_t wal_log_write(size_t num_pairs, char keys[][MAX_STRING_SIZE],
+                       char values[][MAX_STRING_SIZE]);
+
+/**
+ * @brief Appends a delete to the log, with its keys locked.
+ *
+ * @param num_pairs Number of keys.
+ * @param keys Keys to be deleted.
+ * @param missing 1 for each key that did not exist, which is not logged.
+ * @return Position of the record, to be committed, 0 if the log is not
+ * open or nothing was deleted.
+ */
+uint64_t wal_log_delete(size_t num_pairs, char keys[][MAX_STRING_SIZE], const char missing[]);
+
+/**
+ * @brief Waits until the log is written up to the given position, and
+ * synced if every commit is synced.
+ *
+ * @param position Position returned when the record was logged.
+ * @return 0 if the record was committed, 1 otherwise.
+ */
+int wal_commit(uint64_t position);
+
+/**
+ * @brief Tells, without waiting, whether wal_commit would return at once.
+ *
+ * @param position Position returned when the record was logged.
+ * @return 1 if the record is committed, 0 if it is not yet, -1 if the log
+ * could not be written.
+ */
+int wal_committed(uint64_t position);
+
+/**
+ * @brief Writes and syncs what is left of the log and closes it.
+ */
+void wal_close();
+
+#endif  // KVS_WAL_H